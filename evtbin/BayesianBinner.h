@@ -4,7 +4,6 @@
 #ifndef evtbin_BayesianBinner_h
 #define evtbin_BayesianBinner_h
 
-#include <deque>
 #include <string>
 #include <vector>
 
@@ -17,14 +16,34 @@ namespace evtbin {
   class BayesianBinner : public OrderedBinner {
     public:
       /** \brief Construct a Bayesian block binner object, using any kind of iterator to provide the cell population.
+          \param intervals The cells, which must be contiguous and in increasing order.
+          \param cell_begin Iterator pointing to the population of the first cell.
+          \param name The name of the binner.
+          \param ncp_prior The prior penalty per change point.
+          \param prune If true, discard candidate block starts which can never again be optimal (PELT). This gives
+                 the same blocks but is close to linear in the number of cells rather than quadratic.
       */
       template <typename Itor>
       BayesianBinner(const IntervalCont_t & intervals, Itor cell_begin, const std::string & name = std::string(),
-        double ncp_prior = 9.): OrderedBinner(IntervalCont_t(), name), m_cell_pop(cell_begin, cell_begin + intervals.size()),
-        m_ncp_prior(ncp_prior) {
-        computeBlocks(intervals);
+        double ncp_prior = 9., bool prune = false): OrderedBinner(IntervalCont_t(), name),
+        m_cell_pop(cell_begin, cell_begin + intervals.size()), m_ncp_prior(ncp_prior) {
+        computeBlocks(intervals, prune);
       }
 
+      /** \brief Construct a Bayesian block binner object directly from individual event times (event mode). Each
+                 distinct event time defines one cell, bounded by the midpoints between it and its neighbors, with
+                 the first and last cells extending to the ends of the time range. Events which share a time are
+                 merged into one cell. Events outside the time range are ignored.
+          \param begin The beginning of the time range.
+          \param end The end of the time range.
+          \param event_time The event times. These need not be sorted, but sorted input avoids a copy.
+          \param name The name of the binner.
+          \param ncp_prior The prior penalty per change point.
+          \param prune Whether to prune candidate block starts (see above).
+      */
+      BayesianBinner(double begin, double end, const std::vector<double> & event_time,
+        const std::string & name = std::string(), double ncp_prior = 9., bool prune = true);
+
       virtual ~BayesianBinner() throw();
 
       /** \brief Create copy of this object.
@@ -33,13 +52,10 @@ namespace evtbin {
 
     private:
       /** \brief Perform the Bayesian Block procedure to determine the block definitions.
+          \param intervals The cells.
+          \param prune Whether to prune candidate block starts.
       */
-      void computeBlocks(const IntervalCont_t & intervals);
-
-      /** \brief Internal utility to compute the log posterior (Bayes factor).
-      */
-      void computeLogProb(const std::deque<double> & rev_csize, const std::deque<double> & rev_cpop,
-        std::vector<double> & result) const;
+      void computeBlocks(const IntervalCont_t & intervals, bool prune);
 
       std::vector<double> m_cell_pop;
       const double m_ncp_prior;
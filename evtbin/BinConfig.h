@@ -7,6 +7,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 
 // Interactive parameter file access from st_app.
 #include "st_app/AppParGroup.h"
@@ -63,6 +64,13 @@ namespace evtbin {
     protected:
       typedef std::map<std::string, BinConfig *> ConfigCont;
       static ConfigCont s_config_cont;
+
+    private:
+      typedef std::map<std::string, std::vector<double> > EdgeCont;
+
+      // Bin edges of each equal-count binner already created, keyed by its parameters, so that the energy binner and
+      // the ebounds (which use the same parameters) read the event file only once between them.
+      mutable EdgeCont m_quant_edge_cont;
   };
 
 }
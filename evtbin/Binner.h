@@ -46,6 +46,30 @@ namespace evtbin {
       */
       virtual long computeIndex(double value) const = 0;
 
+      /** \brief Return the bin number for the given value, starting from the bin number found for a previous value.
+                 The result is always the same as computeIndex(value), but binners which must search for the bin may
+                 use the previous bin as a cursor, which is much faster when values arrive in increasing order, as
+                 event times do.
+          \param value The value being binned.
+          \param previous_index The bin number of a previous value, or a negative number if there is none.
+      */
+      virtual long computeNextIndex(double value, long /* previous_index */) const { return computeIndex(value); }
+
+      /** \brief Compute the bin numbers of an array of values, as computeIndex would, assigning -1 to values outside
+                 all bins. By default each value is looked up starting from the bin of the previous one, but binners whose
+                 bins can be computed independently for each value may override this with a loop the compiler can vectorize.
+          \param value Array of values.
+          \param num_values The number of values.
+          \param index Array which receives the bin numbers.
+      */
+      virtual void computeIndices(const double * value, long num_values, long * index) const {
+        long previous_index = -1;
+        for (long ii = 0; ii < num_values; ++ii) {
+          index[ii] = computeNextIndex(value[ii], previous_index);
+          if (0 <= index[ii]) previous_index = index[ii];
+        }
+      }
+
       /** \brief Return the number of bins currently defined.
       */
       virtual long getNumBins() const = 0;
@@ -59,6 +83,20 @@ namespace evtbin {
       */
       virtual Binner * clone() const = 0;
 
+      /** \brief Return the range of values accepted by this binner. By default this spans from the beginning of the
+                 first bin to the end of the last bin.
+      */
+      virtual Interval getDomain() const {
+        long num_bins = getNumBins();
+        if (0 >= num_bins) return Interval(0., 0.);
+        return Interval(getInterval(0).begin(), getInterval(num_bins - 1).end());
+      }
+
+      /** \brief Return true if this binner folds the values it accepts onto bins in a different coordinate (e.g. times
+                 onto pulse phase), in which case the bins do not lie inside the domain.
+      */
+      virtual bool isFolded() const { return false; }
+
       /** \brief Compute and return the bin width of the given bin.
           \param index The index of the bin.
       */
@@ -0,0 +1,62 @@
+/** \file ChannelBinner.h
+    \brief Declaration of a binner whose bins are individual integer channels.
+*/
+#ifndef evtbin_ChannelBinner_h
+#define evtbin_ChannelBinner_h
+
+#include <string>
+#include <vector>
+
+#include "evtbin/Binner.h"
+
+namespace evtbin {
+  /** \class ChannelBinner
+      \brief Declaration of a binner whose bins are individual integer channels, such as the PHA channels of GBM data.
+             Bin i holds the values which round to the i-th channel in the list, i.e. [channel - .5, channel + .5).
+             Channels are looked up in a table which spans the range of channels, so the list need not be contiguous.
+  */
+  class ChannelBinner : public Binner {
+    public:
+      typedef std::vector<long> ChannelCont_t;
+
+      /** \brief Construct a channel binner object. Throws an exception if the list is empty or a channel is repeated.
+          \param channels The channel number of each bin, in bin order.
+          \param name Optional name of the quantity being binned.
+      */
+      ChannelBinner(const ChannelCont_t & channels, const std::string & name = std::string());
+
+      /** \brief Return the bin number for the given value, or -1 if it does not round to one of the channels.
+          \param value The value being binned.
+      */
+      virtual long computeIndex(double value) const;
+
+      /** \brief Return the number of bins currently defined.
+      */
+      virtual long getNumBins() const;
+
+      /** \brief Return the interval spanned by the given bin.
+          \param index The index indicating the bin number.
+      */
+      virtual Binner::Interval getInterval(long index) const;
+
+      /** \brief Create copy of this object.
+      */
+      virtual Binner * clone() const;
+
+      /** \brief Compute the bin numbers of an array of values, each rounded to the nearest channel. Values which do not
+                 round to a channel in the list are assigned -1. Spectra filled in batches use this instead of computeIndex.
+          \param value Array of values.
+          \param num_values The number of values.
+          \param index Array which receives the bin numbers.
+      */
+      virtual void computeIndices(const double * value, long num_values, long * index) const;
+
+    private:
+      ChannelCont_t m_channels;
+      std::vector<long> m_lookup;
+      long m_offset;
+  };
+
+}
+
+#endif
@@ -12,6 +12,10 @@
 namespace evtbin {
   /** \class ConstSnBinner
       \brief Declaration of a linearly uniform interval binner.
+
+      Bins are defined in a separate phase, by calling defineBins with all the event times. After that, computeIndex
+      is an ordinary lookup which does not modify the binner, so events may be binned in any order, in batches or from
+      several threads. Until bins are defined, there is a single bin spanning the whole interval.
   */
   class ConstSnBinner : public OrderedBinner {
     public:
@@ -28,11 +32,34 @@ namespace evtbin {
 
       ~ConstSnBinner() throw() {}
 
+      /** \brief Define the bins from the given event times, replacing any bins defined previously. Events are
+                 accumulated in time order, and each bin is closed at the first event for which the S/N ratio of
+                 the counts above the background reaches the threshold. The last bin extends to the end of the interval.
+          \param event_time The event times. These need not be sorted, but sorted input avoids a copy.
+      */
+      void defineBins(const std::vector<double> & event_time);
+
+      /** \brief Define the bins from the given event times and energies, replacing any bins defined previously.
+                 Only events with lc_emin <= energy < lc_emax count toward the S/N ratio, so only they can close a
+                 bin. All events are still binned by computeIndex afterwards. If lc_emax <= lc_emin, no events are
+                 excluded.
+          \param event_time The event times.
+          \param event_energy The event energies, in the same order as the times.
+      */
+      void defineBins(const std::vector<double> & event_time, const std::vector<double> & event_energy);
+
       /** \brief Return the bin number for the given value.
           \param value The value being binned.
       */
       virtual long computeIndex(double value) const;
 
+      /** \brief Return the bin number for the given value. Bins of this binner are (], so the cursor of the
+                 base class does not apply, and this just calls computeIndex.
+          \param value The value being binned.
+          \param previous_index Ignored.
+      */
+      virtual long computeNextIndex(double value, long previous_index) const;
+
       /** \brief Return the number of bins currently defined.
       */
       virtual long getNumBins() const;
@@ -47,15 +74,17 @@ namespace evtbin {
       virtual Binner * clone() const;
 
     private:
+      /** \brief Return the integral of the background polynomial from 0 to the given value.
+          \param value The upper limit of the integral.
+      */
+      double integrateBackground(double value) const;
+
       std::vector<double> m_background_coeff;
       double m_interval_begin;
       double m_interval_end;
       double m_sn_ratio_squared;
       double m_lc_emin;
       double m_lc_emax;
-      mutable double m_counts;
-      mutable double m_background;
-      mutable double m_previous_value;
   };
 
 }
@@ -6,9 +6,10 @@
 #define evtbin_CountCube_h
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "evtbin/DataProduct.h"
-#include "evtbin/Hist3D.h"
 
 namespace astro {
   class SkyProj;
@@ -17,7 +18,8 @@ namespace astro {
 namespace evtbin {
 
   /** \class CountCube
-      \brief Encapsulation of a count map, with methods to read/write using tip.
+      \brief Encapsulation of a count map, with methods to read/write using tip. Cubes with logarithmic energy bins,
+             the usual case, are binned by a HistND whose binners are all inlined; other energy binners use a Hist3D.
   */
   class CountCube : public DataProduct {
     public:
@@ -40,14 +42,47 @@ namespace evtbin {
       */
       virtual void binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end);
 
-      /** \brief Write count map file.
+      /** \brief Bin input from a memory mapped table, reading the coordinates, energies (and event types) a batch at a time.
+          \param table The mapped table.
+          \param first_record The first record to be binned.
+          \param last_record One past the last record to be binned.
+      */
+      virtual void binInput(const MappedEventTable & table, long first_record, long last_record);
+
+      /** \brief Split the cube by event type, binning each event into one cube per event type it belongs to. The full
+                 cube is then freed, so a split cube cannot be rebinned.
+          \param event_types The event type bit masks.
+          \param field The name of the event type field, a bit array or an integer field.
+      */
+      virtual void setEventTypes(const EventTypeCont_t & event_types, const std::string & field = "EVENT_TYPE");
+
+      /** \brief Write count cube file, or one file per event type if the cube is split by event type.
           \param creator The value to write for the "CREATOR" keyword.
           \param out_file The output file name.
       */
       virtual void writeOutput(const std::string & creator, const std::string & out_file) const;
 
+    protected:
+      virtual std::string getSkyProjection() const;
+
     private:
-      Hist3D m_hist;
+      /** \brief Project and bin a batch of events, into the histogram of each event type if the cube is split.
+      */
+      void fillBatch(const double * ra, const double * dec, const double * energy, const unsigned long * event_type,
+        long num_events);
+
+      /** \brief Write one count cube file from the given histogram.
+      */
+      void writeImage(const std::string & creator, const std::string & out_file, const Hist & hist) const;
+
+      Hist * m_hist; // 0 if the cube is split by event type
+      std::vector<Hist *> m_type_hist;
+      std::vector<double> m_x; // scratch space for batches of projected coordinates
+      std::vector<double> m_y;
+      std::vector<double> m_type_x; // scratch space for the events of one event type in a batch
+      std::vector<double> m_type_y;
+      std::vector<double> m_type_energy;
+      std::vector<unsigned char> m_selected; // scratch space for batches of event type selections
       std::string m_proj_name;
       double m_crpix[2];
       double m_crval[2];
@@ -6,6 +6,8 @@
 #define evtbin_CountMap_h
 
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "evtbin/DataProduct.h"
 #include "evtbin/Hist2D.h"
@@ -40,14 +42,69 @@ namespace evtbin {
       */
       virtual void binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end);
 
-      /** \brief Write count map file.
+      /** \brief Bin input from a memory mapped table, reading the coordinates (and event types) a batch at a time.
+          \param table The mapped table.
+          \param first_record The first record to be binned.
+          \param last_record One past the last record to be binned.
+      */
+      virtual void binInput(const MappedEventTable & table, long first_record, long last_record);
+
+      /** \brief Split the map by event type, binning each event into one map per event type it belongs to. The full
+                 map is then freed, so a split map cannot be rebinned, and getHist2D throws.
+          \param event_types The event type bit masks.
+          \param field The name of the event type field, a bit array or an integer field.
+      */
+      virtual void setEventTypes(const EventTypeCont_t & event_types, const std::string & field = "EVENT_TYPE");
+
+      /** \brief Write count map file, or one file per event type if the map is split by event type.
           \param creator The value to write for the "CREATOR" keyword.
           \param out_file The output file name.
       */
       virtual void writeOutput(const std::string & creator, const std::string & out_file) const;
 
+    protected:
+      /** \brief Create the count map object, creating its histogram only if alloc_hist is true. Derived classes
+                 which bin into a histogram of their own pass false, and point m_hist_ptr to their histogram.
+      */
+      CountMap(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
+        const std::string & sc_table, double ref_ra, double ref_dec, const std::string & proj,
+        unsigned long num_x_pix, unsigned long num_y_pix, double pix_scale, double axis_rot, bool use_lb,
+        const std::string & ra_field, const std::string & dec_field, const Gti & gti, bool alloc_hist);
+
+      virtual std::string getSkyProjection() const;
+
+      /** \brief Project a batch of events onto the sky, storing their sky X/Y in m_coord.
+          \param ra Array of the events' RA (or L).
+          \param dec Array of the events' DEC (or B).
+          \param num_events The number of events.
+      */
+      void project(const double * ra, const double * dec, long num_events);
+
+      /** \brief Write one count map file holding the given image, laid out as by Hist2D::getImage, and GTI. The image
+                 has the size of the first two dimensions of the histogram m_hist_ptr points to.
+          \param creator The value to write for the "CREATOR" keyword.
+          \param out_file The output file name.
+          \param image The count map image.
+          \param gti The GTI to write to the GTI extension.
+      */
+      void writeImage(const std::string & creator, const std::string & out_file, const std::vector<float> & image,
+        const Gti & gti) const;
+
+      /** \brief Write the keywords which describe the sky projection of the first two image axes.
+          \param header The header of the image.
+      */
+      void writeSkyKeywords(tip::Header & header) const;
+
+      std::vector<std::pair<double, double> > m_coord; // scratch space for batches of projected coordinates
+
     private:
-      Hist2D m_hist;
+      /** \brief Project and bin a batch of events, into the histogram of each event type if the map is split.
+      */
+      void fillBatch(const double * ra, const double * dec, const unsigned long * event_type, long num_events);
+
+      Hist2D * m_hist; // 0 if the map is split by event type, or binned by a derived class
+      std::vector<Hist2D *> m_type_hist;
+      std::vector<unsigned char> m_selected; // scratch space for batches of event type selections
       std::string m_proj_name;
       double m_crpix[2];
       double m_crval[2];
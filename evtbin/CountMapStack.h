@@ -0,0 +1,100 @@
+/** \file CountMapStack.h
+    \brief Encapsulation of a stack of count maps over consecutive time windows, with methods to read/write using tip.
+*/
+#ifndef evtbin_CountMapStack_h
+#define evtbin_CountMapStack_h
+
+#include <string>
+#include <vector>
+
+#include "evtbin/CountMap.h"
+#include "evtbin/SparseHist3D.h"
+
+namespace evtbin {
+
+  class Binner;
+
+  /** \class CountMapStack
+      \brief Encapsulation of a stack of count maps, one per bin of a time binner (a "sky movie"), all binned in one
+             pass over the input. The sky projection is set up exactly as for a CountMap. Only the nonzero pixels of
+             each map are held in memory, so many short time windows are affordable. The output is either a single
+             cube whose third axis is time, or one count map file per time window.
+  */
+  class CountMapStack : public CountMap {
+    public:
+      /** \brief Create the count map stack object.
+      */
+      CountMapStack(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
+        const std::string & sc_table, double ref_ra, double ref_dec, const std::string & proj,
+        unsigned long num_x_pix, unsigned long num_y_pix, double pix_scale, double axis_rot, bool use_lb,
+        const std::string & ra_field, const std::string & dec_field, const Binner & time_binner, const Gti & gti);
+
+      virtual ~CountMapStack() throw();
+
+      /** \brief Bin input from input file/files passed to the constructor.
+      */
+      virtual void binInput();
+
+      /** \brief Bin input from tip table.
+          \param begin Table iterator pointing to the first record to be binned.
+          \param end Table iterator pointing to one past the last record to be binned.
+      */
+      virtual void binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end);
+
+      /** \brief Bin input from a memory mapped table, reading the coordinates and times a batch at a time.
+          \param table The mapped table.
+          \param first_record The first record to be binned.
+          \param last_record One past the last record to be binned.
+      */
+      virtual void binInput(const MappedEventTable & table, long first_record, long last_record);
+
+      /** \brief Count map stacks cannot be split by event type, so this throws an exception.
+      */
+      virtual void setEventTypes(const EventTypeCont_t & event_types, const std::string & field = "EVENT_TYPE");
+
+      /** \brief Select whether writeOutput() writes one count map file per time window instead of a single cube.
+          \param window_images True to write one file per time window.
+      */
+      void setWindowImages(bool window_images);
+
+      /** \brief Return the name of the count map file of one time window, inserting "_win" and the zero-padded
+                 window number before the extension of the given output file name.
+          \param out_file The output file name.
+          \param index The index of the time window.
+      */
+      std::string getWindowFileName(const std::string & out_file, long index) const;
+
+      /** \brief Write the stack as a cube, whose WINDOWS extension gives the time window, ontime and exposure of each
+                 plane, or, if so selected, as one count map file per time window, each with the GTI, ONTIME and
+                 EXPOSURE of its window.
+          \param creator The value to write for the "CREATOR" keyword.
+          \param out_file The output file name.
+      */
+      virtual void writeOutput(const std::string & creator, const std::string & out_file) const;
+
+    protected:
+      virtual const Binner * getTimeBinner() const;
+
+    private:
+      /** \brief Project and bin a batch of events, skipping the projection of events outside all the time windows.
+      */
+      void fillBatch(double * ra, double * dec, const double * time, long num_events);
+
+      void writeCube(const std::string & creator, const std::string & out_file) const;
+
+      /** \brief Write the planes of the stack into the image of a cube file already sized to hold them.
+      */
+      void writePlanes(const std::string & out_file) const;
+
+      void writeWindowImages(const std::string & creator, const std::string & out_file) const;
+
+      SparseHist3D m_stack_hist;
+      std::vector<long> m_time_index; // scratch space for batches of time window numbers
+      std::string m_sc_file;
+      std::string m_sc_table;
+      bool m_window_images;
+  };
+
+}
+
+#endif
@@ -7,6 +7,7 @@
 
 #include <ctime>
 #include <deque>
+#include <future>
 #include <list>
 #include <map>
 #include <string>
@@ -29,6 +30,7 @@ namespace evtbin {
   class Hist;
   class Hist1D;
   class Hist2D;
+  class MappedEventTable;
 
   /** \class DataProduct
       \brief Base class for encapsulations of specific data products, with methods to read/write them using tip.
@@ -40,6 +42,7 @@ namespace evtbin {
       typedef std::map<std::string, tip::KeyRecord> KeyValuePairCont_t;
       typedef std::map<std::string, KeyCont_t> StringKeyPairCont_t;
       typedef std::set<std::string> DefaultKeyCont_t;
+      typedef std::vector<unsigned long> EventTypeCont_t;
 
       /** \brief Construct data product object from the given event and spacecraft file.
       */
@@ -47,7 +50,8 @@ namespace evtbin {
 
       virtual ~DataProduct() throw();
 
-      /** \brief Bin input from input file/files passed to the constructor.
+      /** \brief Bin input from input file/files passed to the constructor. If the EXPOSURE keyword still needs to be
+                 computed from spacecraft data, that computation runs on another thread at the same time.
       */
       virtual void binInput();
 
@@ -57,6 +61,25 @@ namespace evtbin {
       */
       virtual void binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end);
 
+      /** \brief Bin input from a memory mapped table. Column values are decoded in batches and passed to the histogram.
+          \param table The mapped table.
+          \param first_record The first record to be binned.
+          \param last_record One past the last record to be binned.
+      */
+      virtual void binInput(const MappedEventTable & table, long first_record, long last_record);
+
+      /** \brief Fill this product from the histogram of a master product which was binned from the same events more
+                 finely, instead of rereading the events. Each dimension of this product's histogram must be present in
+                 the master's, with bin edges which line up with the master's bin edges; other dimensions of the master
+                 are summed over (e.g. PHA2 -> PHA1 or LC, CCUBE -> CMAP, fine LC -> coarse LC). The master's keywords
+                 other than time keywords are carried forward, and the GTI is restricted to that of the master.
+                 TSTART, TSTOP and ONTIME are recomputed from this product's own bins and GTI; EXPOSURE is carried
+                 forward from the master unless the restriction changed the GTI, in which case it is recomputed.
+                 Products split by event type cannot be rebinned, nor be masters.
+          \param master The master data product, which must already have been binned.
+      */
+      void rebin(const DataProduct & master);
+
       /** \brief Create a file, identifying the creator, and using the given template.
           \param creator The creator identifier, used to set the "CREATOR" keyword.
           \param out_file The output file name.
@@ -76,6 +99,13 @@ namespace evtbin {
       */
       virtual void writeGti(const std::string & out_file) const;
 
+      /** \brief Write the given GTI information to the given file's GTI extension. The extension must
+          exist.
+          \param out_file The output file name.
+          \param gti The GTI to write.
+      */
+      void writeGti(const std::string & out_file, const Gti & gti) const;
+
       /** \brief Write history to an output file from an input extension.
           exist.
           \param output_ext The output extension to which to write the history.
@@ -88,15 +118,20 @@ namespace evtbin {
       virtual const Gti & getGti() const;
 
       /** \brief Return the histogram which was used to bin this data product. Throws exception if
-          underlying histogram is not 1 dimensional.
+          underlying histogram is not 1 dimensional, or if the product is split by event type.
       */
       virtual const Hist1D & getHist1D() const;
 
       /** \brief Return the histogram which was used to bin this data product. Throws exception if
-          underlying histogram is not 2 dimensional.
+          underlying histogram is not a Hist2D, or if the product is split by event type.
       */
       virtual const Hist2D & getHist2D() const;
 
+      /** \brief Return the histogram which was used to bin this data product, of whatever type. Throws exception if
+          the product is split by event type.
+      */
+      virtual const Hist & getHist() const;
+
       /** \brief Use the given (time) binner to modify the Gti by finding the overlap.
           Returns true if the Gti was actually changed by this operation, false if the
           Gti was unchanged.
@@ -110,6 +145,40 @@ namespace evtbin {
       */
       virtual void writeEbounds(const std::string & out_file, const Binner * binner) const;
 
+      /** \brief Split this product by event type. Each event is binned once for every given event type whose bits it
+                 has in common with the event's event type field, into a separate histogram for each event type. All
+                 event types are binned in the same pass over the input, and writeOutput() then writes one output file
+                 per event type, named as given by getEventTypeFileName(). The base class version throws an exception;
+                 products which support this (count maps, count cubes and healpix maps) override it.
+          \param event_types The event type bit masks, e.g. 4, 8, 16 and 32 for the four PSF types.
+          \param field The name of the event type field, a bit array or an integer field.
+      */
+      virtual void setEventTypes(const EventTypeCont_t & event_types, const std::string & field = "EVENT_TYPE");
+
+      /** \brief Return the event types this product is split by, or an empty container if it is not split.
+      */
+      const EventTypeCont_t & getEventTypes() const;
+
+      /** \brief Return the name of the output file for one event type, inserting "_evtype<event_type>" before the
+                 extension of the given output file name.
+          \param out_file The output file name.
+          \param event_type The event type bit mask.
+      */
+      std::string getEventTypeFileName(const std::string & out_file, unsigned long event_type) const;
+
+      /** \brief Return the given file name with the given suffix inserted before its extension, or appended if it has
+                 no extension.
+          \param file_name The file name.
+          \param suffix The suffix to insert.
+      */
+      static std::string insertFileNameSuffix(const std::string & file_name, const std::string & suffix);
+
+      /** \brief Select tile compression for image output. Legal values are NONE (the default), RICE and GZIP.
+                 This only affects data products whose output is an image (count maps and cubes).
+          \param compression The name of the compression algorithm.
+      */
+      void setImageCompression(const std::string & compression);
+
       /** \brief Read values for all known keywords from the given file and extension.
            Any keywords missing from the header will simply be omitted in this object's
            container of key-value pairs.
@@ -142,7 +211,8 @@ namespace evtbin {
                  this data product is written.
 
                  Keywords TSTART, TSTOP are modified only if the binner has a tighter range than the values in the original file.
-                 Keywords EXPOSURE, ONTIME are computed from the spacecraft file.
+                 Keywords EXPOSURE, ONTIME are computed from the spacecraft file. The EXPOSURE computation is deferred: it
+                 runs concurrently with binInput(), and its result is stored before any keywords are written.
           \param sc_file The spacecraft data file used to compute time keywords.
           \param sc_table The name of the data table in the spacecraft data file.
           \param binner Optional binner used to adjust TSTART and TSTOP if necessary. 
@@ -171,6 +241,25 @@ namespace evtbin {
       */
       virtual double computeExposure(const std::string & sc_file, const std::string & sc_table) const;
 
+      /** \brief Store the EXPOSURE keyword if it is still pending, waiting for the computation started by binInput(),
+                 or computing it now if it was not started. The computation reads the spacecraft data through tip, so
+                 callers which bin several products concurrently must call this for every product before using tip.
+      */
+      void finishExposure() const;
+
+      /** \brief Compute the ontime and exposure of each bin of a time binner. The ontime of a bin is its overlap with the
+                 GTI; its exposure is the livetime of the spacecraft data prorated by their overlap with that part of
+                 the bin. All bins are done in a single sweep over the bins, the GTI and the spacecraft data. The bins of
+                 a folding binner get their fraction of the total ontime and exposure.
+          \param sc_file The name of the spacecraft data file to be used as input. If blank, exposure equals ontime.
+          \param sc_table The name of the data table in the spacecraft data file.
+          \param binner The time binner.
+          \param ontime Output ontime of each bin.
+          \param exposure Output exposure of each bin.
+      */
+      void computeBinExposure(const std::string & sc_file, const std::string & sc_table, const Binner & binner,
+        std::vector<double> & ontime, std::vector<double> & exposure) const;
+
       /** \brief Convert time object into a string representation suitable for storage in a date-like keyword.
           \param time The time to convert.
       */
@@ -181,7 +270,101 @@ namespace evtbin {
       */
       virtual double calcStatErr(double) const;
 
+      /** \brief Calculate statistical errors for an array of counts, by calling calcStatErr(double) for each of them,
+                 so that subclasses which override it are honored.
+          \param counts Array of counts.
+          \param num_counts The number of counts.
+          \param stat_err Array which receives the errors.
+      */
+      void calcStatErr(const double * counts, long num_counts, double * stat_err) const;
+
     protected:
+      /** \brief Throw an exception describing a cfitsio error, if the given cfitsio status is not 0.
+          \param status The status returned by cfitsio.
+          \param context Description of the operation which failed, used at the start of the message.
+      */
+      static void checkFitsStatus(int status, const std::string & context);
+
+      /** \brief Return a description of the sky projection used by this product's spatial bins, which must match for
+                 one product to be rebinned from another. Empty for products without spatial bins.
+      */
+      virtual std::string getSkyProjection() const;
+
+      /** \brief Return the binner of this product's time dimension, used to adjust TSTART and TSTOP, or 0 if its
+                 histogram has no time dimension.
+      */
+      virtual const Binner * getTimeBinner() const;
+
+      /** \brief Flag the events of a batch whose event type has bits in common with the given mask. There are no
+                 dependencies between events, so the compiler may vectorize the loop.
+          \param event_type Array of event types.
+          \param num_events The number of events.
+          \param mask The event type bit mask.
+          \param selected Array which receives 1 for each selected event and 0 for the others.
+      */
+      static void selectEventType(const unsigned long * event_type, long num_events, unsigned long mask,
+        unsigned char * selected);
+
+      /** \brief Read the event type of the current record of a table, as MappedEventTable::readBits does: a scalar
+                 field is read as an integer, and a bit array field is packed so that its last bit is the least
+                 significant bit.
+          \param record Iterator pointing to the record.
+      */
+      unsigned long readEventType(tip::Table::ConstIterator & record) const;
+
+      /** \brief Start computing the EXPOSURE keyword on another thread, if it is still pending.
+      */
+      void startExposure() const;
+
+      /** \brief Restrict binning of time-ordered input tables to the given (inclusive) time window. When set,
+                 binInput() bisects the named column of each input table whose rows are found to be sorted, and
+                 only the rows inside the window are passed on to be binned.
+          \param field The name of the time field.
+          \param begin The earliest time value which may be binned.
+          \param end The latest time value which may be binned.
+      */
+      void setTimeWindow(const std::string & field, double begin, double end);
+
+      /** \brief Narrow the range [begin, end) of the given table to the rows inside the time window, provided the
+                 table is ordered by time. The iterators are left unchanged if no time window was set or if
+                 the table does not appear to be sorted, either at sampled rows or next to the edges of the window.
+          \param table The input table.
+          \param begin Iterator pointing to the first record to be binned (input/output).
+          \param end Iterator pointing to one past the last record to be binned (input/output).
+      */
+      void seekTimeWindow(const tip::Table & table, tip::Table::ConstIterator & begin, tip::Table::ConstIterator & end) const;
+
+      /** \brief Narrow the range [first_record, last_record) of the given mapped table to the rows inside the time window,
+                 provided the table is ordered by time. The range is left unchanged under the same conditions as for
+                 a tip table.
+          \param table The mapped table.
+          \param first_record The first record to be binned (input/output).
+          \param last_record One past the last record to be binned (input/output).
+      */
+      void seekTimeWindow(const MappedEventTable & table, long & first_record, long & last_record) const;
+
+      /** \brief Return true if image compression was selected. Products writing an image then leave the primary array of
+                 the template empty and call writeCompressedImage instead of writing the image through tip.
+      */
+      bool isImageCompressed() const;
+
+      /** \brief Return the EXTNAME of the tile-compressed image extension written by writeCompressedImage.
+      */
+      static std::string getCompressedImageName();
+
+      /** \brief If image compression was selected, write the given image to the output file as a tile-compressed image
+                 extension named by getCompressedImageName, directly after the primary header as fpack writes it, and
+                 empty the primary array. The other extensions follow the image. The image is compressed as it is written, each tile holding one plane of the image. The compressed image carries all
+                 keywords of the primary header; the primary header keeps all but the WCS keywords. Pixels are stored as
+                 32 bit integers (BITPIX = 32), the same type as the uncompressed image of the templates, so
+                 counts are stored losslessly.
+          \param out_file The output file name.
+          \param dims The dimensions of the image, first axis first.
+          \param image The pixel values, first axis varying fastest.
+      */
+      void writeCompressedImage(const std::string & out_file, const std::vector<long> & dims,
+        const std::vector<float> & image) const;
+
       /** \brief Update a key-value pair, or add a new pair to the container of key-value pairs if it is not already present.
           \param name The name of the key-value pair to update.
           \param value The value to add to the key-value pair.
@@ -203,6 +386,22 @@ namespace evtbin {
       Gti m_gti;
       Hist * m_hist_ptr;
       DefaultKeyCont_t m_default_keys;
+      std::string m_time_field;
+      double m_time_begin;
+      double m_time_end;
+      // Products which can bin from a MappedEventTable set this to read uncompressed local input files
+      // through a memory mapping instead of tip.
+      bool m_use_mapped_input;
+      std::string m_image_compression;
+      // Event types by which the product is split, and the field holding each event's type.
+      std::string m_event_type_field;
+      EventTypeCont_t m_event_types;
+      // Spacecraft data used to compute the EXPOSURE keyword while the input is binned. The future is declared last so that
+      // it is destroyed, and thus waited for, before anything it uses.
+      std::string m_exposure_sc_file;
+      std::string m_exposure_sc_table;
+      mutable bool m_exposure_pending;
+      mutable std::future<double> m_exposure;
   };
 
   template <typename T>
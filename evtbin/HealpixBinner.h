@@ -7,9 +7,9 @@
 #ifndef evtbin_HealpixBinner_h
 #define evtbin_HealpixBinner_h
 
+#include <memory>
 #include <string>
 #include <vector>
-#include <map>
 
 #include "evtbin/Binner.h"
 #include "astro/SkyDir.h"
@@ -68,6 +68,16 @@ namespace evtbin {
       virtual long computeIndex(double coord1, double coord2 ) const;
       virtual long computeIndex(double value) const; ///////////////////////1D-Binner
 
+      /** \brief Compute the bin numbers for a batch of coordinate pairs. The results are identical to calling
+          computeIndex(coord1[i], coord2[i]) for each value, but the pixel computation is done in two passes
+          over the batch (trigonometry, then integer pixel arithmetic) to allow the compiler to vectorize.
+          \param coord1 Array of first coordinates (RA or L) in degrees.
+          \param coord2 Array of second coordinates (DEC or B) in degrees.
+          \param num_values The number of coordinate pairs.
+          \param index Output array of bin numbers (-1 for pixels outside the region).
+      */
+      void computeIndices(const double * coord1, const double * coord2, long num_values, long * index) const;
+
       /** \brief Return the number of bins currently defined.
       */
       virtual long getNumBins() const;
@@ -88,10 +98,34 @@ namespace evtbin {
       inline bool lb() const { return m_lb; }
       inline const healpix::HealpixRegion* region() const { return m_region; } 
       inline bool allSky() const { return m_region == 0; }
-      inline const std::vector<int>& pixelIndices() const { return m_pixelIndices; }
-      inline const std::map<int,int>& pixGlobalToLocalMap() const { return m_pixGlobalToLocalMap; }
+      const std::vector<int>& pixelIndices() const;
+
+      /** \brief Convert a global pixel number to the index of the pixel within the region, or -1 if
+          the pixel is not in the region. For all-sky maps the global pixel number is returned unchanged.
+          \param global_index The global pixel number.
+      */
+      inline long globalToLocal(long global_index) const;
 
   private:
+      /** \class PixelLookup
+          \brief Immutable reverse index for partial-sky mappings, shared by all copies of a binner.
+          Uses a dense table spanning the pixels of the region when nside <= 1024, and a sorted
+          array searched by bisection otherwise.
+      */
+      class PixelLookup {
+        public:
+          PixelLookup(const std::vector<int> & pixel_indices, bool dense);
+
+          long localIndex(long global_index) const;
+
+          const std::vector<int> & pixelIndices() const { return m_pixel_indices; }
+
+        private:
+          std::vector<int> m_pixel_indices; // global pixel indices, in local order
+          long m_first_pixel; // smallest global pixel index of the dense table
+          std::vector<int> m_dense; // local index (or -1) of global pixels [m_first_pixel, m_first_pixel + m_dense.size())
+          std::vector<std::pair<int, int> > m_sorted; // (global, local) pairs sorted by global index
+      };
 
       /** \brief, Computing the mapping if less that the whole sky is used
       */
@@ -102,10 +136,13 @@ namespace evtbin {
 
       healpix::HealpixRegion* m_region; // Region for partial-sky mappings
 
-      std::vector<int> m_pixelIndices;  // global pixel indices for partial-sky mappings
-      std::map<int,int> m_pixGlobalToLocalMap;  // reverse index map for partial-sky mappings
+      std::shared_ptr<const PixelLookup> m_lookup;  // pixel indices and reverse index for partial-sky mappings
   };
 
+  inline long HealpixBinner::globalToLocal(long global_index) const {
+    return m_lookup ? m_lookup->localIndex(global_index) : global_index;
+  }
+
 }
 
 #endif
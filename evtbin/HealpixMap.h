@@ -5,7 +5,9 @@
 #ifndef evtbin_HealpixMap_h
 #define evtbin_HealpixMap_h
 
+#include <cstdint>
 #include <string>
+#include <vector>
 
 #include "evtbin/DataProduct.h"
 #include "evtbin/HealpixBinner.h"
@@ -61,10 +63,25 @@ namespace evtbin {
       */
         virtual void binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end);
 
+      /** \brief Bin input from a memory mapped table, reading only the energy and the coordinate pair in use.
+          \param table The mapped table.
+          \param first_record The first record to be binned.
+          \param last_record One past the last record to be binned.
+      */
+      virtual void binInput(const MappedEventTable & table, long first_record, long last_record);
+
       //virtual void OpenInput(const std::string & event_file) const;
 
 
-      /** \brief Write count map file.
+      /** \brief Split the map by event type, binning each event into one map per event type it belongs to. The full
+                 map is then freed, so the methods which read or fill it (writeSkymaps, degrade, computeMoc and fillBin)
+                 throw.
+          \param event_types The event type bit masks.
+          \param field The name of the event type field, a bit array or an integer field.
+      */
+      virtual void setEventTypes(const EventTypeCont_t & event_types, const std::string & field = "EVENT_TYPE");
+
+      /** \brief Write count map file, or one file per event type if the map is split by event type.
           \param creator The value to write for the "CREATOR" keyword.
           \param out_file The output file name.
       */
@@ -72,6 +89,39 @@ namespace evtbin {
 
        void writeSkymaps(const std::string & out_file) const;
 
+       /** \brief Request that coarser versions of the map be written in the same output file, one extension
+           named SKYMAP_<order> for each order from hpx_order - 1 down to order_min. The coarser maps are derived
+           from the binned map by merging NEST pixels, so this requires the NEST ordering scheme.
+           \param order_min The coarsest order to write. A negative value disables the coarser maps.
+       */
+       void setPyramidOrderMin(int order_min);
+
+       /** \brief Derive the map at a coarser order by summing the NEST pixels of the binned map.
+           \param order The order of the coarser map, which must not exceed the order of the binned map.
+           \param pixels Output global pixel numbers of the coarse map, sorted. Filled only for partial-sky maps.
+           \param data Output coarse map, indexed the same way as the binned map.
+       */
+       void degrade(int order, std::vector<int> & pixels, Cont_t & data) const;
+
+       /** \brief Request an adaptive multi-order version of the map, written to a SKYMAP_MOC extension indexed by
+           NUNIQ pixel number (uniq = 4 * 4^order + pixel). Starting from the coarsest order of the pyramid (see
+           setPyramidOrderMin, or order 0), pixels whose total counts exceed the threshold are split into their
+           children, down to the order of the binned map. This requires the NEST ordering scheme.
+           \param threshold The count threshold. A value <= 0 disables the multi-order map.
+       */
+       void setMocThreshold(double threshold);
+
+       /** \brief Compute the adaptive multi-order map. Each output value is the number of counts in the
+           (variable size) pixel, not a density. The map is built bottom-up from the occupied pixels of the binned map,
+           so apart from the binned map itself memory grows with the number of occupied pixels and output cells,
+           not with the number of pixels at the finest order.
+           \param threshold Pixels with more counts than this (summed over energy) are split.
+           \param order_min The coarsest order used.
+           \param uniq Output NUNIQ pixel numbers, sorted.
+           \param data Output counts, indexed by energy bin, then by position in uniq.
+       */
+       void computeMoc(double threshold, int order_min, std::vector<std::int64_t> & uniq, Cont_t & data) const;
+
        void fillBin(const double coord1, const double coord2, const double energy, double weight=1.);
 
        void readEbounds(const std::string & healpixmap_file);
@@ -98,15 +148,51 @@ namespace evtbin {
 
      private:
 
+      /** \brief Write one map file, with its coarser and multi-order maps, from the given map data.
+      */
+      void writeMap(const std::string & creator, const std::string & out_file, const Cont_t & fine_data) const;
+
+      void writeSkymaps(const std::string & out_file, const Cont_t & fine_data) const;
+
+      void degrade(const Cont_t & fine_data, int order, std::vector<int> & pixels, Cont_t & data) const;
+
+      void computeMoc(const Cont_t & fine_data, double threshold, int order_min, std::vector<std::int64_t> & uniq,
+        Cont_t & data) const;
+
+      /** \brief Write one coarser map derived with degrade() to a new SKYMAP_<order> extension.
+      */
+      void writePyramidLevel(const std::string & out_file, const Cont_t & fine_data, int order) const;
+
+      /** \brief Write the adaptive multi-order map to a new SKYMAP_MOC extension.
+      */
+      void writeMoc(const std::string & out_file, const Cont_t & fine_data) const;
+
+      /** \brief Bin a batch of events: pixel numbers for the whole batch are computed in one call. If the map is split
+          by event type, each event is binned into the map of every event type it belongs to.
+      */
+      void fillBatch(const double * coord1, const double * coord2, const double * energy, const unsigned long * event_type,
+        long num_events);
+
+      /** \brief Throw an exception if the map is split by event type, in which case the full map is not kept.
+          \param method The name of the calling method, for the message.
+      */
+      void checkNotSplit(const std::string & method) const;
+
       HealpixBinner m_hpx_binner;
       bool m_hpx_ebin;
       Binner * m_ebinner;
       Binner * m_ebounds;
       Cont_t m_data;
+      std::vector<Cont_t> m_type_data; // one map per event type, if the map is split by event type
       
       int m_emin;
       int m_emax;
       std::vector<double> m_energies;
+      std::vector<long> m_pix_index; // scratch space for batches of pixel numbers
+      std::vector<long> m_energy_index; // scratch space for batches of energy bin numbers
+      std::vector<unsigned char> m_selected; // scratch space for batches of event type selections
+      int m_order_min; // coarsest order of the pyramid of coarser maps, or -1 for none
+      double m_moc_threshold; // count threshold for splitting pixels of the multi-order map, or 0 for none
   };
 
 }
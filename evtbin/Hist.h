@@ -26,11 +26,60 @@ namespace evtbin {
       */
       virtual void fillBin(const std::vector<double> & value, double weight = 1.) = 0;
 
+      /** \brief Increment the bins appropriate for a batch of values. The default calls fillBin for each value.
+          \param columns Pointers to the values of each dimension, one pointer per dimension.
+          \param num_values The number of values in each column.
+      */
+      virtual void fillBins(const std::vector<const double *> & columns, long num_values);
+
       /** \brief Return the collection of binners being used by this histogram.
       */
       const BinnerCont_t & getBinners() const;
 
+      /** \brief Fill output vector with the contents of the histogram, in which the index of the last dimension
+                 varies fastest.
+          \param values The output vector.
+      */
+      virtual void getValues(std::vector<double> & values) const = 0;
+
+      /** \brief Add the given values, laid out as by getValues, to the contents of the histogram.
+          \param values The values to add.
+      */
+      virtual void addValues(const std::vector<double> & values) = 0;
+
+      /** \brief Add the contents of a master histogram with finer bins to this histogram. Each dimension of this
+                 histogram is matched by name to a dimension of the master, whose bins must nest inside the bins of
+                 this one: no bin edge of this histogram may fall inside a bin of the master. Master bins outside the
+                 bins of this histogram are dropped. Dimensions of the master which are not in this histogram are
+                 summed over. Throws an exception if a dimension is missing or the bins do not align.
+          \param master The master histogram.
+      */
+      virtual void addRebinned(const Hist & master);
+
+      /** \brief Add the contents of this histogram to those of a histogram with coarser bins, as addRebinned does when
+                 this histogram is the master. By default the contents are read through getValues; sparse histograms
+                 override this to visit only their nonzero bins.
+          \param offset For each dimension of this histogram, the contribution of each of its bins to the flat index
+                 of the coarse bin containing it, or -1 if the bin is dropped.
+          \param values The contents of the coarse histogram, laid out as by getValues.
+      */
+      virtual void sumRebinned(const std::vector<std::vector<long> > & offset, std::vector<double> & values) const;
+
+      /** \brief Return, for each bin of a fine binner, the bin of a coarse binner which contains it, or -1 if it is
+                 outside all the coarse bins. Throws an exception if a coarse bin edge falls inside a fine bin.
+          \param fine The binner with finer bins.
+          \param coarse The binner with coarser bins.
+      */
+      static std::vector<long> computeBinMap(const Binner & fine, const Binner & coarse);
+
     protected:
+      /** \brief Compute the offsets used to add the bins of a master histogram to this histogram, as passed to
+                 sumRebinned. Throws an exception if a dimension is missing or the bins do not align.
+          \param master The master histogram.
+          \param offset The output offsets, one vector per dimension of the master.
+      */
+      void computeRebinOffsets(const Hist & master, std::vector<std::vector<long> > & offset) const;
+
       BinnerCont_t m_binners;
   };
 
@@ -34,11 +34,35 @@ namespace evtbin {
       */
       virtual void fillBin(const std::vector<double> & value, double weight = 1.);
 
+      /** \brief Fill output vector with the contents of the histogram, in which the index of the last dimension
+                 varies fastest.
+          \param values The output vector.
+      */
+      virtual void getValues(std::vector<double> & values) const;
+
+      /** \brief Add the given values, laid out as by getValues, to the contents of the histogram.
+          \param values The values to add.
+      */
+      virtual void addValues(const std::vector<double> & values);
+
+      /** \brief Increment the bins appropriate for a batch of values, whose bin numbers are computed by the binner
+                 in a single call.
+          \param columns Array holding the values being binned. Only the first column is used.
+          \param num_values The number of values in the column.
+      */
+      virtual void fillBins(const std::vector<const double *> & columns, long num_values);
+
       /** \brief Increment the bin appropriate for the given value.
           \param value The value being binned.
       */
       void fillBin(double value, double weight = 1.);
 
+      /** \brief Increment the bin with the given index directly, without using the binner. Indices outside
+                 the histogram are ignored.
+          \param index The index of the bin.
+      */
+      void fillBinIndex(long index, double weight = 1.);
+
       const double & operator [](Cont_t::size_type index) const;
 
       ConstIterator begin() const;
@@ -47,6 +71,10 @@ namespace evtbin {
 
     private:
       Cont_t m_data;
+      // Bin of the last value binned, used as a starting point for the next one.
+      long m_cursor;
+      // Scratch space for the bin numbers of a batch of values.
+      std::vector<long> m_index;
   };
 
   inline const double & Hist1D::operator [](Cont_t::size_type index) const { return m_data[index]; }
@@ -37,6 +37,24 @@ namespace evtbin {
       */
       virtual void fillBin(const std::vector<double> & value, double weight = 1.);
 
+      /** \brief Increment the bins appropriate for a batch of values. The bin numbers of each dimension are computed
+                 by its binner in a single call.
+          \param columns Pointers to the values of each dimension. Only the first two columns are used.
+          \param num_values The number of values in each column.
+      */
+      virtual void fillBins(const std::vector<const double *> & columns, long num_values);
+
+      /** \brief Fill output vector with the contents of the histogram, in which the index of the last dimension
+                 varies fastest.
+          \param values The output vector.
+      */
+      virtual void getValues(std::vector<double> & values) const;
+
+      /** \brief Add the given values, laid out as by getValues, to the contents of the histogram.
+          \param values The values to add.
+      */
+      virtual void addValues(const std::vector<double> & values);
+
       /** \brief Fill output vector with a 1-d representation of the histogram, suitable for storing as an image.
           \param image The output vector.
       */
@@ -56,6 +74,11 @@ namespace evtbin {
 
     private:
       Cont_t m_data;
+      // Bin of the last value binned in the first dimension, used as a starting point for the next one.
+      long m_cursor;
+      // Scratch space for the bin numbers of a batch of values in each dimension.
+      std::vector<long> m_index1;
+      std::vector<long> m_index2;
   };
 
   inline const std::vector<double> & Hist2D::operator [](Cont_t::size_type index) const { return m_data[index]; }
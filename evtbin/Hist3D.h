@@ -38,6 +38,17 @@ namespace evtbin {
       */
       virtual void fillBin(const std::vector<double> & value, double weight = 1.);
 
+      /** \brief Fill output vector with the contents of the histogram, in which the index of the last dimension
+                 varies fastest.
+          \param values The output vector.
+      */
+      virtual void getValues(std::vector<double> & values) const;
+
+      /** \brief Add the given values, laid out as by getValues, to the contents of the histogram.
+          \param values The values to add.
+      */
+      virtual void addValues(const std::vector<double> & values);
+
       /** \brief Fill output vector with a 1-d representation of the histogram, suitable for storing as an image.
           \param image The output vector.
       */
@@ -0,0 +1,256 @@
+/** \file HistND.h
+    \brief N dimensional histogram whose binner types are known at compile time.
+*/
+#ifndef evtbin_HistND_h
+#define evtbin_HistND_h
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+#include "evtbin/Binner.h"
+#include "evtbin/Hist.h"
+
+namespace evtbin {
+
+  /** \class HistNDAxis
+      \brief Computation of flat indices of a HistND, one dimension at a time starting from dimension Dim.
+             Each binner is called through its concrete type, so the call is not virtual and may be inlined.
+  */
+  template <std::size_t Dim, std::size_t NumDims>
+  struct HistNDAxis {
+    /** \brief Return the flat index of the given value in dimensions Dim and above, or -1 if it is outside the histogram.
+        \param binners Tuple of binners.
+        \param stride The stride of each dimension.
+        \param value The value being binned, one element per dimension.
+    */
+    template <typename BinnerTuple>
+    static long computeIndex(const BinnerTuple & binners, const long * stride, const double * value) {
+      typedef typename std::tuple_element<Dim, BinnerTuple>::type Binner_t;
+      long index = std::get<Dim>(binners).Binner_t::computeIndex(value[Dim]);
+      if (0 > index) return -1;
+      long rest = HistNDAxis<Dim + 1, NumDims>::computeIndex(binners, stride, value);
+      return 0 > rest ? -1 : index * stride[Dim] + rest;
+    }
+
+    /** \brief Add the contributions of dimensions Dim and above to the flat indices of a batch of values. Indices of
+               values outside the histogram are set to -1. The loop for each dimension has no dependencies between
+               values, so the compiler may vectorize it when the binner's computeIndex is inlined.
+        \param binners Tuple of binners.
+        \param stride The stride of each dimension.
+        \param columns Array of values of each dimension.
+        \param num_values The number of values in each column.
+        \param flat_index The flat indices (input/output).
+    */
+    template <typename BinnerTuple>
+    static void addIndices(const BinnerTuple & binners, const long * stride, const double * const * columns, long num_values,
+      long * flat_index) {
+      typedef typename std::tuple_element<Dim, BinnerTuple>::type Binner_t;
+      const Binner_t & binner = std::get<Dim>(binners);
+      const double * column = columns[Dim];
+      long dim_stride = stride[Dim];
+      for (long ii = 0; ii < num_values; ++ii) {
+        long index = binner.Binner_t::computeIndex(column[ii]);
+        flat_index[ii] = (0 > index || 0 > flat_index[ii]) ? -1 : flat_index[ii] + index * dim_stride;
+      }
+      HistNDAxis<Dim + 1, NumDims>::addIndices(binners, stride, columns, num_values, flat_index);
+    }
+  };
+
+  template <std::size_t NumDims>
+  struct HistNDAxis<NumDims, NumDims> {
+    template <typename BinnerTuple>
+    static long computeIndex(const BinnerTuple &, const long *, const double *) { return 0; }
+
+    template <typename BinnerTuple>
+    static void addIndices(const BinnerTuple &, const long *, const double * const *, long, long *) {}
+  };
+
+  /** \class HistND
+      \brief N dimensional histogram whose binner types are given as template parameters, e.g.
+             HistND<LinearBinner, LinearBinner, LogBinner> for a count cube. The binners are stored by value and called
+             through their concrete types rather than through Binner's virtual functions, and the contents are stored
+             in one flat array, in which the index of the last dimension varies fastest. Being a Hist, it can be used
+             anywhere a Hist is used, for example as a data product's histogram.
+  */
+  template <typename... Binners>
+  class HistND : public Hist {
+    public:
+      static_assert(0 < sizeof...(Binners), "HistND must have at least one dimension");
+
+      enum { s_num_dims = sizeof...(Binners) };
+
+      typedef std::tuple<Binners...> BinnerTuple_t;
+      typedef std::vector<double> Cont_t;
+      typedef Cont_t::const_iterator ConstIterator;
+
+      /** \brief Create an N dimensional histogram which uses copies of the given binner objects, one per dimension.
+          \param binners The binner objects, in order of dimension.
+      */
+      HistND(const Binners & ... binners);
+
+      virtual ~HistND() throw();
+
+      /** \brief Increment the bin appropriate for the given value.
+          \param value Vector giving the value being binned. The vector must have at least as
+                 many values as the dimensionality of the histogram.
+      */
+      virtual void fillBin(const std::vector<double> & value, double weight = 1.);
+
+      /** \brief Increment the bin appropriate for the given value.
+          \param value Array giving the value being binned, one element per dimension.
+      */
+      void fillBin(const double * value, double weight = 1.);
+
+      /** \brief Increment the bins appropriate for a batch of values. The flat index of every value is computed one
+                 dimension at a time, and the bins are then incremented in a separate pass.
+          \param columns Pointers to the values of each dimension, one pointer per dimension.
+          \param num_values The number of values in each column.
+      */
+      virtual void fillBins(const std::vector<const double *> & columns, long num_values);
+
+      virtual void getValues(std::vector<double> & values) const;
+
+      virtual void addValues(const std::vector<double> & values);
+
+      /** \brief Fill output vector with a 1-d representation of the histogram, suitable for storing as an image, in which
+                 the index of the first dimension varies fastest.
+          \param image The output vector.
+      */
+      void getImage(std::vector<float> & image) const;
+
+      /** \brief Return the flat index of the bin appropriate for the given value, or -1 if it is outside the histogram.
+          \param value Array giving the value being binned, one element per dimension.
+      */
+      long computeIndex(const double * value) const;
+
+      /** \brief Return the distance in the flat contents between consecutive bins of the given dimension.
+          \param dim The dimension.
+      */
+      long getStride(std::size_t dim) const;
+
+      /** \brief Return the binner of dimension Dim, with its concrete type.
+      */
+      template <std::size_t Dim>
+      const typename std::tuple_element<Dim, BinnerTuple_t>::type & getBinner() const;
+
+      const double & operator [](Cont_t::size_type index) const;
+
+      ConstIterator begin() const;
+
+      ConstIterator end() const;
+
+    private:
+      BinnerTuple_t m_nd_binners;
+      long m_stride[s_num_dims];
+      Cont_t m_data;
+  };
+
+  template <typename... Binners>
+  inline HistND<Binners...>::HistND(const Binners & ... binners): m_nd_binners(binners...), m_stride(), m_data() {
+    // Save binners:
+    Binner * clones[] = { binners.clone()... };
+    m_binners.assign(clones, clones + s_num_dims);
+
+    // Strides, with the last dimension varying fastest:
+    m_stride[s_num_dims - 1] = 1;
+    for (std::size_t dim = s_num_dims - 1; dim > 0; --dim) m_stride[dim - 1] = m_stride[dim] * m_binners[dim]->getNumBins();
+
+    // Set initial size of data array:
+    m_data.resize(m_stride[0] * m_binners[0]->getNumBins(), 0.);
+  }
+
+  template <typename... Binners>
+  inline HistND<Binners...>::~HistND() throw() {}
+
+  template <typename... Binners>
+  inline void HistND<Binners...>::fillBin(const std::vector<double> & value, double weight) {
+    if (value.size() < std::size_t(s_num_dims)) throw std::logic_error("HistND::fillBin: too few values for the histogram");
+    fillBin(&value[0], weight);
+  }
+
+  template <typename... Binners>
+  inline void HistND<Binners...>::fillBin(const double * value, double weight) {
+    long index = computeIndex(value);
+    if (0 <= index) m_data[index] += weight;
+  }
+
+  template <typename... Binners>
+  inline void HistND<Binners...>::fillBins(const std::vector<const double *> & columns, long num_values) {
+    if (columns.size() < std::size_t(s_num_dims)) throw std::logic_error("HistND::fillBins: too few columns for the histogram");
+
+    // Compute the flat indices of a batch of values at a time, then increment the bins.
+    const long batch_size = 1024;
+    long flat_index[batch_size];
+    for (long batch_begin = 0; batch_begin < num_values; batch_begin += batch_size) {
+      long batch_num = std::min(batch_size, num_values - batch_begin);
+      const double * batch[s_num_dims];
+      for (std::size_t dim = 0; dim != std::size_t(s_num_dims); ++dim) batch[dim] = columns[dim] + batch_begin;
+
+      std::fill(flat_index, flat_index + batch_num, 0l);
+      HistNDAxis<0, s_num_dims>::addIndices(m_nd_binners, m_stride, batch, batch_num, flat_index);
+      for (long ii = 0; ii < batch_num; ++ii) {
+        if (0 <= flat_index[ii]) m_data[flat_index[ii]] += 1.;
+      }
+    }
+  }
+
+  template <typename... Binners>
+  inline void HistND<Binners...>::getValues(std::vector<double> & values) const { values = m_data; }
+
+  template <typename... Binners>
+  inline void HistND<Binners...>::addValues(const std::vector<double> & values) {
+    if (values.size() != m_data.size()) throw std::logic_error("HistND::addValues: wrong number of values");
+    for (Cont_t::size_type index = 0; index != m_data.size(); ++index) m_data[index] += values[index];
+  }
+
+  template <typename... Binners>
+  inline void HistND<Binners...>::getImage(std::vector<float> & image) const {
+    image.resize(m_data.size());
+
+    // Step through the contents in order, keeping track of each dimension's index and the matching image position.
+    long image_stride[s_num_dims];
+    image_stride[0] = 1;
+    for (std::size_t dim = 1; dim != std::size_t(s_num_dims); ++dim)
+      image_stride[dim] = image_stride[dim - 1] * m_binners[dim - 1]->getNumBins();
+
+    long index[s_num_dims] = {};
+    long image_index = 0;
+    for (Cont_t::size_type flat = 0; flat != m_data.size(); ++flat) {
+      image[image_index] = m_data[flat];
+      for (std::size_t dim = s_num_dims; dim > 0; --dim) {
+        image_index += image_stride[dim - 1];
+        if (++index[dim - 1] < m_binners[dim - 1]->getNumBins()) break;
+        image_index -= index[dim - 1] * image_stride[dim - 1];
+        index[dim - 1] = 0;
+      }
+    }
+  }
+
+  template <typename... Binners>
+  inline long HistND<Binners...>::computeIndex(const double * value) const {
+    return HistNDAxis<0, s_num_dims>::computeIndex(m_nd_binners, m_stride, value);
+  }
+
+  template <typename... Binners>
+  inline long HistND<Binners...>::getStride(std::size_t dim) const { return m_stride[dim]; }
+
+  template <typename... Binners>
+  template <std::size_t Dim>
+  inline const typename std::tuple_element<Dim, typename HistND<Binners...>::BinnerTuple_t>::type &
+    HistND<Binners...>::getBinner() const { return std::get<Dim>(m_nd_binners); }
+
+  template <typename... Binners>
+  inline const double & HistND<Binners...>::operator [](Cont_t::size_type index) const { return m_data[index]; }
+
+  template <typename... Binners>
+  inline typename HistND<Binners...>::ConstIterator HistND<Binners...>::begin() const { return m_data.begin(); }
+
+  template <typename... Binners>
+  inline typename HistND<Binners...>::ConstIterator HistND<Binners...>::end() const { return m_data.end(); }
+
+}
+
+#endif
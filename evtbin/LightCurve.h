@@ -5,7 +5,9 @@
 #ifndef evtbin_LightCurve_h
 #define evtbin_LightCurve_h
 
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "evtbin/DataProduct.h"
 #include "evtbin/Hist1D.h"
@@ -13,12 +15,44 @@
 namespace evtbin {
 
   class Binner;
+  class HealpixBinner;
 
   /** \class LightCurve
       \brief Encapsulation of a Light curve, with methods to read/write using tip.
   */
   class LightCurve : public DataProduct {
     public:
+      /** \class Aperture
+          \brief A circular region of the sky around one source, for aperture light curves.
+      */
+      class Aperture {
+        public:
+          /** \brief Create an aperture.
+              \param name The name of the source.
+              \param ra The first coordinate (RA or L) of the center, in degrees.
+              \param dec The second coordinate (DEC or B) of the center, in degrees.
+              \param radius The radius of the aperture, in degrees.
+          */
+          Aperture(const std::string & name, double ra, double dec, double radius): m_name(name), m_ra(ra), m_dec(dec),
+            m_radius(radius) {}
+
+          const std::string & getName() const { return m_name; }
+
+          double getRa() const { return m_ra; }
+
+          double getDec() const { return m_dec; }
+
+          double getRadius() const { return m_radius; }
+
+        private:
+          std::string m_name;
+          double m_ra;
+          double m_dec;
+          double m_radius;
+      };
+
+      typedef std::vector<Aperture> ApertureCont_t;
+
       /** \brief Create the light curve object.
           \param binner The binner used to create the histogram.
       */
@@ -27,14 +61,95 @@ namespace evtbin {
 
       virtual ~LightCurve() throw();
 
+      /** \brief Bin input from input file/files passed to the constructor.
+      */
+      virtual void binInput();
+
+      /** \brief Bin input from tip table.
+          \param begin Table iterator pointing to the first record to be binned.
+          \param end Table iterator pointing to one past the last record to be binned.
+      */
+      virtual void binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end);
+
+      /** \brief Bin input from a memory mapped table.
+          \param table The mapped table.
+          \param first_record The first record to be binned.
+          \param last_record One past the last record to be binned.
+      */
+      virtual void binInput(const MappedEventTable & table, long first_record, long last_record);
+
+      /** \brief Make one light curve per aperture instead of a single light curve, all binned in the same pass over the
+                 input. Each event is counted in every aperture which contains it. Events are matched to apertures
+                 through a HEALPix pixel lookup, which lists for each pixel the apertures which overlap it, so that
+                 only a few candidate apertures are tested per event. Throws an exception, leaving the apertures as they
+                 were, if any aperture has a radius outside (0, 180] degrees.
+          \param apertures The apertures.
+          \param ra_field The name of the field holding the first coordinate of each event.
+          \param dec_field The name of the field holding the second coordinate of each event.
+      */
+      void setApertures(const ApertureCont_t & apertures, const std::string & ra_field = "RA",
+        const std::string & dec_field = "DEC");
+
+      /** \brief Return the apertures, or an empty container if this is a single light curve.
+      */
+      const ApertureCont_t & getApertures() const;
+
+      /** \brief Return the light curve of one aperture.
+          \param index The index of the aperture.
+      */
+      const Hist1D & getApertureHist(ApertureCont_t::size_type index) const;
+
       /** \brief Write standard OGIP light curve file.
           \param creator The value to write for the "CREATOR" keyword.
           \param out_file The output file name.
       */
       virtual void writeOutput(const std::string & creator, const std::string & out_file) const;
 
+      /** \brief Add counts binned elsewhere with the same time bins, for example the light curve of another detector.
+          \param hist The histogram whose counts to add.
+      */
+      void addCounts(const Hist1D & hist);
+
+      /** \brief Add counts binned elsewhere with the same time bins, summed over the other dimensions, for example
+                 the spectra of another detector.
+          \param hist The histogram whose counts to add. Its first dimension must be time.
+      */
+      void addCounts(const Hist & hist);
+
+      /** \brief Select whether the output has ONTIME and EXPOSURE columns giving the ontime and exposure of each bin.
+          \param bin_exposure If true, the columns are computed and written.
+      */
+      void setBinExposure(bool bin_exposure);
+
+    protected:
+      virtual const Binner * getTimeBinner() const;
+
     private:
+      /** \brief Count a batch of events in each aperture which contains them.
+      */
+      void fillApertures(const double * time, const double * ra, const double * dec, long num_events);
+
+      /** \brief Write the light curves of all apertures to the RATE extension, as one element of the COUNTS and ERROR
+                 vectors per aperture, and the apertures themselves to the APERTURES extension.
+      */
+      void writeApertures(const std::string & out_file) const;
+
+      std::string m_sc_file;
+      std::string m_sc_table;
       Hist1D m_hist;
+      bool m_bin_exposure;
+      // Apertures, the fields holding event coordinates, and one light curve per aperture.
+      ApertureCont_t m_apertures;
+      std::string m_ra_field;
+      std::string m_dec_field;
+      std::vector<Hist1D *> m_aperture_hist;
+      // Unit vector and cosine of the radius of each aperture.
+      std::vector<double> m_aperture_dir;
+      std::vector<double> m_aperture_cos_radius;
+      // Pixel lookup: the apertures overlapping pixel p are m_pixel_apertures[m_pixel_first[p] .. m_pixel_first[p + 1]).
+      std::unique_ptr<HealpixBinner> m_aperture_binner;
+      std::vector<long> m_pixel_first;
+      std::vector<long> m_pixel_apertures;
   };
 
 }
@@ -47,6 +47,11 @@ namespace evtbin {
       long m_num_bins;
   };
 
+  inline long LinearBinner::computeIndex(double value) const {
+    if (value < m_interval_begin || value >= m_interval_end) return -1;
+    return long((value - m_interval_begin) / m_bin_size);
+  }
+
 }
 
 #endif
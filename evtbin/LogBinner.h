@@ -4,6 +4,7 @@
 #ifndef evtbin_LogBinner_h
 #define evtbin_LogBinner_h
 
+#include <cmath>
 #include <string>
 
 #include "evtbin/Binner.h"
@@ -46,6 +47,11 @@ namespace evtbin {
       long m_num_bins;
   };
 
+  inline long LogBinner::computeIndex(double value) const {
+    if (value < m_interval_begin || value >= m_interval_end) return -1;
+    return long(m_num_bins * std::log(double(value) / m_interval_begin) / std::log(double(m_interval_end) / m_interval_begin));
+  }
+
 }
 
 #endif
@@ -0,0 +1,107 @@
+/** \file MappedEventTable.h
+    \brief Read-only access to the columns of an uncompressed FITS binary table through a memory mapping of the file.
+*/
+#ifndef evtbin_MappedEventTable_h
+#define evtbin_MappedEventTable_h
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+namespace evtbin {
+
+  /** \class MappedEventTable
+      \brief Read-only access to the columns of an uncompressed FITS binary table through a memory mapping of the file.
+
+      The layout of the table (row width, column offsets, data types and scaling) is parsed once from the header.
+      Column values are then decoded in batches directly from the mapped data, without going through tip's
+      record-by-record iteration. Only plain local files can be mapped; callers should use tip for everything else.
+  */
+  class MappedEventTable {
+    public:
+      /** \brief Return true if the given file name refers to a plain, uncompressed file on local disk which
+                 could be mapped. This does not guarantee that the file contains a table which can be read.
+          \param file_name The name of the file.
+      */
+      static bool isMappable(const std::string & file_name);
+
+      /** \brief Map the given file and parse the layout of the named binary table extension. Throws an exception if
+                 the file cannot be mapped, or the extension is not found or is not a plain binary table.
+          \param file_name The name of the file.
+          \param ext_name The name of the binary table extension. If empty, the first binary table is used.
+      */
+      MappedEventTable(const std::string & file_name, const std::string & ext_name);
+
+      ~MappedEventTable() throw();
+
+      /** \brief Return the number of records in the table.
+      */
+      long getNumRecords() const;
+
+      /** \brief Return true if the table has a scalar numeric field with the given name (case insensitive).
+          \param field_name The name of the field.
+      */
+      bool hasField(const std::string & field_name) const;
+
+      /** \brief Decode a range of values of the given field, applying TSCALn/TZEROn. Throws an exception if the field
+                 does not exist or is not a scalar numeric field.
+          \param field_name The name of the field.
+          \param first_record The first record to read.
+          \param num_records The number of records to read.
+          \param dest Destination array, which must have space for num_records values.
+      */
+      void readColumn(const std::string & field_name, long first_record, long num_records, double * dest) const;
+
+      /** \brief Return true if the table has a field with the given name (case insensitive) which can be read as a set
+                 of bits: a bit array field of at most 64 bits, or a scalar integer field.
+          \param field_name The name of the field.
+      */
+      bool hasBitField(const std::string & field_name) const;
+
+      /** \brief Decode a range of values of a bit field as unsigned integers. The last bit of a bit array is the least
+                 significant bit of the result, as when the array is read as a big-endian integer. Values of scalar integer
+                 fields are used as they are, after applying TSCALn/TZEROn. Throws an exception if the field is not
+                 a bit field.
+          \param field_name The name of the field.
+          \param first_record The first record to read.
+          \param num_records The number of records to read.
+          \param dest Destination array, which must have space for num_records values.
+      */
+      void readBits(const std::string & field_name, long first_record, long num_records, unsigned long * dest) const;
+
+      /** \brief Decode a single value of the given field.
+          \param field_name The name of the field.
+          \param record The record to read.
+      */
+      double readValue(const std::string & field_name, long record) const;
+
+    private:
+      struct Column {
+        std::size_t m_offset;
+        char m_type;
+        long m_repeat;
+        double m_scale;
+        double m_zero;
+      };
+
+      typedef std::map<std::string, Column> ColumnCont_t;
+
+      // Not copyable, because this object owns the mapping.
+      MappedEventTable(const MappedEventTable &);
+      MappedEventTable & operator =(const MappedEventTable &);
+
+      const Column & getColumn(const std::string & field_name) const;
+
+      void parse(const std::string & file_name, const std::string & ext_name);
+
+      ColumnCont_t m_columns;
+      const unsigned char * m_map;
+      std::size_t m_map_size;
+      const unsigned char * m_data;
+      std::size_t m_row_width;
+      long m_num_records;
+  };
+
+}
+
+#endif
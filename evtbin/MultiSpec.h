@@ -8,14 +8,15 @@
 #include <string>
 
 #include "evtbin/DataProduct.h"
-#include "evtbin/Hist2D.h"
 
 namespace evtbin {
 
   class Binner;
 
   /** \class MultiSpec
-      \brief Encapsulation of a group of spectra, with methods to read/write using tip.
+      \brief Encapsulation of a group of spectra, with methods to read/write using tip. Spectra whose time and energy
+             binners are both plain OrderedBinners (bins from files, or equal-count bins) are binned by a HistND whose
+             binners are inlined; others use a Hist2D.
   */
   class MultiSpec : public DataProduct {
     public:
@@ -36,10 +37,13 @@ namespace evtbin {
       */
       virtual void writeOutput(const std::string & creator, const std::string & out_file) const;
 
+    protected:
+      virtual const Binner * getTimeBinner() const;
+
     private:
       std::string m_sc_file;
       std::string m_sc_table;
-      Hist2D m_hist;
+      Hist * m_hist;
       Binner * m_ebounds;
   };
 
@@ -4,6 +4,7 @@
 #ifndef evtbin_OrderedBinner_h
 #define evtbin_OrderedBinner_h
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -12,6 +13,11 @@
 namespace evtbin {
   /** \class OrderedBinner
       \brief Declaration of a binner with ordered but otherwise arbitrary bins.
+
+      Bin lookups go through a uniform grid of buckets over the whole binned range. Each bucket records the first bin
+      which may contain values in that bucket, so most lookups take one multiplication and a short scan of a packed array
+      of bin boundaries, regardless of the number of bins. If any bin boundary is infinite, lookups fall back on a binary
+      search of the bins.
   */
   class OrderedBinner : public Binner {
     public:
@@ -30,6 +36,13 @@ namespace evtbin {
       */
       virtual long computeIndex(double value) const;
 
+      /** \brief Return the bin number for the given value, advancing from the bin of a previous value if the value
+                 falls in that bin or one of the next few, and searching otherwise.
+          \param value The value being binned.
+          \param previous_index The bin number of a previous value, or a negative number if there is none.
+      */
+      virtual long computeNextIndex(double value, long previous_index) const;
+
       /** \brief Return the number of bins currently defined.
       */
       virtual long getNumBins() const;
@@ -44,9 +57,55 @@ namespace evtbin {
       virtual Binner * clone() const;
 
     protected:
-      mutable IntervalCont_t m_intervals;
+      /** \brief Rebuild the lookup index from the current intervals. Subclasses which define or change m_intervals
+                 after construction must call this afterwards.
+      */
+      void buildIndex();
+
+      IntervalCont_t m_intervals;
+
+    private:
+      // Spans of bins longer than this are bisected rather than scanned.
+      static const long s_max_scan = 8;
+
+      std::vector<double> m_begins;
+      std::vector<double> m_ends;
+      std::vector<long> m_bucket;
+      double m_lowest;
+      double m_highest;
+      double m_bucket_scale;
   };
 
+  inline long OrderedBinner::computeIndex(double value) const {
+    // Reject values outside the binned range. This also rejects NaN, for which all comparisons are false.
+    if (!(value >= m_lowest && value < m_highest)) return -1;
+
+    // Find the bucket holding the value, and the span of bins which begin in or just before that bucket.
+    long num_buckets = m_bucket.size() - 1;
+    long bucket = 0. < m_bucket_scale ? long((value - m_lowest) * m_bucket_scale) : 0;
+    if (bucket >= num_buckets) bucket = num_buckets - 1;
+    long first = m_bucket[bucket];
+    long last = m_bucket[bucket + 1];
+
+    // Guard against round-off in the bucket computation.
+    long num_bins = m_begins.size();
+    while (first > 0 && m_begins[first] > value) --first;
+    while (last + 1 < num_bins && m_begins[last + 1] <= value) ++last;
+
+    // Find the last bin in the span which begins at or before the value, scanning short spans and bisecting long ones.
+    long index = first;
+    if (last - first > s_max_scan) {
+      index = std::upper_bound(m_begins.begin() + first + 1, m_begins.begin() + last + 1, value) - m_begins.begin() - 1;
+    } else {
+      while (index < last && m_begins[index + 1] <= value) ++index;
+    }
+
+    // This bin by definition has a beginning value <= the value, so just check the end of the interval.
+    if (m_begins[index] <= value && m_ends[index] > value) return index;
+
+    return -1;
+  }
+
 }
 
 #endif
@@ -0,0 +1,85 @@
+/** \file PhaseBinner.h
+    \brief Declaration of a binner which folds event times by the rotational phase of a pulsar.
+*/
+#ifndef evtbin_PhaseBinner_h
+#define evtbin_PhaseBinner_h
+
+#include <string>
+
+#include "evtbin/Binner.h"
+
+namespace evtbin {
+  /** \class PhaseBinner
+      \brief Declaration of a binner which folds event times by the rotational phase of a pulsar. The phase is computed
+             from a Taylor series ephemeris, phase(t) = f0 * dt + f1 * dt^2 / 2 + f2 * dt^3 / 6, where dt = t - epoch, and
+             the fractional part of the phase is binned into uniform bins over [0, 1). Only times inside the given time
+             range are binned. No barycentric correction is applied, so times must already be barycentered.
+  */
+  class PhaseBinner : public Binner {
+    public:
+      /** \brief Construct a phase binner object.
+          \param time_begin Beginning of the range of times to fold.
+          \param time_end End of the range of times to fold.
+          \param epoch The reference time at which the phase is 0, in the same system as the times.
+          \param f0 The rotation frequency at the epoch (Hz).
+          \param f1 The first time derivative of the frequency (Hz/s).
+          \param f2 The second time derivative of the frequency (Hz/s^2).
+          \param num_bins The number of phase bins.
+          \param name Optional name of the quantity being binned (the time field).
+      */
+      PhaseBinner(double time_begin, double time_end, double epoch, double f0, double f1, double f2, long num_bins,
+        const std::string & name = std::string());
+
+      /** \brief Return the phase bin number for the given time.
+          \param value The time being binned.
+      */
+      virtual long computeIndex(double value) const;
+
+      /** \brief Return the number of phase bins.
+      */
+      virtual long getNumBins() const;
+
+      /** \brief Return the phase interval spanned by the given bin.
+          \param index The index indicating the bin number.
+      */
+      virtual Binner::Interval getInterval(long index) const;
+
+      /** \brief Return the range of times which are folded.
+      */
+      virtual Binner::Interval getDomain() const;
+
+      /** \brief Return true, because bins are in phase rather than in time.
+      */
+      virtual bool isFolded() const;
+
+      /** \brief Create copy of this object.
+      */
+      virtual Binner * clone() const;
+
+      /** \brief Return the phase, in [0, 1), at the given time.
+          \param time The time.
+      */
+      double computePhase(double time) const;
+
+      /** \brief Compute the phase bin numbers of an array of times. Times outside the time range are assigned -1. The
+                 computation has no dependencies between elements, so the compiler may vectorize it. Histograms filled
+                 in batches, such as light curves read through a memory mapping, use this instead of computeIndex.
+          \param time Array of times.
+          \param num_times The number of times.
+          \param index Array which receives the bin numbers.
+      */
+      virtual void computeIndices(const double * time, long num_times, long * index) const;
+
+    private:
+      double m_time_begin;
+      double m_time_end;
+      double m_epoch;
+      double m_f0;
+      double m_f1_half;
+      double m_f2_sixth;
+      long m_num_bins;
+  };
+
+}
+
+#endif
@@ -0,0 +1,45 @@
+/** \file ProductPool.h
+    \brief Pool of worker threads which bin several data products concurrently.
+*/
+#ifndef evtbin_ProductPool_h
+#define evtbin_ProductPool_h
+
+#include <vector>
+
+namespace evtbin {
+
+  class DataProduct;
+
+  /** \class ProductPool
+      \brief Pool of worker threads which bin several data products concurrently, for example the products of each
+             detector of an instrument. Each product is binned by exactly one thread, so products must not share
+             mutable state. Input read through memory mappings is binned in parallel; input which must be read
+             through tip is binned one product at a time.
+  */
+  class ProductPool {
+    public:
+      typedef std::vector<DataProduct *> ProductCont_t;
+
+      /** \brief Create a pool with the given number of threads.
+          \param num_threads The maximum number of threads to use. If 0, the number of hardware threads is used.
+      */
+      explicit ProductPool(unsigned long num_threads = 0);
+
+      /** \brief Call binInput() for every product, and wait for all of them to finish, including the computation of
+                 their exposure, so that tip may safely be used once this returns. If binning any product throws, the
+                 remaining products are still binned, and then the first exception is rethrown.
+          \param products The products to bin.
+      */
+      void binInput(const ProductCont_t & products) const;
+
+      /** \brief Return the maximum number of threads used.
+      */
+      unsigned long getNumThreads() const;
+
+    private:
+      unsigned long m_num_threads;
+  };
+
+}
+
+#endif
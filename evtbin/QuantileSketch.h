@@ -0,0 +1,58 @@
+/** \file QuantileSketch.h
+    \brief Declaration of a streaming summary of a set of values from which approximate quantiles can be computed.
+*/
+#ifndef evtbin_QuantileSketch_h
+#define evtbin_QuantileSketch_h
+
+#include <vector>
+
+namespace evtbin {
+  /** \class QuantileSketch
+      \brief Streaming summary of a set of values from which approximate quantiles can be computed, using the algorithm of
+             Greenwald and Khanna (2001). The rank of any quantile returned is within epsilon * N of the requested rank,
+             where N is the number of values added, while the summary itself stays much smaller than N.
+  */
+  class QuantileSketch {
+    public:
+      /** \brief Construct an empty sketch.
+          \param epsilon The maximum error in the rank of any quantile, as a fraction of the number of values.
+      */
+      explicit QuantileSketch(double epsilon = 1.e-3);
+
+      /** \brief Add a value to the summary.
+          \param value The value.
+      */
+      void add(double value);
+
+      /** \brief Return the number of values added so far.
+      */
+      long getCount() const;
+
+      /** \brief Return a value whose rank is approximately phi * N. Throws an exception if no values were added.
+          \param phi The quantile, from 0 (minimum) to 1 (maximum).
+      */
+      double getQuantile(double phi) const;
+
+    private:
+      struct Tuple {
+        Tuple(double value, double gap, double delta): m_value(value), m_gap(gap), m_delta(delta) {}
+        double m_value;
+        double m_gap;
+        double m_delta;
+      };
+
+      typedef std::vector<Tuple> TupleCont_t;
+
+      /** \brief Merge the buffered values into the summary, and compress the summary.
+      */
+      void flush() const;
+
+      double m_epsilon;
+      long m_count;
+      mutable TupleCont_t m_summary;
+      mutable std::vector<double> m_buffer;
+  };
+
+}
+
+#endif
@@ -0,0 +1,138 @@
+/** \file SparseHist3D.h
+    \brief Three dimensional histogram which stores only its nonzero bins.
+*/
+#ifndef evtbin_SparseHist3D_h
+#define evtbin_SparseHist3D_h
+
+#include <vector>
+
+#include "evtbin/Hist.h"
+
+namespace evtbin {
+
+  class Binner;
+
+  /** \class SparseHist3D
+      \brief Three dimensional histogram which stores only its nonzero bins, in one plane per bin of the third
+             dimension. Each plane holds the positions of its nonzero bins in a 2-d image of the first two dimensions,
+             sorted, alongside their contents, so a stack of many sparsely filled planes (e.g. count maps over short
+             time windows) takes memory in proportion to the number of bins which were filled rather than to the size
+             of the stack. Fills are buffered, and merged into the planes in sorted batches whose size grows with the
+             number of filled bins.
+  */
+  class SparseHist3D : public Hist {
+    public:
+      typedef std::vector<long> PixelCont_t;
+      typedef std::vector<double> ValueCont_t;
+
+      /** \brief Create a three dimensional histogram which uses the given binner objects
+          to determine the indices.
+          \param binner1 The binner object for the first dimension.
+          \param binner2 The binner object for the second dimension.
+          \param binner3 The binner object for the third dimension.
+      */
+      SparseHist3D(const Binner & binner1, const Binner & binner2, const Binner & binner3);
+
+      virtual ~SparseHist3D() throw();
+
+      /** \brief Increment the bin appropriate for the given value.
+                 This is generic for N-dimensional histograms.
+          \param value Vector giving the value being binned. The vector must have at least as
+                 many values as the dimensionality of the histogram.
+      */
+      virtual void fillBin(const std::vector<double> & value, double weight = 1.);
+
+      /** \brief Fill output vector with the contents of the histogram, in which the index of the last dimension
+                 varies fastest.
+          \param values The output vector.
+      */
+      virtual void getValues(std::vector<double> & values) const;
+
+      /** \brief Add the given values, laid out as by getValues, to the contents of the histogram.
+          \param values The values to add.
+      */
+      virtual void addValues(const std::vector<double> & values);
+
+      /** \brief Add the contents of a master histogram with finer bins to this histogram, as Hist::addRebinned does.
+                 If the master is also sparse, only its nonzero bins are visited, and neither histogram is expanded
+                 to its full size.
+          \param master The master histogram.
+      */
+      virtual void addRebinned(const Hist & master);
+
+      /** \brief Add the nonzero bins of this histogram to those of a histogram with coarser bins.
+          \param offset For each dimension, the contribution of each bin to the flat index of the coarse bin.
+          \param values The contents of the coarse histogram, laid out as by getValues.
+      */
+      virtual void sumRebinned(const std::vector<std::vector<long> > & offset, std::vector<double> & values) const;
+
+      /** \brief Fill output vector with a 1-d representation of the histogram, suitable for storing as an image.
+          \param image The output vector.
+      */
+      void getImage(std::vector<float> & image) const;
+
+      /** \brief Fill output vector with a 1-d representation of one plane of the histogram, suitable for storing
+                 as a 2-d image.
+          \param index3 The index of the plane in the third dimension.
+          \param image The output vector.
+      */
+      void getPlaneImage(long index3, std::vector<float> & image) const;
+
+      /** \brief Increment the bin appropriate for the given value.
+          \param value1 The value being binned by the first binner.
+          \param value2 The value being binned by the second binner.
+          \param value3 The value being binned by the third binner.
+      */
+      void fillBin(double value1, double value2, double value3, double weight = 1.);
+
+      /** \brief Increment the bin of the given plane appropriate for the given value, for callers which have already
+                 found the plane, e.g. to select the values to bin.
+          \param index3 The index of the plane in the third dimension.
+          \param value1 The value being binned by the first binner.
+          \param value2 The value being binned by the second binner.
+      */
+      void fillPlaneBin(long index3, double value1, double value2, double weight = 1.);
+
+      /** \brief Return the positions of the nonzero bins of one plane in the plane's image, in increasing order.
+          \param index3 The index of the plane in the third dimension.
+      */
+      const PixelCont_t & getPixels(long index3) const;
+
+      /** \brief Return the contents of the nonzero bins of one plane, in the order of getPixels.
+          \param index3 The index of the plane in the third dimension.
+      */
+      const ValueCont_t & getPlaneValues(long index3) const;
+
+    private:
+      /** \brief A fill which has not yet been merged into its plane.
+      */
+      struct Fill {
+        long m_index3;
+        long m_pixel;
+        double m_weight;
+
+        bool operator <(const Fill & fill) const {
+          return m_index3 < fill.m_index3 || (m_index3 == fill.m_index3 && m_pixel < fill.m_pixel);
+        }
+      };
+
+      /** \brief Buffer one fill, merging the buffer into the planes when it is full.
+      */
+      void addFill(long index3, long pixel, double weight);
+
+      /** \brief Merge the buffered fills into the planes. The buffer is logically part of the contents, so this does
+                 not change the contents of the histogram.
+      */
+      void flush() const;
+
+      long m_size1;
+      long m_size2;
+      mutable std::vector<PixelCont_t> m_pixels;
+      mutable std::vector<ValueCont_t> m_values;
+      mutable std::vector<Fill> m_pending;
+      mutable long m_num_filled; // number of nonzero bins held in the planes
+  };
+
+}
+
+#endif
@@ -8,6 +8,7 @@ def generate(env, **kw):
     env.Tool('st_streamLib')
     env.Tool('healpixLib')
     env.Tool('tipLib')
+    env.Tool('addLibrary', library = env['cfitsioLibs'])
     # EAC, add dependence on HEALPix external
     env.Tool('addLibrary', library=env['healpixlibs'])
 
@@ -5,28 +5,69 @@
 */
 #include <algorithm>
 #include <cmath>
+#include <deque>
 #include <limits>
 #include <memory>
 #include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 //#include "CLHEP/Random/Stat.h"
 
 #include "evtbin/BayesianBinner.h"
 
 namespace {
-  typedef std::deque<double> deque_t;
   typedef std::vector<double> vec_t;
 }
 
 namespace evtbin {
 
+  BayesianBinner::BayesianBinner(double begin, double end, const std::vector<double> & event_time, const std::string & name,
+    double ncp_prior, bool prune): OrderedBinner(IntervalCont_t(), name), m_cell_pop(), m_ncp_prior(ncp_prior) {
+    if (begin >= end) {
+      std::ostringstream os;
+      os << "Cannot compute Bayesian Blocks: time range [" << begin << ", " << end << "] is empty" << std::endl;
+      throw std::runtime_error(os.str());
+    }
+
+    // Cells are defined by walking the events in time order, so sort a copy only if necessary.
+    vec_t sorted_time;
+    const vec_t * time = &event_time;
+    if (!std::is_sorted(event_time.begin(), event_time.end())) {
+      sorted_time = event_time;
+      std::sort(sorted_time.begin(), sorted_time.end());
+      time = &sorted_time;
+    }
+
+    vec_t::const_iterator itor = std::lower_bound(time->begin(), time->end(), begin);
+    vec_t::const_iterator stop = std::upper_bound(itor, time->end(), end);
+    if (itor == stop) throw std::runtime_error("Cannot compute Bayesian Blocks: no events in the time range");
+
+    IntervalCont_t intervals;
+    m_cell_pop.reserve(stop - itor);
+    intervals.reserve(stop - itor);
+    double cell_begin = begin;
+    while (itor != stop) {
+      // Merge all events at this time into one cell.
+      double current = *itor;
+      double pop = 0.;
+      for (; itor != stop && current == *itor; ++itor) pop += 1.;
+
+      double cell_end = (itor != stop) ? .5 * (current + *itor) : end;
+      intervals.push_back(Interval(cell_begin, cell_end));
+      m_cell_pop.push_back(pop);
+      cell_begin = cell_end;
+    }
+
+    computeBlocks(intervals, prune);
+  }
+
   BayesianBinner::~BayesianBinner() throw() {}
 
   Binner * BayesianBinner::clone() const { return new BayesianBinner(*this); }
 
-  void BayesianBinner::computeBlocks(const IntervalCont_t & intervals) {
+  void BayesianBinner::computeBlocks(const IntervalCont_t & intervals, bool prune) {
     // Check inputs for validity.
     for (IntervalCont_t::size_type index = 0; index != intervals.size(); ++index) {
       if (0. >= intervals[index].width()) {
@@ -38,59 +79,83 @@ namespace evtbin {
 
     // Number of cells, obtained here once for convenience.
     vec_t::size_type num_cells = m_cell_pop.size();
-
-    // Create arrays to hold the reverse cumulative sums.
-    deque_t rev_csize(1, intervals[0].width());
-    deque_t rev_cpop(1, m_cell_pop[0]);
+    if (0 == num_cells) throw std::runtime_error("Cannot compute Bayesian Blocks: no input cells");
+
+    // Penalty applied to every block. This is the constant part of the log posterior from log_prob.pro.
+    const double penalty = m_ncp_prior + 6.7;
+
+    // Candidate block starts, held in parallel contiguous arrays. For each candidate, keep its cell index, the
+    // cumulative size and population of all cells before it, and the best fitness of the partition which ends
+    // just before it. The fitness of a block from a candidate to the current cell then follows from differences
+    // with the running totals, without touching any earlier candidates' sums. Candidates are kept in increasing
+    // order of cell index, so the first maximum is the same one BBglobal.pro selects.
+    std::vector<vec_t::size_type> cand_start;
+    vec_t cand_size;
+    vec_t cand_pop;
+    vec_t cand_best;
+    vec_t fitness;
+    cand_start.reserve(num_cells);
+    cand_size.reserve(num_cells);
+    cand_pop.reserve(num_cells);
+    cand_best.reserve(num_cells);
+    fitness.reserve(num_cells);
 
     vec_t best(num_cells, 0.);
-    vec_t merged(num_cells, 0.);
-    vec_t temp(num_cells, 0.);
     std::vector<vec_t::size_type> last_start(num_cells, 0);
+    double cum_size = 0.;
+    double cum_pop = 0.;
     for (vec_t::size_type index = 0; index != num_cells; ++index) {
+      // The current cell is always a candidate for the start of the last block.
+      cand_start.push_back(index);
+      cand_size.push_back(cum_size);
+      cand_pop.push_back(cum_pop);
+      cand_best.push_back(0 == index ? 0. : best[index - 1]);
 
-      if (index > 0) {
-        // The following lines replace the following construct from BBglobal.pro:
-        //       cumsizes = [cell_sizes(R), cumsizes + cell_sizes(R)]
-        for (deque_t::iterator itor = rev_csize.begin(); itor != rev_csize.begin() + index; ++itor)
-          *itor += intervals[index].width();
-        rev_csize.push_front(intervals[index].width());
-
-        // The following lines replace the following construct from BBglobal.pro:
-        //       cumpops  = [cell_pops(R),  cumpops  + cell_pops(R)]
-        for (deque_t::iterator itor = rev_cpop.begin(); itor != rev_cpop.begin() + index; ++itor) *itor += m_cell_pop[index];
-        rev_cpop.push_front(m_cell_pop[index]);
-      }
+      cum_size += intervals[index].width();
+      cum_pop += m_cell_pop[index];
 
       // The following lines replace the following construct from BBglobal.pro:
       //    merged = reverse(log_prob(cumpops, cumsizes))
-      computeLogProb(rev_csize, rev_cpop, merged);
-      std::reverse(merged.begin(), merged.begin() + index + 1);
-
-      // The following lines replace the following construct from BBglobal.pro:
-      //    if (R eq 0) then begin
-      //       best(R) = max(merged, imaxer)
-      //     endif else begin
-      //       temp = [0., best(0:R-1)] + merged
-      //       best(R) = max(temp, imaxer)
-      //     endelse
-      vec_t::size_type imaxer;
-      vec_t::const_iterator imax_itor;
-      if (index == 0) {
-        imax_itor = std::max_element(merged.begin(), merged.begin() + index + 1);
-        imaxer = imax_itor - merged.begin();
-      } else {
-        temp[0] = 0.;
-        std::copy(best.begin(), best.begin() + index, temp.begin() + 1);
-        for (vec_t::size_type ii = 0; ii != index + 1; ++ii) temp[ii] += merged[ii];
-        imax_itor = std::max_element(temp.begin(), temp.begin() + index + 1);
-        imaxer = imax_itor - temp.begin();
+      //    temp = [0., best(0:R-1)] + merged
+      // Note that N * (log(N) - log(T) - 1) from log_prob.pro is evaluated with a single logarithm.
+      vec_t::size_type num_cand = cand_start.size();
+      fitness.resize(num_cand);
+      const double * size_ptr = &cand_size[0];
+      const double * pop_ptr = &cand_pop[0];
+      const double * best_ptr = &cand_best[0];
+      double * fit_ptr = &fitness[0];
+      for (vec_t::size_type ii = 0; ii < num_cand; ++ii) {
+        double pop = cum_pop - pop_ptr[ii];
+        double size = cum_size - size_ptr[ii];
+        double log_prob = .0001 < pop ? pop * (std::log(pop / size) - 1.) : 0.;
+        fit_ptr[ii] = best_ptr[ii] + log_prob - penalty;
       }
-      best[index] = *imax_itor;
 
       // The following lines replace the following construct from BBglobal.pro:
+      //    best(R) = max(temp, imaxer)
       //    last_start(R) = imaxer
-      last_start[index] = imaxer;
+      vec_t::const_iterator imax_itor = std::max_element(fitness.begin(), fitness.end());
+      best[index] = *imax_itor;
+      last_start[index] = cand_start[imax_itor - fitness.begin()];
+
+      if (prune) {
+        // A candidate whose fitness plus one block penalty is below the best fitness so far can never be optimal
+        // for any later cell, because splitting a block never lowers its likelihood (Killick et al. 2012).
+        vec_t::size_type kept = 0;
+        for (vec_t::size_type ii = 0; ii != num_cand; ++ii) {
+          if (fitness[ii] + penalty >= best[index]) {
+            cand_start[kept] = cand_start[ii];
+            cand_size[kept] = cand_size[ii];
+            cand_pop[kept] = cand_pop[ii];
+            cand_best[kept] = cand_best[ii];
+            ++kept;
+          }
+        }
+        cand_start.resize(kept);
+        cand_size.resize(kept);
+        cand_pop.resize(kept);
+        cand_best.resize(kept);
+      }
     }
 
     // The following lines replace the following construct from BBglobal.pro:
@@ -118,6 +183,7 @@ namespace evtbin {
     }
     // Hack to make this work correctly.
     m_intervals.back() = Interval(m_intervals.back().begin(), intervals[cp.back()].end());
+    buildIndex();
 
     // This code is for data type "3" from pulsefitter6.pro.
     // The following lines replace the following construct from blocker.pro:
@@ -134,31 +200,4 @@ namespace evtbin {
     //    yy_blocks = [yy_blocks, 0.]
   }
 
-  void BayesianBinner::computeLogProb(const std::deque<double> & rev_csize, const std::deque<double> & rev_cpop,
-    std::vector<double> & log_prob) const {
-    // This code is for data type "3" from pulsefitter6.pro.
-    //
-    // The following lines replace the following construct from log_prob.pro:
-    // ncells = n_elements(cell_sizes)
-    deque_t::size_type num_cells = rev_csize.size();
-
-    // The following lines replace the following construct from log_prob.pro:
-    // ;-----------------------------
-    // ; posterior for binned data
-    // ;-----------------------------
-    //
-    //    logprob = lngamma(cell_pops + 1.) - (cell_pops + 1.) * alog(cell_sizes)
-    //
-    //    logprob = logprob - ncp_prior
-    for (deque_t::size_type index = 0; index != num_cells; ++index) {
-      //log_prob[index] = HepStat::gammln(rev_cpop[index] + 1.) - (rev_cpop[index] + 1.) * std::log(rev_csize[index]) - m_ncp_prior;
-      //log_prob[index] = rev_cpop[index] * (std::log(rev_cpop[index]) - std::log(rev_csize[index]) - 1.);
-      if (.0001 < rev_cpop[index])
-        log_prob[index] = rev_cpop[index] * (std::log(rev_cpop[index]) - std::log(rev_csize[index]) - 1.);
-      else
-        log_prob[index] = 0.;
-      log_prob[index] -= m_ncp_prior + 6.7;
-    }
-  }
-
 }
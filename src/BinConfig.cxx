@@ -6,18 +6,23 @@
 #include <cctype>
 #include <climits>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 #include <cmath>
 
 #include "GlastGbmBinConfig.h"
 #include "GlastLatBinConfig.h"
+#include "evtbin/BayesianBinner.h"
 #include "evtbin/BinConfig.h"
 #include "evtbin/ConstSnBinner.h"
 #include "evtbin/Gti.h"
 #include "evtbin/LinearBinner.h"
 #include "evtbin/LogBinner.h"
 #include "evtbin/OrderedBinner.h"
+#include "evtbin/PhaseBinner.h"
+#include "evtbin/QuantileSketch.h"
 
 // Interactive parameter file access from st_app.
 #include "st_app/AppParGroup.h"
@@ -30,6 +35,67 @@
 #include "tip/IFileSvc.h"
 #include "tip/Table.h"
 
+namespace {
+
+  /** \brief Read all values of the given field from the given table in each of the given event files, optionally
+             together with the values of a second field.
+      \param ev_file_name The event file name, or list file.
+      \param ev_table The name of the event table.
+      \param field The name of the field to read.
+      \param value The container to which to append the values.
+      \param opt_field The name of an optional second field to read in the same pass, or empty for none.
+      \param opt_value The container to which to append the values of the optional field. This is left empty
+             if any of the tables does not have the optional field.
+  */
+  void readEventField(const std::string & ev_file_name, const std::string & ev_table, const std::string & field,
+    std::vector<double> & value, const std::string & opt_field = std::string(),
+    std::vector<double> * opt_value = 0) {
+    using namespace st_facilities;
+    bool read_opt = 0 != opt_value && !opt_field.empty();
+    FileSys::FileNameCont file_name_cont = FileSys::expandFileList(ev_file_name);
+    for (FileSys::FileNameCont::iterator file_itor = file_name_cont.begin(); file_itor != file_name_cont.end(); ++file_itor) {
+      std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(*file_itor, ev_table));
+      if (read_opt) {
+        try {
+          table->getFieldIndex(opt_field);
+        } catch (const tip::TipException &) {
+          read_opt = false;
+          opt_value->clear();
+        }
+      }
+      value.reserve(value.size() + table->getNumRecords());
+      if (read_opt) opt_value->reserve(opt_value->size() + table->getNumRecords());
+      for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+        value.push_back((*itor)[field].get());
+        if (read_opt) opt_value->push_back((*itor)[opt_field].get());
+      }
+    }
+  }
+
+  /** \brief Add all values of the given field inside the range [begin, end) to the given sketch, from the given table in
+             each of the given event files.
+      \param ev_file_name The event file name, or list file.
+      \param ev_table The name of the event table.
+      \param field The name of the field to read.
+      \param begin The beginning of the range.
+      \param end The end of the range.
+      \param sketch The sketch.
+  */
+  void sketchEventField(const std::string & ev_file_name, const std::string & ev_table, const std::string & field,
+    double begin, double end, evtbin::QuantileSketch & sketch) {
+    using namespace st_facilities;
+    FileSys::FileNameCont file_name_cont = FileSys::expandFileList(ev_file_name);
+    for (FileSys::FileNameCont::iterator file_itor = file_name_cont.begin(); file_itor != file_name_cont.end(); ++file_itor) {
+      std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(*file_itor, ev_table));
+      for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+        double value = (*itor)[field].get();
+        if (begin <= value && end > value) sketch.add(value);
+      }
+    }
+  }
+
+}
+
 namespace evtbin {
 
   BinConfig::ConfigCont BinConfig::s_config_cont;
@@ -208,6 +274,41 @@ namespace evtbin {
       par_group.Prompt(sn_ratio);
       par_group.Prompt(lc_emin);
       par_group.Prompt(lc_emax);
+    } else if (bin_type == "QUANT") {
+      // Get remaining parameters needed for bins with approximately equal numbers of events.
+      if (bin_begin == "tstart") {
+	timeParDefaults(par_group,bin_begin);
+	timeParDefaults(par_group,bin_end);
+      } else {
+	par_group.Prompt(bin_begin);
+	par_group.Prompt(bin_end);
+      }
+      par_group.Prompt(num_bins);
+    } else if (bin_type == "PHASE") {
+      // Get remaining parameters needed for pulse phase bins: the range of times to fold, the ephemeris and the
+      // number of phase bins.
+      if (bin_begin == "tstart") {
+	timeParDefaults(par_group,bin_begin);
+	timeParDefaults(par_group,bin_end);
+      } else {
+	par_group.Prompt(bin_begin);
+	par_group.Prompt(bin_end);
+      }
+      par_group.Prompt("pepoch");
+      par_group.Prompt("f0");
+      par_group.Prompt("f1");
+      par_group.Prompt("f2");
+      par_group.Prompt(num_bins);
+    } else if (bin_type == "BB") {
+      // Get remaining parameters needed for Bayesian Blocks computed from the individual events.
+      if (bin_begin == "tstart") {
+	timeParDefaults(par_group,bin_begin);
+	timeParDefaults(par_group,bin_end);
+      } else {
+	par_group.Prompt(bin_begin);
+	par_group.Prompt(bin_end);
+      }
+      par_group.Prompt("ncpprior");
     } else throw std::runtime_error(std::string("Unknown binning algorithm ") + par_group[alg].Value());
   }
 
@@ -257,8 +358,65 @@ namespace evtbin {
       binner = new OrderedBinner(intervals, par_group[in_field]);
 
     } else if (bin_type == "SNR") {
-      binner = new ConstSnBinner(par_group[bin_begin], par_group[bin_end], par_group[sn_ratio], par_group[lc_emin],
-        par_group[lc_emax], std::vector<double>(), par_group[in_field]);
+      // Read the values of the input field from every event, and use them to define the bins up front. Read the
+      // energies too if the events have them, so that only events in the energy band define the bins.
+      std::vector<double> event_value;
+      std::vector<double> event_energy;
+      readEventField(par_group["evfile"], par_group["evtable"], par_group[in_field], event_value, par_group["efield"],
+        &event_energy);
+      ConstSnBinner * sn_binner = new ConstSnBinner(par_group[bin_begin], par_group[bin_end], par_group[sn_ratio],
+        par_group[lc_emin], par_group[lc_emax], std::vector<double>(), par_group[in_field]);
+      if (event_energy.empty()) sn_binner->defineBins(event_value);
+      else sn_binner->defineBins(event_value, event_energy);
+      binner = sn_binner;
+    } else if (bin_type == "QUANT") {
+      double begin = par_group[bin_begin];
+      double end = par_group[bin_end];
+      long num = par_group[num_bins];
+      if (begin >= end) throw std::runtime_error("Cannot define equal-count bins: the binning interval is empty");
+      if (0 >= num) throw std::runtime_error("Cannot define equal-count bins: the number of bins must be positive");
+
+      // Reuse the edges if bins with these parameters were already defined, e.g. the energy bins for the ebounds.
+      std::ostringstream os;
+      os.precision(24);
+      os << par_group["evfile"].Value() << '\n' << par_group["evtable"].Value() << '\n' << par_group[in_field].Value() <<
+        '\n' << begin << '\n' << end << '\n' << num;
+      std::vector<double> & edges(m_quant_edge_cont[os.str()]);
+
+      if (edges.empty()) {
+        // Summarize the distribution of the input field in one pass over the events.
+        QuantileSketch sketch;
+        sketchEventField(par_group["evfile"], par_group["evtable"], par_group[in_field], begin, end, sketch);
+        if (0 == sketch.getCount()) {
+          m_quant_edge_cont.erase(os.str());
+          throw std::runtime_error("Cannot define equal-count bins: no events in the binning interval");
+        }
+
+        // Place the boundaries between bins at the quantiles. Quantiles which coincide (many identical values)
+        // would give empty bins, so they are merged.
+        edges.push_back(begin);
+        for (long index = 1; index < num; ++index) {
+          double edge = sketch.getQuantile(double(index) / num);
+          if (edge > edges.back() && edge < end) edges.push_back(edge);
+        }
+        edges.push_back(end);
+      }
+
+      OrderedBinner::IntervalCont_t intervals;
+      for (std::vector<double>::size_type index = 1; index != edges.size(); ++index)
+        intervals.push_back(Binner::Interval(edges[index - 1], edges[index]));
+
+      binner = new OrderedBinner(intervals, par_group[in_field]);
+
+    } else if (bin_type == "PHASE") {
+      binner = new PhaseBinner(par_group[bin_begin], par_group[bin_end], par_group["pepoch"], par_group["f0"],
+        par_group["f1"], par_group["f2"], par_group[num_bins], par_group[in_field]);
+    } else if (bin_type == "BB") {
+      // Read the values of the input field from every event, and find the blocks directly from them.
+      std::vector<double> event_value;
+      readEventField(par_group["evfile"], par_group["evtable"], par_group[in_field], event_value);
+      binner = new BayesianBinner(par_group[bin_begin], par_group[bin_end], event_value, par_group[in_field],
+        par_group["ncpprior"]);
     } else throw std::runtime_error(std::string("Unknown binning algorithm ") + par_group[alg].Value());
 
     return binner;
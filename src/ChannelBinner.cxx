@@ -0,0 +1,58 @@
+/** \file ChannelBinner.cxx
+    \brief Implementation of a binner whose bins are individual integer channels.
+*/
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "evtbin/ChannelBinner.h"
+
+namespace evtbin {
+
+  ChannelBinner::ChannelBinner(const ChannelCont_t & channels, const std::string & name): Binner(name),
+    m_channels(channels), m_lookup(), m_offset(0) {
+    if (m_channels.empty()) throw std::runtime_error("ChannelBinner: list of channels is empty");
+
+    // The lookup table covers every channel from the lowest to the highest; gaps map to -1.
+    m_offset = *std::min_element(m_channels.begin(), m_channels.end());
+    long highest = *std::max_element(m_channels.begin(), m_channels.end());
+    m_lookup.assign(highest - m_offset + 1, -1);
+    for (ChannelCont_t::size_type index = 0; index != m_channels.size(); ++index) {
+      long & entry = m_lookup[m_channels[index] - m_offset];
+      if (0 <= entry) {
+        std::ostringstream os;
+        os << "ChannelBinner: channel " << m_channels[index] << " appears more than once";
+        throw std::runtime_error(os.str());
+      }
+      entry = index;
+    }
+  }
+
+  long ChannelBinner::computeIndex(double value) const {
+    // Round to the nearest channel, with halves going up to match the [channel - .5, channel + .5) intervals.
+    double channel = std::floor(value + .5) - m_offset;
+    if (!(channel >= 0. && channel < double(m_lookup.size()))) return -1;
+    return m_lookup[long(channel)];
+  }
+
+  long ChannelBinner::getNumBins() const { return m_channels.size(); }
+
+  Binner::Interval ChannelBinner::getInterval(long index) const {
+    if (index < 0 || (unsigned long)(index) >= m_channels.size()) return Binner::Interval(0., 0.);
+    double channel = m_channels[index];
+    return Binner::Interval(channel - .5, channel + .5);
+  }
+
+  Binner * ChannelBinner::clone() const { return new ChannelBinner(*this); }
+
+  void ChannelBinner::computeIndices(const double * value, long num_values, long * index) const {
+    double size = m_lookup.size();
+    for (long ii = 0; ii < num_values; ++ii) {
+      // Same rounding as computeIndex. The comparisons also reject NaN.
+      double channel = std::floor(value[ii] + .5) - m_offset;
+      index[ii] = (channel >= 0. && channel < size) ? m_lookup[long(channel)] : -1;
+    }
+  }
+
+}
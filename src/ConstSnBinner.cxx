@@ -2,7 +2,10 @@
     \brief Implementation of a linearly uniform interval binner.
 */
 
+#include <algorithm>
 #include <cmath>
+#include <sstream>
+#include <stdexcept>
 
 #include "evtbin/ConstSnBinner.h"
 
@@ -16,62 +19,97 @@ namespace evtbin {
     m_interval_end(interval_end),
     m_sn_ratio_squared(sn_ratio * sn_ratio),
     m_lc_emin(lc_emin),
-    m_lc_emax(lc_emax),
-    m_counts(0.),
-    m_background(0.),
-    m_previous_value(interval_begin) {
+    m_lc_emax(lc_emax) {
   }
 
-  long ConstSnBinner::computeIndex(double value) const {
-    // First make sure value is within the range.
-    // Note that this interval is (] unlike all other binners which are [).
-    if (m_interval_begin >= value || m_interval_end < value) return -1;
-
-    // See if this energy is in the range being used to define S/N bins.
-    // if (m_lc_emin > energy || m_lc_emax <= energy) return m_intervals.size() - 1;
-
-    // This value will for sure go in the last bin defined so far.
-    long index = m_intervals.size() - 1;
-
-    // Calculate the change in the background at this time.
-    double delta_back = 0.;
-    double value_jplus1th = 1.;
-    double previous_value_jplus1th = 1.;
-    for (unsigned int exponent = 0; exponent < m_background_coeff.size(); ++exponent) {
-      value_jplus1th *= value;
-      previous_value_jplus1th *= m_previous_value;
-      delta_back += m_background_coeff[exponent] * (value_jplus1th - previous_value_jplus1th) / (exponent + 1);
+  void ConstSnBinner::defineBins(const std::vector<double> & event_time) {
+    // Bins are defined by walking the events in time order, so sort a copy only if necessary.
+    std::vector<double> sorted_time;
+    const std::vector<double> * time = &event_time;
+    if (!std::is_sorted(event_time.begin(), event_time.end())) {
+      sorted_time = event_time;
+      std::sort(sorted_time.begin(), sorted_time.end());
+      time = &sorted_time;
     }
 
-    // Add the increase to the cumulative background.
-    m_background += delta_back;
-
-    // Increment the number of counts.
-    ++m_counts;
-
-    // The current value becomes the previous value for next time.
-    m_previous_value = value;
+    // Select the events inside the interval. Note that this interval is (] unlike all other binners which are [).
+    std::vector<double>::const_iterator begin = std::upper_bound(time->begin(), time->end(), m_interval_begin);
+    std::vector<double>::const_iterator end = std::upper_bound(begin, time->end(), m_interval_end);
+    std::vector<double>::size_type num_events = end - begin;
+
+    // First phase: the cumulative background at each event time. Each value is independent of all the others, and
+    // the background in any bin is just the difference of the values at its ends.
+    std::vector<double> cum_back(num_events);
+    for (std::vector<double>::size_type index = 0; index != num_events; ++index)
+      cum_back[index] = integrateBackground(begin[index]);
+
+    // Second phase: close a bin whenever the S/N threshold is reached.
+    m_intervals.assign(1, Interval(m_interval_begin, m_interval_end));
+    double counts = 0.;
+    double back_start = integrateBackground(m_interval_begin);
+    for (std::vector<double>::size_type index = 0; index != num_events; ++index) {
+      double value = begin[index];
+
+      // Increment the number of counts.
+      ++counts;
+
+      // Events at the same time always go in the same bin, so a bin may only be closed after the last of them.
+      if (index + 1 != num_events && begin[index + 1] == value) continue;
+
+      // Compute amount by which background was exceeded.
+      double background = cum_back[index] - back_start;
+      double differential_counts = counts > background ? counts - background : 0.;
+
+      // Test whether S/N threshold has been exceeded. If so, set up the next bin.
+      if (m_sn_ratio_squared * counts <= differential_counts * differential_counts) {
+        // Threshold was exceeded, so start a new S/N bin with no counts and no bg.
+        counts = 0.;
+        back_start = cum_back[index];
+
+        // Terminate the current bin with the current value, and start the next one unless this is the very end.
+        m_intervals.back() = Interval(m_intervals.back().begin(), value);
+        if (m_interval_end > value) m_intervals.push_back(Interval(value, m_interval_end));
+      }
+    }
 
-    // Compute amount by which background was exceeded.
-    double differential_counts = m_counts > m_background ? m_counts - m_background : 0.;
+    buildIndex();
+  }
 
-    // Test whether S/N threshold has been exceeded. If so, set up the next bin.
-    if (m_sn_ratio_squared * m_counts <= differential_counts * differential_counts) {
+  void ConstSnBinner::defineBins(const std::vector<double> & event_time, const std::vector<double> & event_energy) {
+    if (event_time.size() != event_energy.size()) {
+      std::ostringstream os;
+      os << "ConstSnBinner::defineBins was given " << event_time.size() << " event times but " << event_energy.size() <<
+        " energies";
+      throw std::logic_error(os.str());
+    }
 
-      // Threshold was exceeded, so start a new S/N bin with no counts, no bg, and new interval.
-      m_counts = 0.;
-      m_background = 0.;
+    // The background depends only on time, so the bins follow from the times of the in-band events alone.
+    if (m_lc_emin >= m_lc_emax) {
+      defineBins(event_time);
+    } else {
+      std::vector<double> in_band_time;
+      in_band_time.reserve(event_time.size());
+      for (std::vector<double>::size_type index = 0; index != event_time.size(); ++index) {
+        if (m_lc_emin <= event_energy[index] && m_lc_emax > event_energy[index]) in_band_time.push_back(event_time[index]);
+      }
+      defineBins(in_band_time);
+    }
+  }
 
-      // Terminate the current bin with the current value.
-      m_intervals.back() = Interval(m_intervals.back().begin(), value);
+  long ConstSnBinner::computeIndex(double value) const {
+    // First make sure value is within the range.
+    // Note that this interval is (] unlike all other binners which are [).
+    if (m_interval_begin >= value || m_interval_end < value) return -1;
 
-      // Next interval starts with this value and ends with the interval_end supplied to the constructor.
-      m_intervals.push_back(Interval(value, m_interval_end));
-    }
+    // Find the first bin whose end is not less than the value. Bins are contiguous, so this bin contains the value.
+    IntervalCont_t::const_iterator found = std::lower_bound(m_intervals.begin(), m_intervals.end(), value);
+    if (m_intervals.end() == found) return -1;
 
-    return index;
+    return found - m_intervals.begin();
   }
 
+  long ConstSnBinner::computeNextIndex(double value, long) const { return computeIndex(value); }
+
   long ConstSnBinner::getNumBins() const { return m_intervals.size(); }
 
   Binner::Interval ConstSnBinner::getInterval(long index) const {
@@ -84,4 +122,14 @@ namespace evtbin {
 
   Binner * ConstSnBinner::clone() const { return new ConstSnBinner(*this); }
 
+  double ConstSnBinner::integrateBackground(double value) const {
+    double integral = 0.;
+    double value_jplus1th = 1.;
+    for (std::vector<double>::size_type exponent = 0; exponent < m_background_coeff.size(); ++exponent) {
+      value_jplus1th *= value;
+      integral += m_background_coeff[exponent] * value_jplus1th / (exponent + 1);
+    }
+    return integral;
+  }
+
 }
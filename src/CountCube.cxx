@@ -15,8 +15,11 @@
 #include "astro/SkyProj.h"
 
 #include "evtbin/LinearBinner.h"
+#include "evtbin/LogBinner.h"
 #include "evtbin/Hist3D.h"
+#include "evtbin/HistND.h"
 #include "evtbin/CountCube.h"
+#include "evtbin/MappedEventTable.h"
 
 #include "st_facilities/Env.h"
 
@@ -29,20 +32,72 @@
 
 static const double pi = 3.14159265358979323846;
 
+namespace {
+  // Number of events projected and binned at a time.
+  const long s_batch_size = 4096;
+
+  // Histogram of a cube with logarithmic energy bins, whose binners are all called inline.
+  typedef evtbin::HistND<evtbin::LinearBinner, evtbin::LinearBinner, evtbin::LogBinner> LogCubeHist;
+
+  /** \brief Create the histogram of a cube, a LogCubeHist if the energy bins are logarithmic, or a Hist3D otherwise.
+      \param x_binner The binner of the first image axis.
+      \param y_binner The binner of the second image axis.
+      \param energy_binner The energy binner.
+  */
+  evtbin::Hist * createCubeHist(const evtbin::LinearBinner & x_binner, const evtbin::LinearBinner & y_binner,
+    const evtbin::Binner & energy_binner) {
+    const evtbin::LogBinner * log_binner = dynamic_cast<const evtbin::LogBinner *>(&energy_binner);
+    if (0 != log_binner) return new LogCubeHist(x_binner, y_binner, *log_binner);
+    return new evtbin::Hist3D(x_binner, y_binner, energy_binner);
+  }
+
+  /** \brief Bin a batch of events into a histogram made by createCubeHist.
+      \param hist The histogram.
+      \param x The first image coordinate of each event.
+      \param y The second image coordinate of each event.
+      \param energy The energy of each event.
+      \param num_events The number of events.
+  */
+  void fillCubeHist(evtbin::Hist & hist, const double * x, const double * y, const double * energy, long num_events) {
+    evtbin::Hist3D * hist3d = dynamic_cast<evtbin::Hist3D *>(&hist);
+    if (0 != hist3d) {
+      for (long ii = 0; ii != num_events; ++ii) hist3d->fillBin(x[ii], y[ii], energy[ii]);
+      return;
+    }
+    std::vector<const double *> columns(3);
+    columns[0] = x;
+    columns[1] = y;
+    columns[2] = energy;
+    hist.fillBins(columns, num_events);
+  }
+
+  /** \brief Fill output vector with the image of a histogram made by createCubeHist.
+      \param hist The histogram.
+      \param image The output vector.
+  */
+  void getCubeImage(const evtbin::Hist & hist, std::vector<float> & image) {
+    const LogCubeHist * log_hist = dynamic_cast<const LogCubeHist *>(&hist);
+    if (0 != log_hist) log_hist->getImage(image);
+    else dynamic_cast<const evtbin::Hist3D &>(hist).getImage(image);
+  }
+}
+
 namespace evtbin {
 
   CountCube::CountCube(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
     const std::string & sc_table, double ref_ra, double ref_dec, const std::string & proj,
     unsigned long num_x_pix, unsigned long num_y_pix, double pix_scale, double axis_rot, bool use_lb,
     const std::string & ra_field, const std::string & dec_field, const Binner & energy_binner, const Binner & ebounds, const Gti & gti):
-    DataProduct(event_file, event_table, gti), m_hist(
+    DataProduct(event_file, event_table, gti), m_hist(createCubeHist(
       //LinearBinner(- (long)(num_x_pix) / 2., num_x_pix / 2., 1., ra_field),
       //LinearBinner(- (long)(num_y_pix) / 2., num_y_pix / 2., 1., dec_field)
       LinearBinner(0.5, num_x_pix + 0.5, 1., ra_field),
       LinearBinner(0.5, num_y_pix + 0.5, 1., dec_field),
       energy_binner
-    ), m_proj_name(proj), m_crpix(), m_crval(), m_cdelt(), m_axis_rot(axis_rot), m_proj(0), m_use_lb(use_lb), m_ebounds(ebounds.clone()) {
-    m_hist_ptr = &m_hist;
+    )), m_type_hist(), m_x(), m_y(), m_type_x(), m_type_y(), m_type_energy(), m_selected(), m_proj_name(proj), m_crpix(),
+    m_crval(), m_cdelt(), m_axis_rot(axis_rot), m_proj(0), m_use_lb(use_lb), m_ebounds(ebounds.clone()) {
+    m_hist_ptr = m_hist;
+    m_use_mapped_input = true;
 
     m_crpix[0] = (num_x_pix + 1.) / 2.;
     m_crpix[1] = (num_y_pix + 1.) / 2.;
@@ -89,7 +144,13 @@ namespace evtbin {
     adjustTimeKeywords(sc_file, sc_table);
   }
 
-  CountCube::~CountCube() throw() { delete m_proj; delete m_ebounds; }
+  CountCube::~CountCube() throw() {
+    for (std::vector<Hist *>::reverse_iterator itor = m_type_hist.rbegin(); itor != m_type_hist.rend(); ++itor)
+      delete *itor;
+    delete m_proj;
+    delete m_ebounds;
+    delete m_hist;
+  }
 
   void CountCube::binInput() {
     DataProduct::binInput();
@@ -97,29 +158,135 @@ namespace evtbin {
 
   void CountCube::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end) {
     // Get binners for the two dimensions.
-    const Hist::BinnerCont_t & binners = m_hist.getBinners();
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
 
     // From each binner, get the name of its field, interpreted as ra and dec.
     std::string ra_field = binners[0]->getName();
     std::string dec_field = binners[1]->getName();
     std::string energy_field = binners[2]->getName();
 
-    // Fill histogram, converting each RA/DEC to Sky X/Y on the fly:
+    // Fill histogram one batch of events at a time, converting each RA/DEC to Sky X/Y:
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    std::vector<double> energy(s_batch_size);
+    std::vector<unsigned long> event_type(s_batch_size);
+    long num_events = 0;
     for (tip::Table::ConstIterator itor = begin; itor != end; ++itor) {
-      // Extract the ra and dec from each record.
-      double ra = (*itor)[ra_field].get();
-      double dec = (*itor)[dec_field].get();
-      double energy = (*itor)[energy_field].get();
+      // Extract the ra, dec and energy from each record.
+      ra[num_events] = (*itor)[ra_field].get();
+      dec[num_events] = (*itor)[dec_field].get();
+      energy[num_events] = (*itor)[energy_field].get();
+      if (!m_event_types.empty()) event_type[num_events] = readEventType(itor);
+      if (s_batch_size == ++num_events) {
+        fillBatch(&ra[0], &dec[0], &energy[0], &event_type[0], num_events);
+        num_events = 0;
+      }
+    }
+    fillBatch(&ra[0], &dec[0], &energy[0], &event_type[0], num_events);
+  }
 
-      // Convert to sky coordinates.
-      std::pair<double, double> coord = astro::SkyDir(ra, dec).project(*m_proj);
+  void CountCube::binInput(const MappedEventTable & table, long first_record, long last_record) {
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
+    std::string ra_field = binners[0]->getName();
+    std::string dec_field = binners[1]->getName();
+    std::string energy_field = binners[2]->getName();
 
-      // Bin the value.
-      m_hist.fillBin(coord.first, coord.second, energy);
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    std::vector<double> energy(s_batch_size);
+    std::vector<unsigned long> event_type(s_batch_size);
+    for (long batch_begin = first_record; batch_begin < last_record; batch_begin += s_batch_size) {
+      long num_events = std::min(s_batch_size, last_record - batch_begin);
+      table.readColumn(ra_field, batch_begin, num_events, &ra[0]);
+      table.readColumn(dec_field, batch_begin, num_events, &dec[0]);
+      table.readColumn(energy_field, batch_begin, num_events, &energy[0]);
+      if (!m_event_types.empty()) table.readBits(m_event_type_field, batch_begin, num_events, &event_type[0]);
+      fillBatch(&ra[0], &dec[0], &energy[0], &event_type[0], num_events);
     }
   }
 
+  void CountCube::setEventTypes(const EventTypeCont_t & event_types, const std::string & field) {
+    // Create the new histograms with the bins of the current one before any histogram is deleted.
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
+    const LinearBinner & x_binner = dynamic_cast<const LinearBinner &>(*binners[0]);
+    const LinearBinner & y_binner = dynamic_cast<const LinearBinner &>(*binners[1]);
+    std::vector<Hist *> type_hist;
+    for (EventTypeCont_t::size_type index = 0; index != event_types.size(); ++index)
+      type_hist.push_back(createCubeHist(x_binner, y_binner, *binners[2]));
+    Hist * hist = event_types.empty() && 0 == m_hist ? createCubeHist(x_binner, y_binner, *binners[2]) : m_hist;
+
+    for (std::vector<Hist *>::reverse_iterator itor = m_type_hist.rbegin(); itor != m_type_hist.rend(); ++itor)
+      delete *itor;
+    m_type_hist.swap(type_hist);
+
+    // A split cube bins events only into the cube of each event type, so the full cube is freed, and the cube of the
+    // first event type stands in for it to describe the bins.
+    if (!event_types.empty()) {
+      delete hist;
+      hist = 0;
+    }
+    m_hist = hist;
+    m_hist_ptr = event_types.empty() ? m_hist : m_type_hist.front();
+    m_event_types = event_types;
+    m_event_type_field = field;
+  }
+
+  void CountCube::fillBatch(const double * ra, const double * dec, const double * energy, const unsigned long * event_type,
+    long num_events) {
+    if (0 == num_events) return;
+
+    // Convert to sky coordinates.
+    m_x.resize(num_events);
+    m_y.resize(num_events);
+    for (long ii = 0; ii != num_events; ++ii) {
+      std::pair<double, double> coord = astro::SkyDir(ra[ii], dec[ii]).project(*m_proj);
+      m_x[ii] = coord.first;
+      m_y[ii] = coord.second;
+    }
+
+    if (m_event_types.empty()) {
+      fillCubeHist(*m_hist, &m_x[0], &m_y[0], energy, num_events);
+      return;
+    }
+
+    // Bin each event into the histogram of every event type it belongs to, gathering the events of each type first.
+    m_selected.resize(num_events);
+    m_type_x.resize(num_events);
+    m_type_y.resize(num_events);
+    m_type_energy.resize(num_events);
+    for (EventTypeCont_t::size_type index = 0; index != m_event_types.size(); ++index) {
+      selectEventType(event_type, num_events, m_event_types[index], &m_selected[0]);
+      long num_selected = 0;
+      for (long ii = 0; ii != num_events; ++ii) {
+        if (m_selected[ii]) {
+          m_type_x[num_selected] = m_x[ii];
+          m_type_y[num_selected] = m_y[ii];
+          m_type_energy[num_selected] = energy[ii];
+          ++num_selected;
+        }
+      }
+      fillCubeHist(*m_type_hist[index], &m_type_x[0], &m_type_y[0], &m_type_energy[0], num_selected);
+    }
+  }
+
+  std::string CountCube::getSkyProjection() const {
+    std::ostringstream os;
+    os.precision(17);
+    os << m_proj_name << ' ' << m_crpix[0] << ' ' << m_crpix[1] << ' ' << m_crval[0] << ' ' << m_crval[1] << ' ' <<
+      m_cdelt[0] << ' ' << m_cdelt[1] << ' ' << m_axis_rot << ' ' << m_use_lb;
+    return os.str();
+  }
+
   void CountCube::writeOutput(const std::string & creator, const std::string & out_file) const {
+    if (m_event_types.empty()) {
+      writeImage(creator, out_file, *m_hist);
+    } else {
+      for (EventTypeCont_t::size_type index = 0; index != m_event_types.size(); ++index)
+        writeImage(creator, getEventTypeFileName(out_file, m_event_types[index]), *m_type_hist[index]);
+    }
+  }
+
+  void CountCube::writeImage(const std::string & creator, const std::string & out_file, const Hist & hist) const {
     // Standard file creation from base class.
     createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatCountCubeTemplate"));
 
@@ -136,7 +303,7 @@ namespace evtbin {
     if (3 != num_dims) throw std::runtime_error("CountCube::writeOutput cannot write a count map to an image which is not 2D");
 
     // Get the binners.
-    const Hist::BinnerCont_t & binners = m_hist.getBinners();
+    const Hist::BinnerCont_t & binners = hist.getBinners();
 
     // Extract the energy binner.
     const Binner * energy_binner = binners.at(2);
@@ -194,22 +361,28 @@ namespace evtbin {
       dims[index] = binners.at(index)->getNumBins();
     }
 
-    // Set size of image.
-    output_image->setImageDimensions(dims);
-
     std::vector<float> vec;
 
     // Get bins from histogram in a 1-d vector.
-    m_hist.getImage(vec);
+    getCubeImage(hist, vec);
+
+    // A compressed image is written only once, as the extension after the primary, so the primary array is left empty.
+    if (!isImageCompressed()) {
+      // Set size of image.
+      output_image->setImageDimensions(dims);
 
-    // Write the output image in one fell swoop instead of iterating over each dimension separately.
-    output_image->set(vec);
+      // Write the output image in one fell swoop instead of iterating over each dimension separately.
+      output_image->set(vec);
+    }
 
     // Write the EBOUNDS extension.
     writeEbounds(out_file, m_ebounds);
 
     // Write the GTI extension.
     writeGti(out_file);
+
+    // Write the tile-compressed image, if requested.
+    writeCompressedImage(out_file, std::vector<long>(dims.begin(), dims.end()), vec);
   }
 
 }
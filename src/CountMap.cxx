@@ -17,6 +17,7 @@
 #include "evtbin/LinearBinner.h"
 #include "evtbin/Hist2D.h"
 #include "evtbin/CountMap.h"
+#include "evtbin/MappedEventTable.h"
 
 #include "st_facilities/Env.h"
 
@@ -29,20 +30,33 @@
 
 static const double pi = 3.14159265358979323846;
 
+namespace {
+  // Number of events projected and binned at a time.
+  const long s_batch_size = 4096;
+}
+
 namespace evtbin {
 
   CountMap::CountMap(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
     const std::string & sc_table, double ref_ra, double ref_dec, const std::string & proj,
     unsigned long num_x_pix, unsigned long num_y_pix, double pix_scale, double axis_rot, bool use_lb,
     const std::string & ra_field, const std::string & dec_field, const Gti & gti):
+    CountMap(event_file, event_table, sc_file, sc_table, ref_ra, ref_dec, proj, num_x_pix, num_y_pix, pix_scale, axis_rot,
+      use_lb, ra_field, dec_field, gti, true) {}
 
-    DataProduct(event_file, event_table, gti), m_hist(
+  CountMap::CountMap(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
+    const std::string & sc_table, double ref_ra, double ref_dec, const std::string & proj,
+    unsigned long num_x_pix, unsigned long num_y_pix, double pix_scale, double axis_rot, bool use_lb,
+    const std::string & ra_field, const std::string & dec_field, const Gti & gti, bool alloc_hist):
+
+    DataProduct(event_file, event_table, gti), m_coord(), m_hist(!alloc_hist ? 0 : new Hist2D(
       //LinearBinner(- (long)(num_x_pix) / 2., num_x_pix / 2., 1., ra_field),
       //LinearBinner(- (long)(num_y_pix) / 2., num_y_pix / 2., 1., dec_field)
       LinearBinner(0.5, num_x_pix + 0.5, 1., ra_field),
       LinearBinner(0.5, num_y_pix + 0.5, 1., dec_field)
-    ), m_proj_name(proj), m_crpix(), m_crval(), m_cdelt(), m_axis_rot(axis_rot), m_proj(0), m_use_lb(use_lb) {
-    m_hist_ptr = &m_hist;
+    )), m_type_hist(), m_selected(), m_proj_name(proj), m_crpix(), m_crval(), m_cdelt(), m_axis_rot(axis_rot), m_proj(0), m_use_lb(use_lb) {
+    m_hist_ptr = m_hist;
+    m_use_mapped_input = true;
 
     m_crpix[0] = (num_x_pix + 1.) / 2.;
     m_crpix[1] = (num_y_pix + 1.) / 2.;
@@ -83,7 +97,12 @@ namespace evtbin {
     adjustTimeKeywords(sc_file, sc_table);
   }
 
-  CountMap::~CountMap() throw() { delete m_proj; }
+  CountMap::~CountMap() throw() {
+    for (std::vector<Hist2D *>::reverse_iterator itor = m_type_hist.rbegin(); itor != m_type_hist.rend(); ++itor)
+      delete *itor;
+    delete m_proj;
+    delete m_hist;
+  }
 
   void CountMap::binInput() {
     DataProduct::binInput();
@@ -91,27 +110,120 @@ namespace evtbin {
 
   void CountMap::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end) {
     // Get binners for the two dimensions.
-    const Hist::BinnerCont_t & binners = m_hist.getBinners();
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
 
     // From each binner, get the name of its field, interpreted as ra and dec.
     std::string ra_field = binners[0]->getName();
     std::string dec_field = binners[1]->getName();
 
-    // Fill histogram, converting each RA/DEC to Sky X/Y on the fly:
+    // Fill histogram one batch of events at a time, converting each RA/DEC to Sky X/Y:
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    std::vector<unsigned long> event_type(s_batch_size);
+    long num_events = 0;
     for (tip::Table::ConstIterator itor = begin; itor != end; ++itor) {
       // Extract the ra and dec from each record.
-      double ra = (*itor)[ra_field].get();
-      double dec = (*itor)[dec_field].get();
+      ra[num_events] = (*itor)[ra_field].get();
+      dec[num_events] = (*itor)[dec_field].get();
+      if (!m_event_types.empty()) event_type[num_events] = readEventType(itor);
+      if (s_batch_size == ++num_events) {
+        fillBatch(&ra[0], &dec[0], &event_type[0], num_events);
+        num_events = 0;
+      }
+    }
+    fillBatch(&ra[0], &dec[0], &event_type[0], num_events);
+  }
 
-      // Convert to sky coordinates.
-      std::pair<double, double> coord = astro::SkyDir(ra, dec).project(*m_proj);
+  void CountMap::binInput(const MappedEventTable & table, long first_record, long last_record) {
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
+    std::string ra_field = binners[0]->getName();
+    std::string dec_field = binners[1]->getName();
+
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    std::vector<unsigned long> event_type(s_batch_size);
+    for (long batch_begin = first_record; batch_begin < last_record; batch_begin += s_batch_size) {
+      long num_events = std::min(s_batch_size, last_record - batch_begin);
+      table.readColumn(ra_field, batch_begin, num_events, &ra[0]);
+      table.readColumn(dec_field, batch_begin, num_events, &dec[0]);
+      if (!m_event_types.empty()) table.readBits(m_event_type_field, batch_begin, num_events, &event_type[0]);
+      fillBatch(&ra[0], &dec[0], &event_type[0], num_events);
+    }
+  }
 
-      // Bin the value.
-      m_hist.fillBin(coord.first, coord.second);
+  void CountMap::setEventTypes(const EventTypeCont_t & event_types, const std::string & field) {
+    // Create the new histograms with the bins of the current one before any histogram is deleted.
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
+    std::vector<Hist2D *> type_hist;
+    for (EventTypeCont_t::size_type index = 0; index != event_types.size(); ++index)
+      type_hist.push_back(new Hist2D(*binners[0], *binners[1]));
+    Hist2D * hist = event_types.empty() && 0 == m_hist ? new Hist2D(*binners[0], *binners[1]) : m_hist;
+
+    for (std::vector<Hist2D *>::reverse_iterator itor = m_type_hist.rbegin(); itor != m_type_hist.rend(); ++itor)
+      delete *itor;
+    m_type_hist.swap(type_hist);
+
+    // A split map bins events only into the map of each event type, so the full map is freed, and the map of the first
+    // event type stands in for it to describe the bins.
+    if (!event_types.empty()) {
+      delete hist;
+      hist = 0;
     }
+    m_hist = hist;
+    m_hist_ptr = event_types.empty() ? m_hist : m_type_hist.front();
+    m_event_types = event_types;
+    m_event_type_field = field;
+  }
+
+  void CountMap::project(const double * ra, const double * dec, long num_events) {
+    m_coord.resize(num_events);
+    for (long ii = 0; ii != num_events; ++ii) m_coord[ii] = astro::SkyDir(ra[ii], dec[ii]).project(*m_proj);
+  }
+
+  void CountMap::fillBatch(const double * ra, const double * dec, const unsigned long * event_type, long num_events) {
+    // Convert to sky coordinates.
+    project(ra, dec, num_events);
+
+    if (m_event_types.empty()) {
+      for (long ii = 0; ii != num_events; ++ii) m_hist->fillBin(m_coord[ii].first, m_coord[ii].second);
+      return;
+    }
+
+    // Bin each event into the histogram of every event type it belongs to.
+    m_selected.resize(num_events);
+    for (EventTypeCont_t::size_type index = 0; index != m_event_types.size(); ++index) {
+      if (0 == num_events) break;
+      selectEventType(event_type, num_events, m_event_types[index], &m_selected[0]);
+      Hist2D & hist = *m_type_hist[index];
+      for (long ii = 0; ii != num_events; ++ii) {
+        if (m_selected[ii]) hist.fillBin(m_coord[ii].first, m_coord[ii].second);
+      }
+    }
+  }
+
+  std::string CountMap::getSkyProjection() const {
+    std::ostringstream os;
+    os.precision(17);
+    os << m_proj_name << ' ' << m_crpix[0] << ' ' << m_crpix[1] << ' ' << m_crval[0] << ' ' << m_crval[1] << ' ' <<
+      m_cdelt[0] << ' ' << m_cdelt[1] << ' ' << m_axis_rot << ' ' << m_use_lb;
+    return os.str();
   }
 
   void CountMap::writeOutput(const std::string & creator, const std::string & out_file) const {
+    std::vector<float> image;
+    if (m_event_types.empty()) {
+      m_hist->getImage(image);
+      writeImage(creator, out_file, image, m_gti);
+    } else {
+      for (EventTypeCont_t::size_type index = 0; index != m_event_types.size(); ++index) {
+        m_type_hist[index]->getImage(image);
+        writeImage(creator, getEventTypeFileName(out_file, m_event_types[index]), image, m_gti);
+      }
+    }
+  }
+
+  void CountMap::writeImage(const std::string & creator, const std::string & out_file, const std::vector<float> & image,
+    const Gti & gti) const {
     // Standard file creation from base class.
     createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatCountMapTemplate"));
 
@@ -128,8 +240,40 @@ namespace evtbin {
     if (2 != num_dims) throw std::runtime_error("CountMap::writeOutput cannot write a count map to an image which is not 2D");
 
     // Get the binners.
-    const Hist::BinnerCont_t & binners = m_hist.getBinners();
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
+
+    // Write c* keywords
+    tip::Header & header = output_image->getHeader();
+    writeSkyKeywords(header);
+
+    // Write DSS keywords to preserve cut information.
+    writeDssKeywords(header);
 
+    // Write the history that came from the events extension.
+    writeHistory(*output_image, "EVENTS");
+
+    // Resize image dimensions to conform to the binner dimensions.
+    for (DimCont_t::size_type index = 0; index != num_dims; ++index) {
+      dims[index] = binners.at(index)->getNumBins();
+    }
+
+    // A compressed image is written only once, as the extension after the primary, so the primary array is left empty.
+    if (!isImageCompressed()) {
+      // Set size of image.
+      output_image->setImageDimensions(dims);
+
+      // Write the output image in one fell swoop instead of iterating over each dimension separately.
+      output_image->set(image);
+    }
+
+    // Write the GTI extension.
+    writeGti(out_file, gti);
+
+    // Write the tile-compressed image, if requested.
+    writeCompressedImage(out_file, std::vector<long>(dims.begin(), dims.end()), image);
+  }
+
+  void CountMap::writeSkyKeywords(tip::Header & header) const {
     // Compute settings for CTYPE keywords.
     std::string ctype1;
     std::string ctype2;
@@ -151,8 +295,6 @@ namespace evtbin {
     ctype1 += os.str();
     ctype2 += os.str();
 
-    // Write c* keywords
-    tip::Header & header = output_image->getHeader();
     header["CRPIX1"].set(m_crpix[0]);
     header["CRPIX2"].set(m_crpix[1]);
     header["CRVAL1"].set(m_crval[0]);
@@ -162,31 +304,6 @@ namespace evtbin {
     header["CROTA2"].set(m_axis_rot);
     header["CTYPE1"].set(ctype1);
     header["CTYPE2"].set(ctype2);
-
-    // Write DSS keywords to preserve cut information.
-    writeDssKeywords(header);
-
-    // Write the history that came from the events extension.
-    writeHistory(*output_image, "EVENTS");
-
-    // Resize image dimensions to conform to the binner dimensions.
-    for (DimCont_t::size_type index = 0; index != num_dims; ++index) {
-      dims[index] = binners.at(index)->getNumBins();
-    }
-
-    // Set size of image.
-    output_image->setImageDimensions(dims);
-
-    std::vector<float> vec;
-
-    // Get bins from histogram in a 1-d vector.
-    m_hist.getImage(vec);
-
-    // Write the output image in one fell swoop instead of iterating over each dimension separately.
-    output_image->set(vec);
-
-    // Write the GTI extension.
-    writeGti(out_file);
   }
 
 }
@@ -0,0 +1,288 @@
+/** \file CountMapStack.cxx
+    \brief Encapsulation of a stack of count maps over consecutive time windows, with methods to read/write using tip.
+*/
+#include <algorithm>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "evtbin/Binner.h"
+#include "evtbin/CountMapStack.h"
+#include "evtbin/LinearBinner.h"
+#include "evtbin/MappedEventTable.h"
+
+#include "facilities/commonUtilities.h"
+
+#include "tip/IFileSvc.h"
+#include "tip/Image.h"
+#include "tip/Table.h"
+#include "tip/tip_types.h"
+
+#include "fitsio.h"
+
+namespace {
+  // Number of events projected and binned at a time.
+  const long s_batch_size = 4096;
+}
+
+namespace evtbin {
+
+  CountMapStack::CountMapStack(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
+    const std::string & sc_table, double ref_ra, double ref_dec, const std::string & proj,
+    unsigned long num_x_pix, unsigned long num_y_pix, double pix_scale, double axis_rot, bool use_lb,
+    const std::string & ra_field, const std::string & dec_field, const Binner & time_binner, const Gti & gti):
+    CountMap(event_file, event_table, sc_file, sc_table, ref_ra, ref_dec, proj, num_x_pix, num_y_pix, pix_scale, axis_rot,
+      use_lb, ra_field, dec_field, gti, false),
+    m_stack_hist(LinearBinner(0.5, num_x_pix + 0.5, 1., ra_field), LinearBinner(0.5, num_y_pix + 0.5, 1., dec_field),
+      time_binner), m_time_index(), m_sc_file(sc_file), m_sc_table(sc_table), m_window_images(false) {
+    m_hist_ptr = &m_stack_hist;
+
+    // Adjust the GTI based on binning information.
+    adjustGti(&time_binner);
+
+    // Only events inside the range of the time binner need to be read.
+    if (0 < time_binner.getNumBins())
+      setTimeWindow(time_binner.getName(), time_binner.getDomain().begin(), time_binner.getDomain().end());
+
+    // Update tstart/tstop etc.
+    adjustTimeKeywords(sc_file, sc_table, &time_binner);
+  }
+
+  CountMapStack::~CountMapStack() throw() {}
+
+  const Binner * CountMapStack::getTimeBinner() const { return m_stack_hist.getBinners().at(2); }
+
+  void CountMapStack::binInput() {
+    DataProduct::binInput();
+  }
+
+  void CountMapStack::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end) {
+    // From each binner, get the name of its field, interpreted as ra, dec and time.
+    const Hist::BinnerCont_t & binners = m_stack_hist.getBinners();
+    std::string ra_field = binners[0]->getName();
+    std::string dec_field = binners[1]->getName();
+    std::string time_field = binners[2]->getName();
+
+    // Fill histogram one batch of events at a time.
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    std::vector<double> time(s_batch_size);
+    long num_events = 0;
+    for (tip::Table::ConstIterator itor = begin; itor != end; ++itor) {
+      ra[num_events] = (*itor)[ra_field].get();
+      dec[num_events] = (*itor)[dec_field].get();
+      time[num_events] = (*itor)[time_field].get();
+      if (s_batch_size == ++num_events) {
+        fillBatch(&ra[0], &dec[0], &time[0], num_events);
+        num_events = 0;
+      }
+    }
+    fillBatch(&ra[0], &dec[0], &time[0], num_events);
+  }
+
+  void CountMapStack::binInput(const MappedEventTable & table, long first_record, long last_record) {
+    const Hist::BinnerCont_t & binners = m_stack_hist.getBinners();
+    std::string ra_field = binners[0]->getName();
+    std::string dec_field = binners[1]->getName();
+    std::string time_field = binners[2]->getName();
+
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    std::vector<double> time(s_batch_size);
+    for (long batch_begin = first_record; batch_begin < last_record; batch_begin += s_batch_size) {
+      long num_events = std::min(s_batch_size, last_record - batch_begin);
+      table.readColumn(ra_field, batch_begin, num_events, &ra[0]);
+      table.readColumn(dec_field, batch_begin, num_events, &dec[0]);
+      table.readColumn(time_field, batch_begin, num_events, &time[0]);
+      fillBatch(&ra[0], &dec[0], &time[0], num_events);
+    }
+  }
+
+  void CountMapStack::setEventTypes(const EventTypeCont_t & event_types, const std::string & field) {
+    DataProduct::setEventTypes(event_types, field);
+  }
+
+  void CountMapStack::setWindowImages(bool window_images) { m_window_images = window_images; }
+
+  std::string CountMapStack::getWindowFileName(const std::string & out_file, long index) const {
+    // Pad the window number so that the files sort in time order.
+    long num_windows = m_stack_hist.getBinners().at(2)->getNumBins();
+    int width = 1;
+    for (long last = num_windows - 1; last >= 10; last /= 10) ++width;
+
+    std::ostringstream os;
+    os << "_win";
+    os.fill('0');
+    os.width(width);
+    os << index;
+    return insertFileNameSuffix(out_file, os.str());
+  }
+
+  void CountMapStack::fillBatch(double * ra, double * dec, const double * time, long num_events) {
+    // Find the time window of each event.
+    if (0 >= num_events) return;
+    m_time_index.resize(num_events);
+    m_stack_hist.getBinners()[2]->computeIndices(time, num_events, &m_time_index[0]);
+
+    // Move the events inside a time window to the front of the batch, with their windows, so that only they are projected.
+    long num_selected = 0;
+    for (long ii = 0; ii != num_events; ++ii) {
+      if (0 <= m_time_index[ii]) {
+        ra[num_selected] = ra[ii];
+        dec[num_selected] = dec[ii];
+        m_time_index[num_selected] = m_time_index[ii];
+        ++num_selected;
+      }
+    }
+
+    // Convert to sky coordinates and bin.
+    project(ra, dec, num_selected);
+    for (long ii = 0; ii != num_selected; ++ii)
+      m_stack_hist.fillPlaneBin(m_time_index[ii], m_coord[ii].first, m_coord[ii].second);
+  }
+
+  void CountMapStack::writeOutput(const std::string & creator, const std::string & out_file) const {
+    if (m_window_images) writeWindowImages(creator, out_file);
+    else writeCube(creator, out_file);
+  }
+
+  void CountMapStack::writeCube(const std::string & creator, const std::string & out_file) const {
+    // Standard file creation from base class.
+    createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatCountMapStackTemplate"));
+
+    // Open the primary image of the output file.
+    std::unique_ptr<tip::Image> output_image(tip::IFileSvc::instance().editImage(out_file, ""));
+
+    // Get dimensions of image.
+    typedef std::vector<tip::PixOrd_t> DimCont_t;
+    DimCont_t dims = output_image->getImageDimensions();
+
+    // Make sure image is three dimensional.
+    DimCont_t::size_type num_dims = dims.size();
+    if (3 != num_dims)
+      throw std::runtime_error("CountMapStack::writeOutput cannot write a count map stack to an image which is not 3D");
+
+    // Get the binners.
+    const Hist::BinnerCont_t & binners = m_stack_hist.getBinners();
+    const Binner * time_binner = binners.at(2);
+
+    // Write c* keywords. The time axis is described by its first window; the WINDOWS extension gives every window.
+    tip::Header & header = output_image->getHeader();
+    writeSkyKeywords(header);
+    Binner::Interval first_int = time_binner->getInterval(0);
+    header["CRPIX3"].set(1);
+    header["CRVAL3"].set(first_int.midpoint());
+    header["CDELT3"].set(first_int.width());
+    header["CTYPE3"].set("Time");
+
+    // Write DSS keywords to preserve cut information.
+    writeDssKeywords(header);
+
+    // Write the history that came from the events extension.
+    writeHistory(*output_image, "EVENTS");
+
+    // Resize image dimensions to conform to the binner dimensions.
+    for (DimCont_t::size_type index = 0; index != num_dims; ++index) {
+      dims[index] = binners.at(index)->getNumBins();
+    }
+
+    // A compressed image is written only once, as the extension after the primary, so the primary array is left empty.
+    // Otherwise set size of image. Its planes are filled in at the end, one at a time.
+    if (!isImageCompressed()) output_image->setImageDimensions(dims);
+    output_image.reset();
+
+    // Write the time window, ontime and exposure of each plane.
+    std::vector<double> ontime;
+    std::vector<double> exposure;
+    computeBinExposure(m_sc_file, m_sc_table, *time_binner, ontime, exposure);
+
+    std::unique_ptr<tip::Table> windows_table(tip::IFileSvc::instance().editTable(out_file, "WINDOWS"));
+    windows_table->setNumRecords(time_binner->getNumBins());
+    tip::Table::Iterator table_itor = windows_table->begin();
+    for (long index = 0; index != time_binner->getNumBins(); ++index, ++table_itor) {
+      Binner::Interval interval = time_binner->getInterval(index);
+      (*table_itor)["START"].set(interval.begin());
+      (*table_itor)["STOP"].set(interval.end());
+      (*table_itor)["ONTIME"].set(ontime[index]);
+      (*table_itor)["EXPOSURE"].set(exposure[index]);
+    }
+
+    // Write the GTI extension.
+    writeGti(out_file);
+
+    // Write the tile-compressed image, if requested, then fill in the planes.
+    writeCompressedImage(out_file, std::vector<long>(dims.begin(), dims.end()), std::vector<float>());
+    writePlanes(out_file);
+  }
+
+  void CountMapStack::writePlanes(const std::string & out_file) const {
+    int status = 0;
+    fitsfile * fp = 0;
+    fits_open_file(&fp, out_file.c_str(), READWRITE, &status);
+    checkFitsStatus(status, "CountMapStack::writePlanes cannot open " + out_file);
+
+    // The image is the primary array, or the named extension if it is compressed.
+    if (isImageCompressed()) {
+      std::string ext_name = getCompressedImageName();
+      fits_movnam_hdu(fp, ANY_HDU, const_cast<char *>(ext_name.c_str()), 0, &status);
+    } else {
+      fits_movabs_hdu(fp, 1, 0, &status);
+    }
+
+    // Expand one plane at a time, so that the whole stack is never held as an image.
+    const Hist::BinnerCont_t & binners = m_stack_hist.getBinners();
+    long plane_size = binners[0]->getNumBins() * binners[1]->getNumBins();
+    std::vector<float> image;
+    for (long index = 0; index != binners[2]->getNumBins() && 0 == status; ++index) {
+      m_stack_hist.getPlaneImage(index, image);
+      if (!image.empty()) fits_write_img(fp, TFLOAT, index * plane_size + 1, plane_size, &image[0], &status);
+    }
+
+    // Close the file regardless of errors, reporting the first error.
+    int close_status = 0;
+    fits_close_file(fp, &close_status);
+    if (0 == status) status = close_status;
+    checkFitsStatus(status, "CountMapStack::writePlanes failed to write the image of " + out_file);
+  }
+
+  void CountMapStack::writeWindowImages(const std::string & creator, const std::string & out_file) const {
+    const Binner & time_binner = *m_stack_hist.getBinners().at(2);
+
+    // Ontime and exposure of every window, found in one pass through the spacecraft data.
+    std::vector<double> ontime;
+    std::vector<double> exposure;
+    computeBinExposure(m_sc_file, m_sc_table, time_binner, ontime, exposure);
+
+    // The keywords of the whole stack are replaced by those of each window in turn, and restored afterwards.
+    finishExposure();
+    KeyValuePairCont_t key_value_pairs(m_key_value_pairs);
+    try {
+      std::vector<float> image;
+      for (long index = 0; index != time_binner.getNumBins(); ++index) {
+        // The GTI of each window is its overlap with the GTI of the stack. The bins of a folding binner are not
+        // times, so each of its windows has the whole GTI.
+        Gti gti(m_gti);
+        if (!time_binner.isFolded()) {
+          Binner::Interval interval = time_binner.getInterval(index);
+          Gti window;
+          window.insertInterval(interval.begin(), interval.end());
+          gti = m_gti & window;
+          updateKeyValue("TSTART", interval.begin());
+          updateKeyValue("TSTOP", interval.end());
+        }
+        updateKeyValue("ONTIME", ontime[index], "Sum of all Good Time Intervals");
+        updateKeyValue("EXPOSURE", exposure[index], "Integration time (in seconds) for the PHA data");
+
+        m_stack_hist.getPlaneImage(index, image);
+        writeImage(creator, getWindowFileName(out_file, index), image, gti);
+      }
+    } catch (...) {
+      m_key_value_pairs = key_value_pairs;
+      throw;
+    }
+    m_key_value_pairs = key_value_pairs;
+  }
+
+}
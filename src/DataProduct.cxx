@@ -8,9 +8,11 @@
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <iterator>
 #include <limits>
 #include <list>
 #include <memory>
+#include <mutex>
 #include <numeric>
 #include <stdexcept>
 #include <sstream>
@@ -22,16 +24,19 @@
 #include "evtbin/Hist.h"
 #include "evtbin/Hist1D.h"
 #include "evtbin/Hist2D.h"
+#include "evtbin/MappedEventTable.h"
 #include "evtbin/RecordBinFiller.h"
 #include "st_facilities/Env.h"
 #include "st_facilities/FileSys.h"
 #include "tip/Extension.h"
 #include "tip/FileSummary.h"
 #include "tip/Header.h"
+#include "tip/IColumn.h"
 #include "tip/IFileSvc.h"
 #include "tip/KeyRecord.h"
 #include "tip/Table.h"
 #include "facilities/commonUtilities.h"
+#include "fitsio.h"
 
 namespace {
 
@@ -89,13 +94,166 @@ namespace {
       tip::Index_t m_num_rec;
   };
 
+  // Number of rows sampled when testing whether an input table is ordered by time.
+  const long s_num_sort_samples = 64;
+
+  // Number of rows on either side of a time window which are checked to be outside the window.
+  const long s_num_edge_rows = 64;
+
+  // Number of rows decoded at once from a memory mapped table.
+  const long s_batch_size = 8192;
+
+  // Serializes binning through tip, which is not reentrant, when several products are binned concurrently.
+  std::mutex s_tip_mutex;
+
+  // Adapter giving a field of a mapped table the same interface as a tip::IColumn.
+  class MappedColumn {
+    public:
+      MappedColumn(const evtbin::MappedEventTable & table, const std::string & field_name): m_table(table),
+        m_field_name(field_name) {}
+
+      void get(long record, double & dest) const { dest = m_table.readValue(m_field_name, record); }
+
+    private:
+      const evtbin::MappedEventTable & m_table;
+      std::string m_field_name;
+  };
+
+  // Task which computes the exposure of a data product on another thread. The spacecraft data are read with tip, so this
+  // holds the tip lock.
+  class ExposureTask {
+    public:
+      ExposureTask(const evtbin::DataProduct & product, const std::string & sc_file, const std::string & sc_table):
+        m_product(product), m_sc_file(sc_file), m_sc_table(sc_table) {}
+
+      double operator ()() const {
+        std::lock_guard<std::mutex> lock(s_tip_mutex);
+        return m_product.computeExposure(m_sc_file, m_sc_table);
+      }
+
+    private:
+      const evtbin::DataProduct & m_product;
+      std::string m_sc_file;
+      std::string m_sc_table;
+  };
+
+  // The part of a time bin inside one good time interval.
+  struct BinSegment {
+    BinSegment(long index, double start, double stop): m_index(index), m_start(start), m_stop(stop) {}
+
+    bool operator <(const BinSegment & segment) const { return m_start < segment.m_start; }
+
+    long m_index;
+    double m_start;
+    double m_stop;
+  };
+
+  // Orders bin numbers by the beginning of their bins.
+  class BinBeginLess {
+    public:
+      BinBeginLess(const evtbin::Binner & binner): m_binner(binner) {}
+
+      bool operator ()(long index1, long index2) const {
+        return m_binner.getInterval(index1).begin() < m_binner.getInterval(index2).begin();
+      }
+
+    private:
+      const evtbin::Binner & m_binner;
+  };
+
+  // Check whether the given column appears to be non-decreasing by sampling evenly spaced rows.
+  template <typename Column, typename Index>
+  bool isSorted(const Column & column, Index num_rec) {
+    if (2 > num_rec) return true;
+    Index num_samples = std::min<Index>(num_rec, s_num_sort_samples);
+    double previous = 0.;
+    column.get(0, previous);
+    for (Index sample = 1; sample != num_samples; ++sample) {
+      Index row = (num_rec - 1) * sample / (num_samples - 1);
+      double current = 0.;
+      column.get(row, current);
+      if (current < previous) return false;
+      previous = current;
+    }
+    return true;
+  }
+
+  // Return the index of the first row in [first, last) whose value is >= value (inclusive = false) or > value
+  // (inclusive = true). The column must be sorted.
+  template <typename Column, typename Index>
+  Index bisect(const Column & column, Index first, Index last, double value, bool inclusive) {
+    while (first < last) {
+      Index middle = first + (last - first) / 2;
+      double current = 0.;
+      column.get(middle, current);
+      if (current < value || (inclusive && current == value)) first = middle + 1;
+      else last = middle;
+    }
+    return first;
+  }
+
+  // Find the rows [first, last) of a table ordered by time which fall in the (inclusive) window [begin, end]. Returns
+  // false, leaving first and last unchanged, if the table cannot be shown to be ordered, so that it must be scanned
+  // in full.
+  template <typename Column, typename Index>
+  bool findWindow(const Column & column, Index num_rec, double begin, double end, Index & first, Index & last) {
+    // Bisection is only valid for a table which is ordered by time.
+    if (!isSorted(column, num_rec)) return false;
+
+    // Find the first row at or after the beginning of the window, and the first row past the end of the window.
+    // The end of the window is inclusive, because some binners (e.g. ConstSnBinner) use (] intervals.
+    Index new_first = bisect(column, Index(0), num_rec, begin, false);
+    Index new_last = bisect(column, new_first, num_rec, end, true);
+
+    // Sampling misses tables which are only ordered piecewise, e.g. those concatenated from several files, so the rows
+    // just before and just after the window must be outside it. Otherwise events would be dropped silently.
+    double value = 0.;
+    for (Index row = new_first; 0 < row && new_first - row < s_num_edge_rows; --row) {
+      column.get(row - 1, value);
+      if (!(value < begin)) return false;
+    }
+    for (Index row = new_last; num_rec > row && row - new_last < s_num_edge_rows; ++row) {
+      column.get(row, value);
+      if (!(value > end)) return false;
+    }
+
+    first = new_first;
+    last = new_last;
+    return true;
+  }
+
+  // Read the non-structural keywords of the current HDU into the given container of header cards, then delete its world
+  // coordinate keywords, which describe an image the HDU will no longer hold.
+  void moveKeywords(fitsfile * fp, std::vector<std::string> & card_cont, int & status) {
+    int num_keys = 0;
+    fits_get_hdrspace(fp, &num_keys, 0, &status);
+    for (int key_num = num_keys; key_num > 0 && 0 == status; --key_num) {
+      char card[FLEN_CARD] = "";
+      fits_read_record(fp, key_num, card, &status);
+      int key_class = fits_get_keyclass(card);
+      // Structure, compression, scaling and checksum keywords describe the uncompressed image, not the compressed one.
+      if (TYP_STRUC_KEY == key_class || TYP_CMPRS_KEY == key_class || TYP_SCAL_KEY == key_class ||
+        TYP_NULL_KEY == key_class || TYP_DIM_KEY == key_class || TYP_CKSUM_KEY == key_class) continue;
+      card_cont.insert(card_cont.begin(), card);
+      if (TYP_WCS_KEY == key_class) fits_delete_record(fp, key_num, &status);
+    }
+  }
+
+  // Return true if the named keyword describes the time span of a data product, which depends on its own bins and GTI.
+  bool isTimeKeyword(const std::string & name) {
+    return "TSTART" == name || "TSTOP" == name || "DATE-OBS" == name || "DATE-END" == name || "ONTIME" == name ||
+      "EXPOSURE" == name;
+  }
+
 }
 
 namespace evtbin {
 
   DataProduct::DataProduct(const std::string & event_file, const std::string & event_table, const Gti & gti):
     m_os("DataProduct", "DataProduct", 2), m_key_value_pairs(), m_history(), m_known_keys(), m_dss_keys(), m_event_file_cont(),
-    m_data_dir(), m_event_file(event_file), m_event_table(event_table), m_creator(), m_gti(gti), m_hist_ptr(0), m_default_keys() {
+    m_data_dir(), m_event_file(event_file), m_event_table(event_table), m_creator(), m_gti(gti), m_hist_ptr(0), m_default_keys(),
+    m_time_field(), m_time_begin(0.), m_time_end(0.), m_use_mapped_input(false), m_image_compression("NONE"),
+    m_event_type_field(), m_event_types(), m_exposure_sc_file(), m_exposure_sc_table(), m_exposure_pending(false), m_exposure() {
     using namespace st_facilities;
 
     // Find the directory containing templates.
@@ -139,9 +297,49 @@ namespace evtbin {
 
   void DataProduct::binInput() {
     using namespace tip;
+
+    // Scan the spacecraft data for the exposure while the events are being binned.
+    startExposure();
+
     for (FileNameCont_t::iterator itor = m_event_file_cont.begin(); itor != m_event_file_cont.end(); ++itor) {
+      // Read plain local files directly through a memory mapping if possible.
+      std::unique_ptr<const MappedEventTable> mapped;
+      if (m_use_mapped_input && MappedEventTable::isMappable(*itor)) {
+        try {
+          mapped.reset(new MappedEventTable(*itor, m_event_table));
+          // Products binning through the generic histogram need every binned field to be readable.
+          const Hist::BinnerCont_t & binners = 0 != m_hist_ptr ? m_hist_ptr->getBinners() : Hist::BinnerCont_t();
+          for (Hist::BinnerCont_t::const_iterator b_itor = binners.begin(); b_itor != binners.end(); ++b_itor) {
+            if (!mapped->hasField((*b_itor)->getName())) {
+              mapped.reset();
+              break;
+            }
+          }
+          // So does the event type field of a product which is split by event type.
+          if (0 != mapped.get() && !m_event_types.empty() && !mapped->hasBitField(m_event_type_field)) mapped.reset();
+        } catch (const std::exception &) {
+          // Fall back on tip.
+          mapped.reset();
+        }
+      }
+
+      if (0 != mapped.get()) {
+        long first_record = 0;
+        long last_record = mapped->getNumRecords();
+        seekTimeWindow(*mapped, first_record, last_record);
+        binInput(*mapped, first_record, last_record);
+        continue;
+      }
+
+      std::lock_guard<std::mutex> lock(s_tip_mutex);
       std::unique_ptr<const Table> events(IFileSvc::instance().readTable(*itor, m_event_table));
-      binInput(events->begin(), events->end());
+      Table::ConstIterator begin = events->begin();
+      Table::ConstIterator end = events->end();
+
+      // Skip rows outside the time window, if possible.
+      seekTimeWindow(*events, begin, end);
+
+      binInput(begin, end);
     }
   }
 
@@ -151,7 +349,118 @@ namespace evtbin {
     std::for_each(begin, end, RecordBinFiller(*m_hist_ptr));
   }
 
+  void DataProduct::binInput(const MappedEventTable & table, long first_record, long last_record) {
+    if (0 == m_hist_ptr) throw std::logic_error("DataProduct::binInput cannot bin a NULL histogram");
+    const Hist::BinnerCont_t & binners = m_hist_ptr->getBinners();
+
+    // Decode one batch of each binned column at a time, then fill the histogram from the batch.
+    std::vector<std::vector<double> > batch(binners.size(), std::vector<double>(s_batch_size));
+    std::vector<const double *> columns(binners.size());
+    for (Hist::BinnerCont_t::size_type ii = 0; ii != binners.size(); ++ii) columns[ii] = &batch[ii][0];
+    for (long batch_begin = first_record; batch_begin < last_record; batch_begin += s_batch_size) {
+      long num_records = std::min(s_batch_size, last_record - batch_begin);
+      for (Hist::BinnerCont_t::size_type ii = 0; ii != binners.size(); ++ii)
+        table.readColumn(binners[ii]->getName(), batch_begin, num_records, &batch[ii][0]);
+
+      m_hist_ptr->fillBins(columns, num_records);
+    }
+  }
+
+  void DataProduct::rebin(const DataProduct & master) {
+    if (0 == m_hist_ptr || 0 == master.m_hist_ptr) throw std::logic_error("DataProduct::rebin cannot rebin a NULL histogram");
+
+    // The histogram of a product split by event type describes only the bins, not the counts.
+    if (!m_event_types.empty() || !master.m_event_types.empty())
+      throw std::logic_error("DataProduct::rebin cannot rebin a data product which is split by event type");
+
+    // Spatial bins are pixels of a projection, which only line up if both products use the same projection.
+    if (getSkyProjection() != master.getSkyProjection())
+      throw std::runtime_error("DataProduct::rebin: master data product does not have the same sky projection");
+
+    m_hist_ptr->addRebinned(*master.m_hist_ptr);
+
+    // Carry the master's keywords forward, except those describing the time span, which are this product's own.
+    master.finishExposure();
+    for (KeyValuePairCont_t::const_iterator itor = master.m_key_value_pairs.begin(); itor != master.m_key_value_pairs.end();
+      ++itor) {
+      if (!itor->second.empty() && !isTimeKeyword(itor->first)) m_key_value_pairs[itor->first] = itor->second;
+    }
+
+    // Only the master's good time was binned.
+    m_gti = m_gti & master.m_gti;
+    bool gti_changed = m_gti != master.m_gti;
+
+    // Recompute TSTART, TSTOP and ONTIME from this product's own bins and GTI, using the master's spacecraft data.
+    m_exposure = std::future<double>();
+    adjustTimeKeywords(master.m_exposure_sc_file, master.m_exposure_sc_table, getTimeBinner());
+
+    if (!gti_changed) {
+      // Same good time as the master, so its EXPOSURE carries forward without another pass through the spacecraft data.
+      m_exposure_pending = false;
+      KeyValuePairCont_t::const_iterator found = master.m_key_value_pairs.find("EXPOSURE");
+      if (master.m_key_value_pairs.end() != found && !found->second.empty()) m_key_value_pairs["EXPOSURE"] = found->second;
+    }
+  }
+
+  std::string DataProduct::getSkyProjection() const { return std::string(); }
+
+  const Binner * DataProduct::getTimeBinner() const { return 0; }
+
+  void DataProduct::startExposure() const {
+    if (!m_exposure_pending || m_exposure.valid()) return;
+    m_exposure = std::async(std::launch::async, ExposureTask(*this, m_exposure_sc_file, m_exposure_sc_table));
+  }
+
+  void DataProduct::finishExposure() const {
+    if (!m_exposure_pending) return;
+    double exposure = m_exposure.valid() ? m_exposure.get() : computeExposure(m_exposure_sc_file, m_exposure_sc_table);
+    m_exposure_pending = false;
+    updateKeyValue("EXPOSURE", exposure, "Integration time (in seconds) for the PHA data");
+  }
+
+  void DataProduct::setTimeWindow(const std::string & field, double begin, double end) {
+    m_time_field = field;
+    m_time_begin = begin;
+    m_time_end = end;
+  }
+
+  void DataProduct::seekTimeWindow(const tip::Table & table, tip::Table::ConstIterator & begin,
+    tip::Table::ConstIterator & end) const {
+    // Nothing to do if no window was set.
+    if (m_time_field.empty() || !(m_time_begin <= m_time_end)) return;
+
+    // Window only applies if the table actually has the time field.
+    const tip::IColumn * column_ptr = 0;
+    try {
+      column_ptr = table.getColumn(table.getFieldIndex(m_time_field));
+    } catch (...) {
+      return;
+    }
+    const tip::IColumn & column = *column_ptr;
+    tip::Index_t first = 0;
+    tip::Index_t last = 0;
+    if (!findWindow(column, tip::Index_t(table.getNumRecords()), m_time_begin, m_time_end, first, last)) return;
+
+    tip::Table::ConstIterator new_begin = table.begin();
+    std::advance(new_begin, first);
+    tip::Table::ConstIterator new_end = new_begin;
+    std::advance(new_end, last - first);
+
+    begin = new_begin;
+    end = new_end;
+  }
+
+  void DataProduct::seekTimeWindow(const MappedEventTable & table, long & first_record, long & last_record) const {
+    if (m_time_field.empty() || !(m_time_begin <= m_time_end) || !table.hasField(m_time_field)) return;
+
+    MappedColumn column(table, m_time_field);
+    findWindow(column, table.getNumRecords(), m_time_begin, m_time_end, first_record, last_record);
+  }
+
   void DataProduct::createFile(const std::string & creator, const std::string & out_file, const std::string & fits_template) const {
+    // The exposure computation must be done with tip before the output is created.
+    finishExposure();
+
     // Create light curve file using template from the data directory.
     tip::IFileSvc::instance().createFile(out_file, fits_template);
 
@@ -185,13 +494,17 @@ namespace evtbin {
   }
 
   void DataProduct::writeGti(const std::string & out_file) const {
+    writeGti(out_file, m_gti);
+  }
+
+  void DataProduct::writeGti(const std::string & out_file, const Gti & gti) const {
     std::unique_ptr<tip::Table> gti_table(tip::IFileSvc::instance().editTable(out_file, "GTI"));
 
     // Resize Gti extension to match gti data.
-    gti_table->setNumRecords(m_gti.getNumIntervals());
+    gti_table->setNumRecords(gti.getNumIntervals());
 
     // Start at beginning of the data.
-    Gti::ConstIterator itor = m_gti.begin();
+    Gti::ConstIterator itor = gti.begin();
 
     // Write the gti structure to the table.
     for (tip::Table::Iterator table_itor = gti_table->begin(); table_itor != gti_table->end(); ++table_itor, ++itor) {
@@ -217,23 +530,32 @@ namespace evtbin {
   const Gti & DataProduct::getGti() const { return m_gti; }
 
   const Hist1D & DataProduct::getHist1D() const {
+    if (!m_event_types.empty()) throw std::logic_error("DataProduct::getHist1D: data product is split by event type");
     const Hist1D * hist = dynamic_cast<const Hist1D *>(m_hist_ptr);
     if (0 == hist) throw std::logic_error("DataProduct::getHist1D: not a 1 dimensional histogram");
     return *hist;
   }
 
   const Hist2D & DataProduct::getHist2D() const {
+    if (!m_event_types.empty()) throw std::logic_error("DataProduct::getHist2D: data product is split by event type");
     const Hist2D * hist = dynamic_cast<const Hist2D *>(m_hist_ptr);
     if (0 == hist) throw std::logic_error("DataProduct::getHist2D: not a 2 dimensional histogram");
     return *hist;
   }
 
+  const Hist & DataProduct::getHist() const {
+    if (!m_event_types.empty()) throw std::logic_error("DataProduct::getHist: data product is split by event type");
+    if (0 == m_hist_ptr) throw std::logic_error("DataProduct::getHist: no histogram");
+    return *m_hist_ptr;
+  }
+
   bool DataProduct::adjustGti(const Binner * binner) {
-    // Get number of bins.
-    long num_bins = binner->getNumBins();
+    // Get number of bins. The bins of a folding binner are not times, so only its domain is used.
+    long num_bins = binner->isFolded() ? 0 : binner->getNumBins();
 
     // Create a fake GTI-like object.
     Gti fake_gti;
+    if (binner->isFolded()) fake_gti.insertInterval(binner->getDomain().begin(), binner->getDomain().end());
 
     // Convert bins from binner into the new Gti.
     for (long ii = 0; ii < num_bins; ++ii) {
@@ -280,6 +602,130 @@ namespace evtbin {
     }
   }
 
+  void DataProduct::setEventTypes(const EventTypeCont_t &, const std::string &) {
+    throw std::logic_error("DataProduct::setEventTypes: this data product cannot be split by event type");
+  }
+
+  const DataProduct::EventTypeCont_t & DataProduct::getEventTypes() const { return m_event_types; }
+
+  std::string DataProduct::getEventTypeFileName(const std::string & out_file, unsigned long event_type) const {
+    std::ostringstream os;
+    os << "_evtype" << event_type;
+    return insertFileNameSuffix(out_file, os.str());
+  }
+
+  std::string DataProduct::insertFileNameSuffix(const std::string & file_name, const std::string & suffix) {
+    std::string::size_type slash = file_name.find_last_of('/');
+    std::string::size_type dot = file_name.find_last_of('.');
+    if (std::string::npos == dot || (std::string::npos != slash && dot < slash)) return file_name + suffix;
+    return file_name.substr(0, dot) + suffix + file_name.substr(dot);
+  }
+
+  void DataProduct::selectEventType(const unsigned long * event_type, long num_events, unsigned long mask,
+    unsigned char * selected) {
+    for (long index = 0; index < num_events; ++index) selected[index] = 0 != (event_type[index] & mask);
+  }
+
+  unsigned long DataProduct::readEventType(tip::Table::ConstIterator & record) const {
+    // A scalar field holds the event type as an integer, which MappedEventTable::readBits also uses as is.
+    if (1 == (*record)[m_event_type_field].getNumElements()) {
+      double event_type = 0.;
+      (*record)[m_event_type_field].get(event_type);
+      return static_cast<unsigned long>(event_type);
+    }
+
+    // A bit array field is packed with its last bit least significant.
+    std::vector<bool> bits;
+    (*record)[m_event_type_field].get(bits);
+    unsigned long event_type = 0;
+    for (std::vector<bool>::const_iterator itor = bits.begin(); itor != bits.end(); ++itor) event_type = (event_type << 1) | *itor;
+    return event_type;
+  }
+
+  void DataProduct::setImageCompression(const std::string & compression) {
+    std::string value(compression);
+    for (std::string::iterator itor = value.begin(); itor != value.end(); ++itor) *itor = toupper(*itor);
+    if ("NONE" != value && "RICE" != value && "GZIP" != value)
+      throw std::logic_error("DataProduct::setImageCompression does not understand compression \"" + compression + "\"");
+    m_image_compression = value;
+  }
+
+  bool DataProduct::isImageCompressed() const {
+    return "NONE" != m_image_compression;
+  }
+
+  std::string DataProduct::getCompressedImageName() { return "COUNTS"; }
+
+  void DataProduct::writeCompressedImage(const std::string & out_file, const std::vector<long> & dims,
+    const std::vector<float> & image) const {
+    if (!isImageCompressed()) return;
+    if (1 > dims.size() || 3 < dims.size())
+      throw std::logic_error("DataProduct::writeCompressedImage can only compress images with 1, 2 or 3 dimensions");
+
+    int status = 0;
+    fitsfile * fp = 0;
+    fits_open_file(&fp, out_file.c_str(), READWRITE, &status);
+    checkFitsStatus(status, "DataProduct::writeCompressedImage cannot open " + out_file);
+
+    // Empty the primary array, keeping its keywords for the compressed image.
+    std::vector<std::string> card_cont;
+    moveKeywords(fp, card_cont, status);
+    fits_resize_img(fp, LONG_IMG, 0, 0, &status);
+
+    // cfitsio only appends compressed images, but readers expect the image right after the primary (as fpack writes
+    // it), so set the other extensions aside in memory while the image is appended, then append them after it.
+    fitsfile * ext_fp = 0;
+    fits_create_file(&ext_fp, "mem://", &status);
+    fits_create_img(ext_fp, BYTE_IMG, 0, 0, &status);
+    int num_hdus = 0;
+    fits_get_num_hdus(fp, &num_hdus, &status);
+    for (int hdu_num = 2; hdu_num <= num_hdus && 0 == status; ++hdu_num) {
+      fits_movabs_hdu(fp, hdu_num, 0, &status);
+      fits_copy_hdu(fp, ext_fp, 0, &status);
+    }
+    for (int hdu_num = num_hdus; hdu_num > 1 && 0 == status; --hdu_num) {
+      fits_movabs_hdu(fp, hdu_num, 0, &status);
+      fits_delete_hdu(fp, 0, &status);
+    }
+
+    // Append the compressed image, with one tile per image plane, so that reading one energy plane of a cube
+    // decompresses only that plane.
+    fits_movabs_hdu(fp, 1, 0, &status);
+    std::vector<long> axes(dims);
+    std::vector<long> tile(dims.size(), 1);
+    tile[0] = axes[0];
+    if (1 < axes.size()) tile[1] = axes[1];
+    fits_set_compression_type(fp, "RICE" == m_image_compression ? RICE_1 : GZIP_1, &status);
+    fits_set_tile_dim(fp, axes.size(), &tile[0], &status);
+
+    // Counts are integers, so store them losslessly as 32 bit integers, like the uncompressed images of the templates.
+    fits_create_img(fp, LONG_IMG, axes.size(), &axes[0], &status);
+    for (std::vector<std::string>::iterator itor = card_cont.begin(); itor != card_cont.end() && 0 == status; ++itor)
+      fits_write_record(fp, itor->c_str(), &status);
+    std::string ext_name = getCompressedImageName();
+    fits_update_key(fp, TSTRING, "EXTNAME", const_cast<char *>(ext_name.c_str()), "Tile-compressed counts image",
+      &status);
+
+    // Compress the image straight from memory.
+    if (!image.empty()) fits_write_img(fp, TFLOAT, 1, image.size(), const_cast<float *>(&image[0]), &status);
+
+    // Put the other extensions back after the image.
+    int num_ext_hdus = 0;
+    fits_get_num_hdus(ext_fp, &num_ext_hdus, &status);
+    for (int hdu_num = 2; hdu_num <= num_ext_hdus && 0 == status; ++hdu_num) {
+      fits_movabs_hdu(ext_fp, hdu_num, 0, &status);
+      fits_copy_hdu(ext_fp, fp, 0, &status);
+    }
+    int ext_status = 0;
+    if (0 != ext_fp) fits_close_file(ext_fp, &ext_status);
+
+    // Close the file regardless of errors, reporting the first error.
+    int close_status = 0;
+    fits_close_file(fp, &close_status);
+    if (0 == status) status = close_status;
+    checkFitsStatus(status, "DataProduct::writeCompressedImage failed to compress the image of " + out_file);
+  }
+
   void DataProduct::harvestKeywords(const FileNameCont_t & file_name_cont, const std::string & ext_name) {
     for (FileNameCont_t::const_iterator itor = file_name_cont.begin(); itor != file_name_cont.end(); ++itor) {
       harvestKeywords(*itor, ext_name);
@@ -407,8 +853,8 @@ namespace evtbin {
     std::stringstream ss;
     ss.precision(24);
     if (0 != binner) {
-      // Get the start of the valid time range from the start of the first bin of the binner.
-      double new_tstart = binner->getInterval(0).begin();
+      // Get the start of the valid time range from the start of the domain of the binner.
+      double new_tstart = binner->getDomain().begin();
       // Find the current value of TSTART, if it is defined.
       KeyValuePairCont_t::iterator found = m_key_value_pairs.find("TSTART");
       if (m_key_value_pairs.end() != found && !found->second.empty()) {
@@ -421,8 +867,8 @@ namespace evtbin {
       }
       updateKeyValue("TSTART", new_tstart);
 
-      // Get the stop of the valid time range from the stop of the last bin of the binner.
-      double new_tstop = binner->getInterval(binner->getNumBins() - 1).end();
+      // Get the stop of the valid time range from the stop of the domain of the binner.
+      double new_tstop = binner->getDomain().end();
       found = m_key_value_pairs.find("TSTOP");
       if (m_key_value_pairs.end() != found && !found->second.empty()) {
         // Fetch current TSTOP value.
@@ -435,14 +881,21 @@ namespace evtbin {
       updateKeyValue("TSTOP", new_tstop);
     }
 
-    // Compute the EXPOSURE keyword.
-    updateKeyValue("EXPOSURE", computeExposure(sc_file, sc_table), "Integration time (in seconds) for the PHA data");
+    // The EXPOSURE keyword needs a pass through the spacecraft data, which is overlapped with binning the input.
+    m_exposure_sc_file = sc_file;
+    m_exposure_sc_table = sc_table;
+    m_exposure_pending = true;
+    // Without spacecraft data there is nothing to overlap.
+    if (sc_file.empty()) finishExposure();
 
     // Compute the ONTIME keyword.
     updateKeyValue("ONTIME", m_gti.computeOntime(), "Sum of all Good Time Intervals");
   }
 
   void DataProduct::gbmExposure(double total_counts, double total_error_channel, const std::string & out_file) const {
+    // The deadtime corrected exposure replaces the one from the spacecraft data, so that must be finished first.
+    finishExposure();
+
     KeyValuePairCont_t::iterator found2 = m_key_value_pairs.find("EVT_DEAD");
     KeyValuePairCont_t::iterator found3 = m_key_value_pairs.find("EVTDEDHI");
     // Only modify exposure if EVT_DEAD is found.
@@ -466,6 +919,8 @@ namespace evtbin {
   }
 
   void DataProduct::updateKeywords(const std::string & file_name) const {
+    finishExposure();
+
     // For convenience, make a local reference to tip's file service singleton.
     tip::IFileSvc & file_service = tip::IFileSvc::instance();
 
@@ -656,6 +1111,85 @@ namespace evtbin {
     return exposure;
   }
 
+  void DataProduct::computeBinExposure(const std::string & sc_file, const std::string & sc_table, const Binner & binner,
+    std::vector<double> & ontime, std::vector<double> & exposure) const {
+    using namespace st_facilities;
+    long num_bins = binner.getNumBins();
+    ontime.assign(num_bins, 0.);
+    exposure.assign(num_bins, 0.);
+    if (0 == num_bins) return;
+
+    // Bins of a folding binner are a fraction of every period, so they get the same fraction of the totals.
+    if (binner.isFolded()) {
+      double total_ontime = m_gti.computeOntime();
+      double total_exposure = computeExposure(sc_file, sc_table);
+      for (long index = 0; index != num_bins; ++index) {
+        ontime[index] = binner.getBinWidth(index) * total_ontime;
+        exposure[index] = binner.getBinWidth(index) * total_exposure;
+      }
+      return;
+    }
+
+    // Visit bins in order of time.
+    std::vector<long> order(num_bins);
+    for (long index = 0; index != num_bins; ++index) order[index] = index;
+    std::sort(order.begin(), order.end(), BinBeginLess(binner));
+
+    // Merge the bins with the GTI, giving the part of each bin inside each good time interval.
+    std::vector<BinSegment> segment_cont;
+    Gti::ConstIterator gti_begin = m_gti.begin();
+    for (std::vector<long>::iterator order_itor = order.begin(); order_itor != order.end(); ++order_itor) {
+      Binner::Interval bin = binner.getInterval(*order_itor);
+      // Intervals which end before this bin begins also end before all later bins begin.
+      while (m_gti.end() != gti_begin && gti_begin->second <= bin.begin()) ++gti_begin;
+      for (Gti::ConstIterator gti_itor = gti_begin; m_gti.end() != gti_itor && gti_itor->first < bin.end(); ++gti_itor) {
+        double start = std::max(bin.begin(), gti_itor->first);
+        double stop = std::min(bin.end(), gti_itor->second);
+        if (start < stop) {
+          segment_cont.push_back(BinSegment(*order_itor, start, stop));
+          ontime[*order_itor] += stop - start;
+        }
+      }
+    }
+    // Segments are already in order unless bins overlap.
+    std::sort(segment_cont.begin(), segment_cont.end());
+
+    if (sc_file.empty()) {
+      exposure = ontime;
+      return;
+    }
+
+    // Get the spacecraft files in ascending order.
+    FileSys::FileNameCont file_name_cont = FileSys::expandFileList(sc_file);
+    std::vector<SpacecraftTable> table_cont;
+    for (FileSys::FileNameCont::iterator itor = file_name_cont.begin(); itor != file_name_cont.end(); ++itor)
+      table_cont.push_back(SpacecraftTable(*itor, sc_table));
+    std::sort(table_cont.begin(), table_cont.end());
+
+    // Sweep the spacecraft data, prorating the livetime of each interval among the segments it overlaps.
+    std::vector<BinSegment>::size_type first = 0;
+    for (std::vector<SpacecraftTable>::iterator table_itor = table_cont.begin();
+      table_itor != table_cont.end() && first != segment_cont.size(); ++table_itor) {
+      std::unique_ptr<const tip::Table> table(table_itor->openTable());
+      for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+        double start = (*itor)["START"].get();
+        double stop = (*itor)["STOP"].get();
+        if (!(start < stop)) continue;
+
+        // Segments which end before this interval starts are done.
+        while (first != segment_cont.size() && segment_cont[first].m_stop <= start) ++first;
+        if (first == segment_cont.size()) break;
+
+        double livetime_rate = (*itor)["LIVETIME"].get() / (stop - start);
+        for (std::vector<BinSegment>::size_type index = first;
+          index != segment_cont.size() && segment_cont[index].m_start < stop; ++index) {
+          double overlap = std::min(stop, segment_cont[index].m_stop) - std::max(start, segment_cont[index].m_start);
+          if (0. < overlap) exposure[segment_cont[index].m_index] += livetime_rate * overlap;
+        }
+      }
+    }
+  }
+
   std::string DataProduct::formatDateKeyword(const time_t & time) const {
     // Standard date format defined by FITS standard.
     char string_time[] = "YYYY-MM-DDThh:mm:ss";
@@ -687,4 +1221,18 @@ namespace evtbin {
     return stat_err;
   }
 
+  void DataProduct::calcStatErr(const double * counts, long num_counts, double * stat_err) const {
+    // Go through the scalar version, which subclasses may override.
+    for (long index = 0; index < num_counts; ++index) stat_err[index] = calcStatErr(counts[index]);
+  }
+
+  void DataProduct::checkFitsStatus(int status, const std::string & context) {
+    if (0 == status) return;
+    char text[FLEN_STATUS] = "";
+    fits_get_errstatus(status, text);
+    std::ostringstream os;
+    os << context << ": cfitsio error " << status << " (" << text << ")";
+    throw std::runtime_error(os.str());
+  }
+
 }
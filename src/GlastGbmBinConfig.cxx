@@ -1,6 +1,7 @@
 #include <memory>
 #include "GlastGbmBinConfig.h"
 
+#include "evtbin/ChannelBinner.h"
 #include "evtbin/Gti.h"
 #include "evtbin/OrderedBinner.h"
 
@@ -31,19 +32,17 @@ namespace evtbin {
     // Open ebounds extension.
     std::unique_ptr<const tip::Table> ebounds(tip::IFileSvc::instance().readTable(par_group["evfile"], "EBOUNDS"));
 
-    // Create a container of appropriate size for the intervals. 
-    OrderedBinner::IntervalCont_t intervals(ebounds->getNumRecords());
-
-    // Fill the intervals using the contents of the channel column.
-    OrderedBinner::IntervalCont_t::iterator interval_itor = intervals.begin();
-    for (tip::Table::ConstIterator itor = ebounds->begin(); itor != ebounds->end(); ++itor, ++interval_itor) {
-      double channel = (*itor)["CHANNEL"].get();
+    // Create a container of appropriate size for the channels.
+    ChannelBinner::ChannelCont_t channels(ebounds->getNumRecords());
 
-      *interval_itor = Binner::Interval(channel - .5, channel + .5);
+    // Fill the channels using the contents of the channel column.
+    ChannelBinner::ChannelCont_t::iterator channel_itor = channels.begin();
+    for (tip::Table::ConstIterator itor = ebounds->begin(); itor != ebounds->end(); ++itor, ++channel_itor) {
+      (*itor)["CHANNEL"].get(*channel_itor);
     }
 
-    // Binning will occur in "PHA" space.
-    return new OrderedBinner(intervals, "PHA");
+    // Binning will occur in "PHA" space, one bin per channel.
+    return new ChannelBinner(channels, "PHA");
   }
   
   Binner * GlastGbmBinConfig::createEbounds(const st_app::AppParGroup & par_group) const {
@@ -2,6 +2,7 @@
     \brief Implementation of a Healpix binner.
 */
 
+#include <algorithm>
 #include <cmath>
 #include <numeric> 
 #include <string>
@@ -26,6 +27,83 @@
 
 using namespace astro;
 
+namespace {
+
+  // Constants and helpers below reproduce the double precision pixelization of T_Healpix_Base::loc2pix exactly.
+  const double s_inv_halfpi = 0.6366197723675813430755350534900574;
+  const double s_twothird = 2.0 / 3.0;
+
+  // Number of coordinates processed in each pass of HealpixBinner::computeIndices.
+  const long s_chunk_size = 256;
+
+  inline double fmodulo(double v1, double v2) {
+    if (v1 >= 0) return (v1 < v2) ? v1 : std::fmod(v1, v2);
+    double tmp = std::fmod(v1, v2) + v2;
+    return (tmp == v2) ? 0. : tmp;
+  }
+
+  // Interleave the bits of a 16 bit value with zeros.
+  inline int spreadBits(int value) {
+    unsigned int x = value & 0xffff;
+    x = (x | (x << 8)) & 0x00ff00ffu;
+    x = (x | (x << 4)) & 0x0f0f0f0fu;
+    x = (x | (x << 2)) & 0x33333333u;
+    x = (x | (x << 1)) & 0x55555555u;
+    return int(x);
+  }
+
+  inline int xyf2nest(int ix, int iy, int face_num, int order) {
+    return (face_num << (2 * order)) + spreadBits(ix) + (spreadBits(iy) << 1);
+  }
+
+  // z = cos(theta), tt = phi / (pi/2) in [0, 4), sth = sin(theta) (only used near the poles).
+  inline int loc2pix(double z, double tt, double sth, bool have_sth, int nside, int order, int npix, int ncap, bool ring) {
+    double za = std::fabs(z);
+    if (ring) {
+      if (za <= s_twothird) {
+        int nl4 = 4 * nside;
+        double temp1 = nside * (0.5 + tt);
+        double temp2 = nside * z * 0.75;
+        int jp = int(temp1 - temp2);
+        int jm = int(temp1 + temp2);
+        int ir = nside + 1 + jp - jm;
+        int kshift = 1 - (ir & 1);
+        int t1 = jp + jm - nside + kshift + 1 + nl4 + nl4;
+        int ip = (order > 0) ? (t1 >> 1) & (nl4 - 1) : ((t1 >> 1) % nl4);
+        return ncap + (ir - 1) * nl4 + ip;
+      }
+      double tp = tt - int(tt);
+      double tmp = ((za < 0.99) || (!have_sth)) ? nside * std::sqrt(3 * (1 - za)) : nside * sth / std::sqrt((1. + za) / 3.);
+      int jp = int(tp * tmp);
+      int jm = int((1.0 - tp) * tmp);
+      int ir = jp + jm + 1;
+      int ip = int(tt * ir);
+      return (z > 0) ? 2 * ir * (ir - 1) + ip : npix - 2 * ir * (ir + 1) + ip;
+    }
+    if (za <= s_twothird) {
+      double temp1 = nside * (0.5 + tt);
+      double temp2 = nside * (z * 0.75);
+      int jp = int(temp1 - temp2);
+      int jm = int(temp1 + temp2);
+      int ifp = jp >> order;
+      int ifm = jm >> order;
+      int face_num = (ifp == ifm) ? (ifp | 4) : ((ifp < ifm) ? ifp : (ifm + 8));
+      int ix = jm & (nside - 1);
+      int iy = nside - (jp & (nside - 1)) - 1;
+      return xyf2nest(ix, iy, face_num, order);
+    }
+    int ntt = std::min(3, int(tt));
+    double tp = tt - ntt;
+    double tmp = ((za < 0.99) || (!have_sth)) ? nside * std::sqrt(3 * (1 - za)) : nside * sth / std::sqrt((1. + za) / 3.);
+    int jp = int(tp * tmp);
+    int jm = int((1.0 - tp) * tmp);
+    jp = std::min(jp, nside - 1);
+    jm = std::min(jm, nside - 1);
+    return (z >= 0) ? xyf2nest(nside - jm - 1, nside - jp - 1, ntt, order) : xyf2nest(jp, jm, ntt + 8, order);
+  }
+
+}
+
 namespace evtbin {
 
   HealpixBinner::HealpixBinner(int order, Healpix_Ordering_Scheme scheme, bool lb, 
@@ -91,8 +169,7 @@ namespace evtbin {
      m_hpx(other.m_hpx),
      m_lb(other.m_lb),
      m_region(other.m_region ? new healpix::HealpixRegion(*other.m_region) : 0),
-     m_pixelIndices(other.m_pixelIndices),
-     m_pixGlobalToLocalMap(other.m_pixGlobalToLocalMap)
+     m_lookup(other.m_lookup)
   {
   }
   
@@ -103,17 +180,45 @@ namespace evtbin {
     double phi = astro::degToRad(coord1);
     double theta = astro::degToRad( astro::latToTheta_Deg(coord2) );
     int index= m_hpx.ang2pix(pointing(theta,phi));  //Convert theta,phi to pix nbr
-    if ( allSky() ) {
-      return index;
-    }
-    // Not an all-sky map, convert to local pixel index
-    std::map<int,int>::const_iterator itrFind = m_pixGlobalToLocalMap.find(index);    
-    if ( itrFind == m_pixGlobalToLocalMap.end() ) {
-      return -1;
-    }
-    return itrFind->second;
+    // Convert to local pixel index if not an all-sky map
+    return globalToLocal(index);
   } //end of compute index
   
+  void HealpixBinner::computeIndices(const double * coord1, const double * coord2, long num_values, long * index) const
+  {
+    static const double pi = 3.141592653589793238462643383279502884197;
+    const int nside = m_hpx.Nside();
+    const int order = m_hpx.Order();
+    const int npix = m_hpx.Npix();
+    const int ncap = 2 * nside * (nside - 1);
+    const bool ring = RING == m_hpx.Scheme();
+
+    double z[s_chunk_size];
+    double tt[s_chunk_size];
+    double sth[s_chunk_size];
+    bool have_sth[s_chunk_size];
+    for ( long begin = 0; begin < num_values; begin += s_chunk_size ) {
+      long size = std::min(s_chunk_size, num_values - begin);
+
+      // First pass: angles -> (z, tt), same conversions as computeIndex.
+      for ( long i = 0; i < size; ++i ) {
+        double phi = astro::degToRad(coord1[begin + i]);
+        double theta = astro::degToRad( astro::latToTheta_Deg(coord2[begin + i]) );
+        // Let Healpix_Base report invalid values in its usual way.
+        if ( !(theta >= 0. && theta <= pi) ) m_hpx.ang2pix(pointing(theta,phi));
+        z[i] = std::cos(theta);
+        tt[i] = fmodulo(phi * s_inv_halfpi, 4.0);
+        have_sth[i] = (theta < 0.01) || (theta > 3.14159-0.01);
+        sth[i] = have_sth[i] ? std::sin(theta) : 0.;
+      }
+
+      // Second pass: (z, tt) -> pixel number -> bin number.
+      for ( long i = 0; i < size; ++i ) {
+        index[begin + i] = globalToLocal(loc2pix(z[i], tt[i], sth[i], have_sth[i], nside, order, npix, ncap, ring));
+      }
+    }
+  }
+
   /////////////////////////////////////////////////////////////////////////1D-Binner
   long HealpixBinner::computeIndex(double value) const {
     if ( allSky() ) {
@@ -121,16 +226,17 @@ namespace evtbin {
       return long(value);
     }
     // Not an all-sky map, convert to local pixel index
-    std::map<int,int>::const_iterator itrFind = m_pixGlobalToLocalMap.find(int(value));    
-    if ( itrFind == m_pixGlobalToLocalMap.end() ) {
-      return -1;
-    }
-    return long(itrFind->second);
+    return globalToLocal(long(value));
   }
   ////////////////////////////////////////////////////////////////////////////
   
   long HealpixBinner::getNumBins() const { 
-    return allSky() ? m_hpx.Npix() : m_pixelIndices.size();
+    return allSky() ? m_hpx.Npix() : m_lookup->pixelIndices().size();
+  }
+
+  const std::vector<int>& HealpixBinner::pixelIndices() const {
+    static const std::vector<int> s_no_pixels;
+    return m_lookup ? m_lookup->pixelIndices() : s_no_pixels;
   }
   
   Binner::Interval HealpixBinner::getInterval(long index) const {
@@ -144,19 +250,59 @@ namespace evtbin {
   };
 
   void HealpixBinner::setPixelMapping() {
-    m_pixelIndices.clear();
-    m_pixGlobalToLocalMap.clear();
+    m_lookup.reset();
     if ( m_region == 0 ) {
       return;
     }
 
-    m_region->getPixels(m_hpx,m_pixelIndices);
-       
-    // finally, fill the reverse map
-    for ( int i(0); i < m_pixelIndices.size(); i++ ) {
-      m_pixGlobalToLocalMap[ m_pixelIndices[i] ] = i;
+    std::vector<int> pixelIndices;
+    m_region->getPixels(m_hpx,pixelIndices);
+
+    // finally, build the reverse index, which is shared by all copies of this binner
+    m_lookup = std::make_shared<const PixelLookup>(pixelIndices, m_hpx.Nside() <= 1024);
+  }
+
+  HealpixBinner::PixelLookup::PixelLookup(const std::vector<int> & pixel_indices, bool dense)
+    :m_pixel_indices(pixel_indices),
+     m_first_pixel(0),
+     m_dense(),
+     m_sorted()
+  {
+    if ( m_pixel_indices.empty() ) {
+      return;
+    }
+    if ( dense ) {
+      // table spans only the global pixel range of the region
+      std::pair<std::vector<int>::const_iterator, std::vector<int>::const_iterator> range =
+        std::minmax_element(m_pixel_indices.begin(), m_pixel_indices.end());
+      m_first_pixel = *range.first;
+      m_dense.assign(*range.second - *range.first + 1, -1);
+      for ( std::size_t i(0); i < m_pixel_indices.size(); i++ ) {
+        m_dense[ m_pixel_indices[i] - m_first_pixel ] = i;
+      }
+    } else {
+      m_sorted.reserve(m_pixel_indices.size());
+      for ( std::size_t i(0); i < m_pixel_indices.size(); i++ ) {
+        m_sorted.push_back(std::make_pair(m_pixel_indices[i], int(i)));
+      }
+      std::sort(m_sorted.begin(), m_sorted.end());
+    }
+  }
+
+  long HealpixBinner::PixelLookup::localIndex(long global_index) const {
+    if ( !m_dense.empty() ) {
+      long offset = global_index - m_first_pixel;
+      if ( offset < 0 || offset >= long(m_dense.size()) ) {
+        return -1;
+      }
+      return m_dense[offset];
     }
-    
+    std::vector<std::pair<int, int> >::const_iterator itrFind =
+      std::lower_bound(m_sorted.begin(), m_sorted.end(), std::make_pair(int(global_index), -1));
+    if ( itrFind == m_sorted.end() || itrFind->first != global_index ) {
+      return -1;
+    }
+    return itrFind->second;
   }
   
   void HealpixBinner::setKeywords(tip::Header & header) const {
@@ -3,8 +3,10 @@
    
 */
 #include <algorithm>
+#include <cstdint>
 #include <iomanip>
 #include <memory>
+#include <numeric>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -14,6 +16,9 @@
 #include "evtbin/LinearBinner.h"
 #include "evtbin/HealpixMap.h"
 #include "evtbin/HealpixBinner.h"
+#include "evtbin/MappedEventTable.h"
+
+#include "astro/HealpixProj.h"
 
 #include "facilities/commonUtilities.h"
 
@@ -21,6 +26,36 @@
 #include "tip/Table.h"
 #include "tip/tip_types.h"
 
+namespace {
+  // Number of events binned at once.
+  const long s_batch_size = 4096;
+
+  // Node of the multi-order map while it is merged bottom-up: a NEST pixel, its counts per energy bin, and whether
+  // it is still a single cell (as opposed to having been split because it holds more counts than the threshold).
+  struct MocNode {
+    MocNode(std::int64_t pixel, long num_energies): m_pixel(pixel), m_counts(num_energies, 0.), m_leaf(true) {}
+
+    double total() const { return std::accumulate(m_counts.begin(), m_counts.end(), 0.); }
+
+    bool operator <(const MocNode & node) const { return m_pixel < node.m_pixel; }
+
+    std::int64_t m_pixel;
+    std::vector<double> m_counts;
+    bool m_leaf;
+  };
+
+  // NUNIQ number of a pixel of the given order.
+  std::int64_t computeUniq(int order, std::int64_t pixel) { return (std::int64_t(4) << (2 * order)) + pixel; }
+
+  // Whether the pixel covers any pixel of the sorted region, whose NEST numbers are shift bits longer. An empty region
+  // stands for the whole sky.
+  bool coversRegion(const std::vector<std::int64_t> & region, std::int64_t pixel, int shift) {
+    if (region.empty()) return true;
+    std::vector<std::int64_t>::const_iterator found = std::lower_bound(region.begin(), region.end(), pixel << shift);
+    return found != region.end() && (*found >> shift) == pixel;
+  }
+}
+
 namespace evtbin {
      
    HealpixMap::HealpixMap(const std::string & event_file, const std::string & event_table, 
@@ -34,7 +69,7 @@ namespace evtbin {
 		 region_string,"HEALPIX"),
     m_ebinner(energy_binner.clone()), 
     m_hpx_ebin(hpx_ebin), 
-    m_ebounds(ebounds.clone()), m_emin(0.),m_emax(0.) {    
+    m_ebounds(ebounds.clone()), m_emin(0.),m_emax(0.), m_order_min(-1), m_moc_threshold(0.) {    
      // Set initial size of data array : m_data sized to the number of energy bin
      // m_ebinner->getNumBins() returns 0 if no energy binning is requested, which needs to default to 1 bin.
      m_data.resize(m_ebinner->getNumBins()?m_ebinner->getNumBins():1) ;
@@ -63,6 +98,9 @@ namespace evtbin {
 
     // Correct time keywords.
     adjustTimeKeywords(sc_file, sc_table);     
+
+    // Use memory mapped input when possible.
+    m_use_mapped_input = true;
    }
 
    HealpixMap::HealpixMap(const std::string & event_file, const std::string & event_table, 
@@ -76,7 +114,7 @@ namespace evtbin {
 		 region_string,"HEALPIX"),    
     m_ebinner(energy_binner.clone()), 
     m_hpx_ebin(hpx_ebin),
-    m_ebounds(ebounds.clone()), m_emin(0.),m_emax(0.) {    
+    m_ebounds(ebounds.clone()), m_emin(0.),m_emax(0.), m_order_min(-1), m_moc_threshold(0.) {    
      // Set initial size of data array : m_data sized to the number of energy bin
      // m_ebinner->getNumBins() returns 0 if no energy binning is requested, which needs to default to 1 bin.
      m_data.resize(m_ebinner->getNumBins()?m_ebinner->getNumBins():1) ;
@@ -105,13 +143,18 @@ namespace evtbin {
 
     // Correct time keywords.
     adjustTimeKeywords(sc_file, sc_table);     
+
+    // Use memory mapped input when possible.
+    m_use_mapped_input = true;
    }
   
   HealpixMap::HealpixMap(const std::string & healpixmap_file)
     : DataProduct(healpixmap_file, "SKYMAP", evtbin::Gti(healpixmap_file)),
       m_hpx_binner(healpixmap_file, "SKYMAP"),
       m_ebinner(0),
-      m_ebounds(0){
+      m_ebounds(0),
+      m_order_min(-1),
+      m_moc_threshold(0.){
     
     readEbounds(healpixmap_file);
     //in principle it should be possible to build the following correctly from the bounds....
@@ -156,34 +199,133 @@ namespace evtbin {
   }
 
 void HealpixMap::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end) {
+    if (begin == end) return;
+
      // From each binner, get the name of its field.
     std::string energy_field = m_ebinner->getName();
 
+    // Only the coordinate pair which is actually used is read: (l,b) or (ra,dec).
+    std::string coord1_field = m_hpx_binner.lb() ? "L" : "RA";
+    std::string coord2_field = m_hpx_binner.lb() ? "B" : "DEC";
+
     //initialize m_emin
     m_emin=(*begin)[energy_field].get();
-    // Fill histogram, converting each coord to pix number on the fly:
+
+    // Fill histogram one batch of events at a time, converting each coord to pix number for the whole batch.
+    std::vector<double> coord1(s_batch_size);
+    std::vector<double> coord2(s_batch_size);
+    std::vector<double> energy(s_batch_size);
+    std::vector<unsigned long> event_type(s_batch_size);
+    long num_events = 0;
     for (tip::Table::ConstIterator itor = begin; itor != end; ++itor)
       {
 	// Extract the data from each record.
-	double energy = (*itor)[energy_field].get();   //get the data in col ENERGY
-	double ra = (*itor)["RA"].get();
-	double dec = (*itor)["DEC"].get();
-	double l = (*itor)["L"].get();
-	double b = (*itor)["B"].get();
-	
-	// There is no easy way to make use of Hist2D::fillBin in the
-	// case of HEALPIX spatial binner, so we clone the loop here
-	// deal with (l,b) or (ra,dec)?
-	if (m_hpx_binner.lb()) fillBin(l, b, energy);
-        else       fillBin(ra, dec, energy);
-
-	//this is bookkeeping for EBOUNDS in case of no ebinning request
-	m_emax=energy>m_emax?energy:m_emax;
-	m_emin=energy<m_emin?energy:m_emin;
+	energy[num_events] = (*itor)[energy_field].get();
+	coord1[num_events] = (*itor)[coord1_field].get();
+	coord2[num_events] = (*itor)[coord2_field].get();
+	if (!m_event_types.empty()) event_type[num_events] = readEventType(itor);
+	if (s_batch_size == ++num_events) {
+	  fillBatch(&coord1[0], &coord2[0], &energy[0], &event_type[0], num_events);
+	  num_events = 0;
+	}
     }//end for
+    fillBatch(&coord1[0], &coord2[0], &energy[0], &event_type[0], num_events);
 } //end binInput
 
+  void HealpixMap::binInput(const MappedEventTable & table, long first_record, long last_record) {
+    if (first_record >= last_record) return;
+
+    std::string energy_field = m_ebinner->getName();
+    std::string coord1_field = m_hpx_binner.lb() ? "L" : "RA";
+    std::string coord2_field = m_hpx_binner.lb() ? "B" : "DEC";
+
+    //initialize m_emin
+    m_emin = table.readValue(energy_field, first_record);
+
+    std::vector<double> coord1(s_batch_size);
+    std::vector<double> coord2(s_batch_size);
+    std::vector<double> energy(s_batch_size);
+    std::vector<unsigned long> event_type(s_batch_size);
+    for (long batch_begin = first_record; batch_begin < last_record; batch_begin += s_batch_size) {
+      long num_events = std::min(s_batch_size, last_record - batch_begin);
+      table.readColumn(energy_field, batch_begin, num_events, &energy[0]);
+      table.readColumn(coord1_field, batch_begin, num_events, &coord1[0]);
+      table.readColumn(coord2_field, batch_begin, num_events, &coord2[0]);
+      if (!m_event_types.empty()) table.readBits(m_event_type_field, batch_begin, num_events, &event_type[0]);
+      fillBatch(&coord1[0], &coord2[0], &energy[0], &event_type[0], num_events);
+    }
+  }
+
+  void HealpixMap::fillBatch(const double * coord1, const double * coord2, const double * energy,
+    const unsigned long * event_type, long num_events) {
+    m_pix_index.resize(num_events);
+    if (0 == num_events) return;
+    m_hpx_binner.computeIndices(coord1, coord2, num_events, &m_pix_index[0]);
+
+    //computeIndex returns -1 if m_ebinner has 0 bin, 
+    //which is the case if no energy binning is requested by the user.
+    bool ebin = m_ebinner->getNumBins()>1;
+    m_energy_index.resize(num_events);
+    for (long ii = 0; ii != num_events; ++ii) {
+      m_energy_index[ii] = ebin?m_ebinner->computeIndex(energy[ii]):0;
+
+      //this is bookkeeping for EBOUNDS in case of no ebinning request
+      m_emax=energy[ii]>m_emax?energy[ii]:m_emax;
+      m_emin=energy[ii]<m_emin?energy[ii]:m_emin;
+    }
+
+    if (m_event_types.empty()) {
+      for (long ii = 0; ii != num_events; ++ii) {
+        long index1 = m_energy_index[ii];
+        long index2 = m_pix_index[ii];
+        if (0 <= index1 && 0 <= index2) {
+          m_data[index1][index2] += 1.;
+        }
+      }
+      return;
+    }
+
+    // Bin each event into the map of every event type it belongs to.
+    m_selected.resize(num_events);
+    for (EventTypeCont_t::size_type index = 0; index != m_event_types.size(); ++index) {
+      selectEventType(event_type, num_events, m_event_types[index], &m_selected[0]);
+      Cont_t & data = m_type_data[index];
+      for (long ii = 0; ii != num_events; ++ii) {
+        long index1 = m_energy_index[ii];
+        long index2 = m_pix_index[ii];
+        if (m_selected[ii] && 0 <= index1 && 0 <= index2) {
+          data[index1][index2] += 1.;
+        }
+      }
+    }
+  }
+
+  void HealpixMap::setEventTypes(const EventTypeCont_t & event_types, const std::string & field) {
+    // A split map bins events only into the map of each event type, so the full map is freed before they are created.
+    Cont_t().swap(m_data);
+    std::vector<Cont_t>().swap(m_type_data);
+    Cont_t::size_type num_energy_bins = m_ebinner->getNumBins() ? m_ebinner->getNumBins() : 1;
+    if (event_types.empty()) {
+      m_data.assign(num_energy_bins, std::vector<double>(m_hpx_binner.getNumBins(), 0.));
+    } else {
+      m_type_data.resize(event_types.size());
+      for (std::vector<Cont_t>::iterator itor = m_type_data.begin(); itor != m_type_data.end(); ++itor)
+        itor->assign(num_energy_bins, std::vector<double>(m_hpx_binner.getNumBins(), 0.));
+    }
+    m_event_types = event_types;
+    m_event_type_field = field;
+  }
+
   void HealpixMap::writeOutput(const std::string & creator, const std::string & out_file) const {
+    if (m_event_types.empty()) {
+      writeMap(creator, out_file, m_data);
+    } else {
+      for (EventTypeCont_t::size_type index = 0; index != m_event_types.size(); ++index)
+        writeMap(creator, getEventTypeFileName(out_file, m_event_types[index]), m_type_data[index]);
+    }
+  }
+
+  void HealpixMap::writeMap(const std::string & creator, const std::string & out_file, const Cont_t & fine_data) const {
 
     // Standard file creation from base class.    
     createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatHealpixTemplate"));
@@ -193,7 +335,7 @@ void HealpixMap::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIter
     tip::Header & header(output_table->getHeader());
    
     // Write the SKYMAP  extension
-    writeSkymaps(out_file);
+    writeSkymaps(out_file, fine_data);
 
     // Write the history that came from the skymaps extension.
     writeHistory(*output_table, "EVENTS"); 
@@ -213,9 +355,21 @@ void HealpixMap::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIter
     // Write the GTI extension.
     writeGti(out_file);
 
+    // Write the coarser maps, if requested.
+    for (int order = m_hpx_binner.healpix().Order() - 1; order >= m_order_min && order >= 0; --order) {
+      writePyramidLevel(out_file, fine_data, order);
+    }
+
+    // Write the multi-order map, if requested.
+    if (0. < m_moc_threshold) writeMoc(out_file, fine_data);
   }  
   
   void HealpixMap::writeSkymaps(const std::string & out_file) const {
+    checkNotSplit("HealpixMap::writeSkymaps");
+    writeSkymaps(out_file, m_data);
+  }
+
+  void HealpixMap::writeSkymaps(const std::string & out_file, const Cont_t & fine_data) const {
     //Open the skymap extension
     std::unique_ptr<tip::Table> output_table(tip::IFileSvc::instance().editTable(out_file, "SKYMAP"));
     //resize the table to have as many records as there are healpixels
@@ -250,13 +404,228 @@ void HealpixMap::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIter
       //loop over rows and fill healpix values in
       tip::Table::Iterator table_itor = output_table->begin();
       for(long hpx_index = 0;hpx_index != m_hpx_binner.getNumBins();++hpx_index,++table_itor) {
-	(*table_itor)[e_channel.str()].set(m_data[e_index][hpx_index]);
+	(*table_itor)[e_channel.str()].set(fine_data[e_index][hpx_index]);
       }
     }
 }
 
+  void HealpixMap::setPyramidOrderMin(int order_min) {
+    if (0 <= order_min && order_min < m_hpx_binner.healpix().Order() && NEST != scheme())
+      throw std::logic_error("HealpixMap::setPyramidOrderMin: coarser maps can only be derived from NESTED maps");
+    m_order_min = order_min < 0 ? -1 : order_min;
+  }
+
+  void HealpixMap::degrade(int order, std::vector<int> & pixels, Cont_t & data) const {
+    checkNotSplit("HealpixMap::degrade");
+    degrade(m_data, order, pixels, data);
+  }
+
+  void HealpixMap::degrade(const Cont_t & fine_data, int order, std::vector<int> & pixels, Cont_t & data) const {
+    int fine_order = m_hpx_binner.healpix().Order();
+    if (NEST != scheme() || 0 > order || fine_order < order) {
+      std::ostringstream os;
+      os << "HealpixMap::degrade cannot derive a map of order " << order << " from a " <<
+        (NEST == scheme() ? "NESTED" : "RING") << " map of order " << fine_order;
+      throw std::logic_error(os.str());
+    }
+
+    // In the NEST scheme, the parent of a pixel at a coarser order is found by dropping 2 bits per order.
+    int shift = 2 * (fine_order - order);
+    pixels.clear();
+    std::vector<long> coarse_index;
+    long num_coarse = 0;
+    if (m_hpx_binner.allSky()) {
+      num_coarse = 12l << (2 * order);
+    } else {
+      // Coarse pixels are the distinct parents of the pixels in the region.
+      const std::vector<int> & fine_pixels = m_hpx_binner.pixelIndices();
+      for (std::vector<int>::const_iterator itor = fine_pixels.begin(); itor != fine_pixels.end(); ++itor)
+        pixels.push_back(*itor >> shift);
+      std::sort(pixels.begin(), pixels.end());
+      pixels.erase(std::unique(pixels.begin(), pixels.end()), pixels.end());
+      num_coarse = pixels.size();
+      coarse_index.reserve(fine_pixels.size());
+      for (std::vector<int>::const_iterator itor = fine_pixels.begin(); itor != fine_pixels.end(); ++itor)
+        coarse_index.push_back(std::lower_bound(pixels.begin(), pixels.end(), *itor >> shift) - pixels.begin());
+    }
+
+    data.assign(fine_data.size(), std::vector<double>(num_coarse, 0.));
+    for (Cont_t::size_type e_index = 0; e_index != fine_data.size(); ++e_index) {
+      const std::vector<double> & fine = fine_data[e_index];
+      std::vector<double> & coarse = data[e_index];
+      if (m_hpx_binner.allSky()) {
+        for (std::vector<double>::size_type pix = 0; pix != fine.size(); ++pix) coarse[pix >> shift] += fine[pix];
+      } else {
+        for (std::vector<double>::size_type pix = 0; pix != fine.size(); ++pix) coarse[coarse_index[pix]] += fine[pix];
+      }
+    }
+  }
+
+  void HealpixMap::writePyramidLevel(const std::string & out_file, const Cont_t & fine_data, int order) const {
+    std::vector<int> pixels;
+    Cont_t data;
+    degrade(fine_data, order, pixels, data);
+
+    std::ostringstream ext_name;
+    ext_name << "SKYMAP_" << order;
+    tip::IFileSvc::instance().appendTable(out_file, ext_name.str());
+    std::unique_ptr<tip::Table> output_table(tip::IFileSvc::instance().editTable(out_file, ext_name.str()));
+    long num_pix = data.empty() ? 0 : data.front().size();
+    output_table->setNumRecords(num_pix);
+
+    // HEALPix keywords for the coarser order.
+    tip::Header & header(output_table->getHeader());
+    astro::HealpixProj proj(1 << order, NEST, SET_NSIDE, isGalactic());
+    proj.setKeywords(header);
+    header["INDXSCHM"].set(m_hpx_binner.allSky() ? "IMPLICIT" : "EXPLICIT");
+    writeDssKeywords(header);
+
+    // Partial-sky maps need the pixel indices.
+    if (!m_hpx_binner.allSky()) {
+      std::string pixname("PIX");
+      output_table->appendField(pixname, std::string("J"));
+      tip::IColumn* col = output_table->getColumn(output_table->getFieldIndex(pixname));
+      for (long hpx_index = 0; hpx_index != num_pix; ++hpx_index) col->set(hpx_index, pixels[hpx_index]);
+    }
+
+    for (Cont_t::size_type e_index = 0; e_index != data.size(); ++e_index) {
+      std::ostringstream e_channel;
+      e_channel<<"CHANNEL"<<e_index+1;
+      output_table->appendField(e_channel.str(), std::string("D"));
+      tip::IColumn* col = output_table->getColumn(output_table->getFieldIndex(e_channel.str()));
+      for (long hpx_index = 0; hpx_index != num_pix; ++hpx_index) col->set(hpx_index, data[e_index][hpx_index]);
+    }
+  }
+
+  void HealpixMap::setMocThreshold(double threshold) {
+    if (0. < threshold && NEST != scheme())
+      throw std::logic_error("HealpixMap::setMocThreshold: multi-order maps can only be derived from NESTED maps");
+    m_moc_threshold = threshold < 0. ? 0. : threshold;
+  }
+
+  void HealpixMap::computeMoc(double threshold, int order_min, std::vector<std::int64_t> & uniq, Cont_t & data) const {
+    checkNotSplit("HealpixMap::computeMoc");
+    computeMoc(m_data, threshold, order_min, uniq, data);
+  }
+
+  void HealpixMap::computeMoc(const Cont_t & fine_data, double threshold, int order_min, std::vector<std::int64_t> & uniq,
+    Cont_t & data) const {
+    int order_max = m_hpx_binner.healpix().Order();
+    if (0 > order_min) order_min = 0;
+    if (order_min > order_max) order_min = order_max;
+
+    bool all_sky = m_hpx_binner.allSky();
+    long num_energies = fine_data.size();
+    long num_fine = fine_data.empty() ? 0 : fine_data.front().size();
+
+    // Global NEST pixel numbers of a partial-sky map, sorted, to find out which cells cover part of the region.
+    std::vector<std::int64_t> region;
+    if (!all_sky) {
+      region.assign(m_hpx_binner.pixelIndices().begin(), m_hpx_binner.pixelIndices().end());
+      std::sort(region.begin(), region.end());
+    }
+
+    // The occupied pixels of the binned map are the leaves of the finest order.
+    std::vector<MocNode> nodes;
+    for (long local = 0; local != num_fine; ++local) {
+      MocNode node(all_sky ? local : m_hpx_binner.pixelIndices()[local], num_energies);
+      for (long e_index = 0; e_index != num_energies; ++e_index) node.m_counts[e_index] = fine_data[e_index][local];
+      if (0. != node.total()) nodes.push_back(node);
+    }
+    std::sort(nodes.begin(), nodes.end());
+
+    // Merge the nodes bottom-up, four siblings at a time. Siblings whose parent has more counts than the threshold
+    // become cells of the map, as do the siblings which hold no counts but cover part of the region.
+    std::vector<std::pair<std::int64_t, std::vector<double> > > cells; // (uniq, counts)
+    std::vector<double> no_counts(num_energies, 0.);
+    for (int order = order_max; order > order_min; --order) {
+      int shift = 2 * (order_max - order);
+      std::vector<MocNode> parents;
+      for (std::vector<MocNode>::iterator first = nodes.begin(); first != nodes.end(); ) {
+        std::vector<MocNode>::iterator last = first;
+        MocNode parent(first->m_pixel >> 2, num_energies);
+        for (; last != nodes.end() && parent.m_pixel == last->m_pixel >> 2; ++last) {
+          for (long e_index = 0; e_index != num_energies; ++e_index) parent.m_counts[e_index] += last->m_counts[e_index];
+          parent.m_leaf = parent.m_leaf && last->m_leaf;
+        }
+        parent.m_leaf = parent.m_leaf && parent.total() <= threshold;
+        if (!parent.m_leaf) {
+          std::vector<MocNode>::iterator child = first;
+          for (std::int64_t pixel = 4 * parent.m_pixel; pixel != 4 * parent.m_pixel + 4; ++pixel) {
+            if (child != last && pixel == child->m_pixel) {
+              if (child->m_leaf) cells.push_back(std::make_pair(computeUniq(order, pixel), child->m_counts));
+              ++child;
+            } else if (coversRegion(region, pixel, shift)) {
+              cells.push_back(std::make_pair(computeUniq(order, pixel), no_counts));
+            }
+          }
+        }
+        parents.push_back(parent);
+        first = last;
+      }
+      nodes.swap(parents);
+    }
+
+    // Every pixel of the coarsest order which was not split is a cell, whether it holds counts or not.
+    int shift = 2 * (order_max - order_min);
+    std::int64_t num_coarse = std::int64_t(12) << (2 * order_min);
+    std::vector<MocNode>::const_iterator node = nodes.begin();
+    for (std::int64_t pixel = 0; pixel != num_coarse; ++pixel) {
+      if (node != nodes.end() && pixel == node->m_pixel) {
+        if (node->m_leaf) cells.push_back(std::make_pair(computeUniq(order_min, pixel), node->m_counts));
+        ++node;
+      } else if (coversRegion(region, pixel, shift)) {
+        cells.push_back(std::make_pair(computeUniq(order_min, pixel), no_counts));
+      }
+    }
+    std::sort(cells.begin(), cells.end());
+
+    uniq.resize(cells.size());
+    data.assign(num_energies, std::vector<double>(cells.size(), 0.));
+    for (std::vector<std::pair<std::int64_t, std::vector<double> > >::size_type index = 0; index != cells.size(); ++index) {
+      uniq[index] = cells[index].first;
+      for (long e_index = 0; e_index != num_energies; ++e_index) data[e_index][index] = cells[index].second[e_index];
+    }
+  }
+
+  void HealpixMap::writeMoc(const std::string & out_file, const Cont_t & fine_data) const {
+    std::vector<std::int64_t> uniq;
+    Cont_t data;
+    computeMoc(fine_data, m_moc_threshold, m_order_min, uniq, data);
+
+    std::string ext_name("SKYMAP_MOC");
+    tip::IFileSvc::instance().appendTable(out_file, ext_name);
+    std::unique_ptr<tip::Table> output_table(tip::IFileSvc::instance().editTable(out_file, ext_name));
+    output_table->setNumRecords(uniq.size());
+
+    // Multi-order maps are explicitly indexed by NUNIQ pixel number.
+    tip::Header & header(output_table->getHeader());
+    header["PIXTYPE"].set("HEALPIX");
+    header["ORDERING"].set("NUNIQ");
+    header["COORDSYS"].set(isGalactic() ? "G" : "C");
+    header["INDXSCHM"].set("EXPLICIT");
+    header["MOCORDER"].set(m_hpx_binner.healpix().Order());
+    header["MOCTHRES"].set(m_moc_threshold);
+    writeDssKeywords(header);
+
+    std::string uniqname("UNIQ");
+    output_table->appendField(uniqname, std::string("K"));
+    tip::IColumn* col = output_table->getColumn(output_table->getFieldIndex(uniqname));
+    for (std::vector<std::int64_t>::size_type index = 0; index != uniq.size(); ++index) col->set(index, uniq[index]);
+
+    for (Cont_t::size_type e_index = 0; e_index != data.size(); ++e_index) {
+      std::ostringstream e_channel;
+      e_channel<<"CHANNEL"<<e_index+1;
+      output_table->appendField(e_channel.str(), std::string("D"));
+      col = output_table->getColumn(output_table->getFieldIndex(e_channel.str()));
+      for (std::vector<std::int64_t>::size_type index = 0; index != uniq.size(); ++index) col->set(index, data[e_index][index]);
+    }
+  }
+
   void HealpixMap::fillBin(const double coord1, const double coord2, const double energy, double weight)
   {
+    checkNotSplit("HealpixMap::fillBin");
+
     //computeIndex returns -1 if m_ebinner has 0 bin, 
     //which is the case if no energy binning is requested by the user.
     long index1 = m_ebinner->getNumBins()>1?m_ebinner->computeIndex(energy):0;
@@ -269,5 +638,8 @@ void HealpixMap::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIter
     
   }
 
-}
+  void HealpixMap::checkNotSplit(const std::string & method) const {
+    if (!m_event_types.empty()) throw std::logic_error(method + ": the full map is not kept when it is split by event type");
+  }
 
+}
@@ -1,6 +1,9 @@
 /** \file Hist.cxx
     \brief Base class for histogram abstractions.
 */
+#include <sstream>
+#include <stdexcept>
+
 #include "evtbin/Binner.h"
 #include "evtbin/Hist.h"
 
@@ -11,6 +14,112 @@ namespace evtbin {
       delete *itor;
   }
 
+  void Hist::fillBins(const std::vector<const double *> & columns, long num_values) {
+    std::vector<double> value(columns.size());
+    for (long record = 0; record != num_values; ++record) {
+      for (std::vector<double>::size_type ii = 0; ii != value.size(); ++ii) value[ii] = columns[ii][record];
+      fillBin(value);
+    }
+  }
+
   const Hist::BinnerCont_t & Hist::getBinners() const { return m_binners; }
 
+  void Hist::addRebinned(const Hist & master) {
+    std::vector<std::vector<long> > offset;
+    computeRebinOffsets(master, offset);
+
+    // Sum the master's bins into the bins of this histogram.
+    long size = m_binners.empty() ? 0 : 1;
+    for (BinnerCont_t::size_type dim = 0; dim != m_binners.size(); ++dim) size *= m_binners[dim]->getNumBins();
+    std::vector<double> values(size, 0.);
+    master.sumRebinned(offset, values);
+
+    addValues(values);
+  }
+
+  void Hist::sumRebinned(const std::vector<std::vector<long> > & offset, std::vector<double> & values) const {
+    BinnerCont_t::size_type num_dims = m_binners.size();
+
+    // Step through this histogram's bins in order.
+    std::vector<double> fine_values;
+    getValues(fine_values);
+    std::vector<long> index(num_dims, 0);
+    for (std::vector<double>::size_type flat = 0; flat != fine_values.size(); ++flat) {
+      long target = 0;
+      for (BinnerCont_t::size_type dim = 0; dim != num_dims && 0 <= target; ++dim) {
+        long contribution = offset[dim][index[dim]];
+        target = 0 <= contribution ? target + contribution : -1;
+      }
+      if (0 <= target) values[target] += fine_values[flat];
+
+      // Advance to the next bin.
+      for (BinnerCont_t::size_type dim = num_dims; dim > 0; --dim) {
+        if (++index[dim - 1] < long(offset[dim - 1].size())) break;
+        index[dim - 1] = 0;
+      }
+    }
+  }
+
+  void Hist::computeRebinOffsets(const Hist & master, std::vector<std::vector<long> > & offset) const {
+    const BinnerCont_t & master_binners = master.getBinners();
+    BinnerCont_t::size_type num_master_dims = master_binners.size();
+    BinnerCont_t::size_type num_dims = m_binners.size();
+
+    // Strides of this histogram's flattened contents.
+    std::vector<long> stride(num_dims, 1);
+    for (BinnerCont_t::size_type dim = num_dims; dim > 1; --dim)
+      stride[dim - 2] = stride[dim - 1] * m_binners[dim - 1]->getNumBins();
+
+    // For each bin of each master dimension, its contribution to the flat index in this histogram, or -1 if it is
+    // dropped. Master dimensions not matched by any dimension of this histogram contribute 0.
+    offset.assign(num_master_dims, std::vector<long>());
+    for (BinnerCont_t::size_type master_dim = 0; master_dim != num_master_dims; ++master_dim)
+      offset[master_dim].assign(master_binners[master_dim]->getNumBins(), 0);
+
+    std::vector<bool> matched(num_master_dims, false);
+    for (BinnerCont_t::size_type dim = 0; dim != num_dims; ++dim) {
+      BinnerCont_t::size_type master_dim = 0;
+      while (master_dim != num_master_dims && (matched[master_dim] ||
+        master_binners[master_dim]->getName() != m_binners[dim]->getName())) ++master_dim;
+      if (num_master_dims == master_dim)
+        throw std::runtime_error("Hist::addRebinned: master histogram has no dimension named \"" + m_binners[dim]->getName() +
+          "\"");
+      matched[master_dim] = true;
+
+      std::vector<long> bin_map = computeBinMap(*master_binners[master_dim], *m_binners[dim]);
+      for (std::vector<long>::size_type index = 0; index != bin_map.size(); ++index)
+        offset[master_dim][index] = 0 <= bin_map[index] ? bin_map[index] * stride[dim] : -1;
+    }
+  }
+
+  std::vector<long> Hist::computeBinMap(const Binner & fine, const Binner & coarse) {
+    // The bins of a folding binner are not intervals of the binned quantity.
+    if (fine.isFolded() || coarse.isFolded())
+      throw std::runtime_error("Hist::computeBinMap cannot rebin the bins of a folding binner");
+
+    // No coarse bin edge may fall inside a fine bin, up to round-off.
+    for (long coarse_index = 0; coarse_index != coarse.getNumBins(); ++coarse_index) {
+      Binner::Interval coarse_bin = coarse.getInterval(coarse_index);
+      double edge[] = { coarse_bin.begin(), coarse_bin.end() };
+      for (int ii = 0; ii != 2; ++ii) {
+        long fine_index = fine.computeIndex(edge[ii]);
+        if (0 > fine_index) continue;
+        Binner::Interval fine_bin = fine.getInterval(fine_index);
+        double tolerance = 1.e-6 * fine_bin.width();
+        if (edge[ii] - fine_bin.begin() > tolerance && fine_bin.end() - edge[ii] > tolerance) {
+          std::ostringstream os;
+          os << "Hist::computeBinMap: edge " << edge[ii] << " of " << coarse.getName() << " bin " << coarse_index <<
+            " falls inside bin [" << fine_bin.begin() << ", " << fine_bin.end() << ") of the finer binning";
+          throw std::runtime_error(os.str());
+        }
+      }
+    }
+
+    // Each fine bin is therefore either inside the coarse bin which contains its midpoint, or outside all coarse bins.
+    std::vector<long> bin_map(fine.getNumBins());
+    for (long fine_index = 0; fine_index != fine.getNumBins(); ++fine_index)
+      bin_map[fine_index] = coarse.computeIndex(fine.getInterval(fine_index).midpoint());
+    return bin_map;
+  }
+
 }
@@ -8,7 +8,7 @@
 
 namespace evtbin {
 
-  Hist1D::Hist1D(const Binner & binner): m_data(binner.getNumBins(), 0.) {
+  Hist1D::Hist1D(const Binner & binner): m_data(binner.getNumBins(), 0.), m_cursor(-1), m_index() {
     // Save binner:
     m_binners.resize(1, binner.clone());
   }
@@ -20,11 +20,14 @@ namespace evtbin {
   }
 
   void Hist1D::fillBin(double value, double weight) {
-    // Use the binner to determine the index for the data:
-    long index = m_binners[0]->computeIndex(value);
+    // Use the binner to determine the index for the data. Input is usually ordered, so start from the bin of the
+    // previous value:
+    long index = m_binners[0]->computeNextIndex(value, m_cursor);
 
     // Make sure index is valid:
     if (0 <= index) {
+      m_cursor = index;
+
       // Grow the container to accomodate this value, if necessary.
       if (Cont_t::size_type(index) >= m_data.size()) m_data.resize(index + 1);
 
@@ -33,4 +36,31 @@ namespace evtbin {
     }
   }
 
+  void Hist1D::fillBins(const std::vector<const double *> & columns, long num_values) {
+    if (0 >= num_values) return;
+    if (columns.empty()) throw std::logic_error("Hist1D::fillBins: no column to bin");
+
+    m_index.resize(num_values);
+    m_binners[0]->computeIndices(columns[0], num_values, &m_index[0]);
+    for (long ii = 0; ii != num_values; ++ii) {
+      long index = m_index[ii];
+      if (0 <= index) {
+        // Grow the container to accomodate this value, if necessary.
+        if (Cont_t::size_type(index) >= m_data.size()) m_data.resize(index + 1);
+        m_data[index] += 1.;
+      }
+    }
+  }
+
+  void Hist1D::getValues(std::vector<double> & values) const { values = m_data; }
+
+  void Hist1D::addValues(const std::vector<double> & values) {
+    if (values.size() != m_data.size()) throw std::logic_error("Hist1D::addValues: wrong number of values");
+    for (Cont_t::size_type index = 0; index != m_data.size(); ++index) m_data[index] += values[index];
+  }
+
+  void Hist1D::fillBinIndex(long index, double weight) {
+    if (0 <= index && Cont_t::size_type(index) < m_data.size()) m_data[index] += weight;
+  }
+
 }
@@ -8,7 +8,7 @@
 
 namespace evtbin {
 
-  Hist2D::Hist2D(const Binner & binner1, const Binner & binner2): m_data() {
+  Hist2D::Hist2D(const Binner & binner1, const Binner & binner2): m_data(), m_cursor(-1), m_index1(), m_index2() {
     // Set initial size of data array:
     m_data.resize(binner1.getNumBins());
     for (Cont_t::iterator itor = m_data.begin(); itor != m_data.end(); ++itor) {
@@ -29,8 +29,10 @@ namespace evtbin {
 
   void Hist2D::fillBin(double value1, double value2, double weight) {
     // Use the binners to determine the indices for the data:
-    long index1 = m_binners[0]->computeIndex(value1);
+    // Input is usually ordered by the first value (e.g. time), so start from the bin of the previous value.
+    long index1 = m_binners[0]->computeNextIndex(value1, m_cursor);
     long index2 = m_binners[1]->computeIndex(value2);
+    if (0 <= index1) m_cursor = index1;
 
     // Make sure indices are valid:
     if (0 <= index1 && 0 <= index2) {
@@ -43,6 +45,48 @@ namespace evtbin {
     }
   }
 
+  void Hist2D::fillBins(const std::vector<const double *> & columns, long num_values) {
+    if (0 >= num_values) return;
+    if (2 > columns.size()) throw std::logic_error("Hist2D::fillBins: too few columns for the histogram");
+
+    m_index1.resize(num_values);
+    m_index2.resize(num_values);
+    m_binners[0]->computeIndices(columns[0], num_values, &m_index1[0]);
+    m_binners[1]->computeIndices(columns[1], num_values, &m_index2[0]);
+    for (long ii = 0; ii != num_values; ++ii) {
+      long index1 = m_index1[ii];
+      long index2 = m_index2[ii];
+      if (0 <= index1 && 0 <= index2) {
+        // Grow the container to accomodate this value, if necessary.
+        if (Cont_t::size_type(index1) >= m_data.size()) m_data.resize(index1 + 1);
+        if (Cont_t::size_type(index2) >= m_data[index1].size()) m_data[index1].resize(index2 + 1);
+        m_data[index1][index2] += 1.;
+      }
+    }
+  }
+
+  void Hist2D::getValues(std::vector<double> & values) const {
+    Cont_t::size_type size0 = m_binners[0]->getNumBins();
+    Cont_t::size_type size1 = m_binners[1]->getNumBins();
+    values.resize(size0 * size1);
+    for (Cont_t::size_type index0 = 0; index0 != size0; ++index0) {
+      for (Cont_t::size_type index1 = 0; index1 != size1; ++index1) {
+        values[index0 * size1 + index1] = m_data[index0][index1];
+      }
+    }
+  }
+
+  void Hist2D::addValues(const std::vector<double> & values) {
+    Cont_t::size_type size0 = m_binners[0]->getNumBins();
+    Cont_t::size_type size1 = m_binners[1]->getNumBins();
+    if (values.size() != size0 * size1) throw std::logic_error("Hist2D::addValues: wrong number of values");
+    for (Cont_t::size_type index0 = 0; index0 != size0; ++index0) {
+      for (Cont_t::size_type index1 = 0; index1 != size1; ++index1) {
+        m_data[index0][index1] += values[index0 * size1 + index1];
+      }
+    }
+  }
+
   void Hist2D::getImage(std::vector<float> & image) const {
     if (!m_data.empty()) {
       // Get the sizes of the 2 dimensions from the binners.
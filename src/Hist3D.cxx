@@ -50,6 +50,34 @@ namespace evtbin {
     }
   }
 
+  void Hist3D::getValues(std::vector<double> & values) const {
+    Cont_t::size_type size0 = m_binners[0]->getNumBins();
+    Cont_t::size_type size1 = m_binners[1]->getNumBins();
+    Cont_t::size_type size2 = m_binners[2]->getNumBins();
+    values.resize(size0 * size1 * size2);
+    for (Cont_t::size_type index0 = 0; index0 != size0; ++index0) {
+      for (Cont_t::size_type index1 = 0; index1 != size1; ++index1) {
+        for (Cont_t::size_type index2 = 0; index2 != size2; ++index2) {
+          values[(index0 * size1 + index1) * size2 + index2] = m_data[index0][index1][index2];
+        }
+      }
+    }
+  }
+
+  void Hist3D::addValues(const std::vector<double> & values) {
+    Cont_t::size_type size0 = m_binners[0]->getNumBins();
+    Cont_t::size_type size1 = m_binners[1]->getNumBins();
+    Cont_t::size_type size2 = m_binners[2]->getNumBins();
+    if (values.size() != size0 * size1 * size2) throw std::logic_error("Hist3D::addValues: wrong number of values");
+    for (Cont_t::size_type index0 = 0; index0 != size0; ++index0) {
+      for (Cont_t::size_type index1 = 0; index1 != size1; ++index1) {
+        for (Cont_t::size_type index2 = 0; index2 != size2; ++index2) {
+          m_data[index0][index1][index2] += values[(index0 * size1 + index1) * size2 + index2];
+        }
+      }
+    }
+  }
+
   void Hist3D::getImage(std::vector<float> & image) const {
     if (!m_data.empty()) {
       // Get the sizes of the 3 dimensions from the binners.
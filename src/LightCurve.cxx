@@ -2,25 +2,71 @@
     \brief Encapsulation of a Light curve, with methods to read/write using tip.
     \author James Peachey, HEASARC
 */
+#include <algorithm>
+#include <cmath>
 #include <memory>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 #include "evtbin/Binner.h"
+#include "evtbin/HealpixBinner.h"
 #include "evtbin/LightCurve.h"
+#include "evtbin/MappedEventTable.h"
 
 #include "st_facilities/Env.h"
 
 #include "facilities/commonUtilities.h"
 
+#include "tip/Header.h"
 #include "tip/IFileSvc.h"
 #include "tip/Table.h"
 
+namespace {
+  const double s_pi = 3.14159265358979323846;
+  const double s_deg_to_rad = s_pi / 180.;
+
+  // Number of events matched to apertures at a time.
+  const long s_batch_size = 4096;
+
+  // Highest order of the HEALPix pixel lookup used to match events to apertures.
+  const int s_max_lookup_order = 8;
+
+  // Side of a HEALPix pixel for nside 1, in radians: the square root of the area of one of its 12 pixels.
+  const double s_pixel_side = std::sqrt(s_pi / 3.);
+
+  // The bins of a folding binner are in phase, not time, so rename the TIME and TIMEDEL columns of the light curve
+  // template, which are its first two columns, to PHASE and PHASEDEL, which have no unit.
+  void renamePhaseColumns(tip::Header & header) {
+    header["TTYPE1"].set("PHASE");
+    header["TTYPE1"].setComment("Phase of the bin center");
+    header["TUNIT1"].set("");
+    header["TTYPE2"].set("PHASEDEL");
+    header["TTYPE2"].setComment("Bin size in phase");
+    header["TUNIT2"].set("");
+  }
+
+  // Compute the unit vector of the given direction, in degrees.
+  void toUnitVector(double ra, double dec, double * dir) {
+    double cos_dec = std::cos(dec * s_deg_to_rad);
+    dir[0] = cos_dec * std::cos(ra * s_deg_to_rad);
+    dir[1] = cos_dec * std::sin(ra * s_deg_to_rad);
+    dir[2] = std::sin(dec * s_deg_to_rad);
+  }
+}
+
 namespace evtbin {
 
   LightCurve::LightCurve(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
     const std::string & sc_table, const Binner & binner, const Gti & gti): DataProduct(event_file, event_table, gti),
-    m_hist(binner) {
+    m_sc_file(sc_file), m_sc_table(sc_table), m_hist(binner), m_bin_exposure(false), m_apertures(), m_ra_field(),
+    m_dec_field(), m_aperture_hist(), m_aperture_dir(), m_aperture_cos_radius(), m_aperture_binner(), m_pixel_first(),
+    m_pixel_apertures() {
     m_hist_ptr = &m_hist;
+    m_use_mapped_input = true;
 
     // Collect any/all needed keywords from the primary extension.
     harvestKeywords(m_event_file_cont);
@@ -37,13 +83,208 @@ namespace evtbin {
     // Adjust the GTI based on binning information.
     adjustGti(&binner);
 
+    // Only events inside the range of the time binner need to be read.
+    if (0 < binner.getNumBins()) setTimeWindow(binner.getName(), binner.getDomain().begin(), binner.getDomain().end());
+
     // Update tstart/tstop etc.
     adjustTimeKeywords(sc_file, sc_table, &binner);
   }
 
-  LightCurve::~LightCurve() throw() {}
+  LightCurve::~LightCurve() throw() {
+    for (std::vector<Hist1D *>::reverse_iterator itor = m_aperture_hist.rbegin(); itor != m_aperture_hist.rend(); ++itor)
+      delete *itor;
+  }
+
+  void LightCurve::binInput() {
+    DataProduct::binInput();
+  }
+
+  void LightCurve::binInput(tip::Table::ConstIterator begin, tip::Table::ConstIterator end) {
+    if (m_apertures.empty()) {
+      DataProduct::binInput(begin, end);
+      return;
+    }
+
+    // Match events to apertures one batch at a time.
+    std::string time_field = m_hist.getBinners().at(0)->getName();
+    std::vector<double> time(s_batch_size);
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    long num_events = 0;
+    for (tip::Table::ConstIterator itor = begin; itor != end; ++itor) {
+      time[num_events] = (*itor)[time_field].get();
+      ra[num_events] = (*itor)[m_ra_field].get();
+      dec[num_events] = (*itor)[m_dec_field].get();
+      if (s_batch_size == ++num_events) {
+        fillApertures(&time[0], &ra[0], &dec[0], num_events);
+        num_events = 0;
+      }
+    }
+    fillApertures(&time[0], &ra[0], &dec[0], num_events);
+  }
+
+  void LightCurve::binInput(const MappedEventTable & table, long first_record, long last_record) {
+    if (m_apertures.empty()) {
+      DataProduct::binInput(table, first_record, last_record);
+      return;
+    }
+
+    std::string time_field = m_hist.getBinners().at(0)->getName();
+    std::vector<double> time(s_batch_size);
+    std::vector<double> ra(s_batch_size);
+    std::vector<double> dec(s_batch_size);
+    for (long batch_begin = first_record; batch_begin < last_record; batch_begin += s_batch_size) {
+      long num_events = std::min(s_batch_size, last_record - batch_begin);
+      table.readColumn(time_field, batch_begin, num_events, &time[0]);
+      table.readColumn(m_ra_field, batch_begin, num_events, &ra[0]);
+      table.readColumn(m_dec_field, batch_begin, num_events, &dec[0]);
+      fillApertures(&time[0], &ra[0], &dec[0], num_events);
+    }
+  }
+
+  void LightCurve::setApertures(const ApertureCont_t & apertures, const std::string & ra_field, const std::string & dec_field) {
+    // Check every aperture before changing anything, so that a bad one leaves the light curve as it was.
+    double min_radius = 180.;
+    double max_radius = 0.;
+    for (ApertureCont_t::const_iterator itor = apertures.begin(); itor != apertures.end(); ++itor) {
+      if (!(0. < itor->getRadius() && 180. >= itor->getRadius())) {
+        std::ostringstream os;
+        os << "LightCurve::setApertures: aperture " << itor->getName() << " has radius " << itor->getRadius() <<
+          ", which is not in the range (0, 180] degrees";
+        throw std::runtime_error(os.str());
+      }
+      min_radius = std::min(min_radius, itor->getRadius());
+      max_radius = std::max(max_radius, itor->getRadius());
+    }
+
+    // Direction and size of each aperture.
+    std::vector<double> aperture_dir;
+    std::vector<double> aperture_cos_radius;
+    std::vector<std::pair<double, long> > aperture_dec;
+    for (ApertureCont_t::size_type index = 0; index != apertures.size(); ++index) {
+      const Aperture & aperture(apertures[index]);
+      double dir[3];
+      toUnitVector(aperture.getRa(), aperture.getDec(), dir);
+      aperture_dir.insert(aperture_dir.end(), dir, dir + 3);
+      aperture_cos_radius.push_back(std::cos(aperture.getRadius() * s_deg_to_rad));
+      aperture_dec.push_back(std::make_pair(aperture.getDec(), long(index)));
+    }
+
+    std::unique_ptr<HealpixBinner> aperture_binner;
+    std::vector<long> pixel_first;
+    std::vector<long> pixel_apertures;
+    if (!apertures.empty()) {
+      // The pixels of the lookup are about as large as the smallest aperture, so most events have few candidates.
+      int order = 0;
+      while (order < s_max_lookup_order && s_pixel_side / (2 << order) >= min_radius * s_deg_to_rad) ++order;
+      aperture_binner.reset(new HealpixBinner(order, RING, false, "", "APERTURE"));
+      const Healpix_Base & hpx = aperture_binner->healpix();
+      long num_pixels = hpx.Npix();
+
+      // Generous bound on the distance from the center of a pixel to any point inside it, in radians.
+      double pixel_radius = 2. * s_pixel_side / hpx.Nside();
+
+      // For each pixel, list the apertures which may overlap it: those whose centers are within their radius plus the
+      // pixel radius of the pixel center. Sorting the apertures by declination limits the search to a band.
+      std::sort(aperture_dec.begin(), aperture_dec.end());
+      double band = max_radius + pixel_radius / s_deg_to_rad;
+      pixel_first.reserve(num_pixels + 1);
+      pixel_first.push_back(0);
+      for (long pixel = 0; pixel != num_pixels; ++pixel) {
+        pointing center = hpx.pix2ang(pixel);
+        double center_ra = center.phi / s_deg_to_rad;
+        double center_dec = 90. - center.theta / s_deg_to_rad;
+        double center_dir[3];
+        toUnitVector(center_ra, center_dec, center_dir);
+
+        std::vector<std::pair<double, long> >::const_iterator itor =
+          std::lower_bound(aperture_dec.begin(), aperture_dec.end(), std::make_pair(center_dec - band, -1l));
+        for (; itor != aperture_dec.end() && itor->first <= center_dec + band; ++itor) {
+          long index = itor->second;
+          double limit = apertures[index].getRadius() * s_deg_to_rad + pixel_radius;
+          const double * dir = &aperture_dir[3 * index];
+          double cos_dist = dir[0] * center_dir[0] + dir[1] * center_dir[1] + dir[2] * center_dir[2];
+          if (s_pi <= limit || std::cos(limit) <= cos_dist) pixel_apertures.push_back(index);
+        }
+        pixel_first.push_back(pixel_apertures.size());
+      }
+    }
+
+    // The apertures and fields themselves, and one light curve per aperture.
+    ApertureCont_t new_apertures(apertures);
+    std::string new_ra_field(ra_field);
+    std::string new_dec_field(dec_field);
+    std::vector<Hist1D *> aperture_hist;
+    try {
+      for (ApertureCont_t::size_type index = 0; index != apertures.size(); ++index)
+        aperture_hist.push_back(new Hist1D(*m_hist.getBinners().at(0)));
+    } catch (...) {
+      for (std::vector<Hist1D *>::reverse_iterator itor = aperture_hist.rbegin(); itor != aperture_hist.rend(); ++itor)
+        delete *itor;
+      throw;
+    }
+
+    // Swap in the new apertures, and delete the light curves of the old ones.
+    m_apertures.swap(new_apertures);
+    m_ra_field.swap(new_ra_field);
+    m_dec_field.swap(new_dec_field);
+    m_aperture_hist.swap(aperture_hist);
+    m_aperture_dir.swap(aperture_dir);
+    m_aperture_cos_radius.swap(aperture_cos_radius);
+    m_aperture_binner.swap(aperture_binner);
+    m_pixel_first.swap(pixel_first);
+    m_pixel_apertures.swap(pixel_apertures);
+    for (std::vector<Hist1D *>::reverse_iterator itor = aperture_hist.rbegin(); itor != aperture_hist.rend(); ++itor)
+      delete *itor;
+  }
+
+
+  const LightCurve::ApertureCont_t & LightCurve::getApertures() const { return m_apertures; }
+
+  const Hist1D & LightCurve::getApertureHist(ApertureCont_t::size_type index) const { return *m_aperture_hist.at(index); }
+
+  void LightCurve::fillApertures(const double * time, const double * ra, const double * dec, long num_events) {
+    if (0 >= num_events) return;
+
+    // Find the lookup pixel of every event in the batch at once.
+    std::vector<long> pixel(num_events);
+    m_aperture_binner->computeIndices(ra, dec, num_events, &pixel[0]);
+
+    const Binner & binner = *m_hist.getBinners().at(0);
+    for (long ii = 0; ii != num_events; ++ii) {
+      if (0 > pixel[ii]) continue;
+      long first = m_pixel_first[pixel[ii]];
+      long last = m_pixel_first[pixel[ii] + 1];
+      if (first == last) continue;
+
+      long time_index = binner.computeIndex(time[ii]);
+      if (0 > time_index) continue;
+
+      // Count the event in each candidate aperture which really contains it.
+      double dir[3];
+      toUnitVector(ra[ii], dec[ii], dir);
+      for (long candidate = first; candidate != last; ++candidate) {
+        long index = m_pixel_apertures[candidate];
+        const double * aperture_dir = &m_aperture_dir[3 * index];
+        double cos_dist = aperture_dir[0] * dir[0] + aperture_dir[1] * dir[1] + aperture_dir[2] * dir[2];
+        if (m_aperture_cos_radius[index] <= cos_dist) m_aperture_hist[index]->fillBinIndex(time_index);
+      }
+    }
+  }
 
   void LightCurve::writeOutput(const std::string & creator, const std::string & out_file) const {
+    if (!m_apertures.empty()) {
+      // Standard file creation from base class.
+      createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatApertureLightCurveTemplate"));
+
+      // Write the light curves and apertures.
+      writeApertures(out_file);
+
+      // Write GTI extension.
+      writeGti(out_file);
+      return;
+    }
+
     // Standard file creation from base class.
     createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatLightCurveTemplate"));
 
@@ -60,6 +301,24 @@ namespace evtbin {
     // The binner from the histogram will be used below.
     const Binner * binner = m_hist.getBinners().at(0);
 
+    // Ontime and exposure of each bin, if requested.
+    std::vector<double> ontime;
+    std::vector<double> exposure;
+    if (m_bin_exposure) {
+      computeBinExposure(m_sc_file, m_sc_table, *binner, ontime, exposure);
+
+      // For GBM data, correct the exposure for deadtime, as is done for the EXPOSURE keyword.
+      KeyValuePairCont_t::iterator found = m_key_value_pairs.find("EVT_DEAD");
+      if (m_key_value_pairs.end() != found && !found->second.empty()) {
+        double deadtime;
+        found->second.getValue(deadtime);
+        for (long index = 0; index != binner->getNumBins(); ++index) exposure[index] = ontime[index] - m_hist[index] * deadtime;
+      }
+
+      output_table->appendField("ONTIME", std::string("D"));
+      output_table->appendField("EXPOSURE", std::string("D"));
+    }
+
     // Resize table: number of records in light curve must == the number of bins in the binner.
     output_table->setNumRecords(binner->getNumBins());
 
@@ -70,10 +329,11 @@ namespace evtbin {
     double total_counts=0;
     double total_error_channel=0;
     for (long index = 0; index != binner->getNumBins(); ++index, ++table_itor) {
-      // Midpoint time of each bin, from the binner.
+      // Midpoint time of each bin, from the binner. For a folding binner this is the midpoint phase, written to the
+      // same column, which is renamed below.
       (*table_itor)["TIME"].set(binner->getInterval(index).midpoint());
 
-      // Width of each bin, from the binner.
+      // Width of each bin, from the binner (in phase for a folding binner).
       (*table_itor)["TIMEDEL"].set(binner->getBinWidth(index));
 
       // Number of counts in each bin, from the histogram.
@@ -84,8 +344,16 @@ namespace evtbin {
 
       //Statistical Error
       (*table_itor)["ERROR"].set(calcStatErr(m_hist[index]));
+
+      if (m_bin_exposure) {
+        (*table_itor)["ONTIME"].set(ontime[index]);
+        (*table_itor)["EXPOSURE"].set(exposure[index]);
+      }
     }
 
+    // Bins of a folding binner hold phases.
+    if (binner->isFolded()) renamePhaseColumns(output_table->getHeader());
+
     //Check for and if needed make gbm specific correction for deadtime.
     gbmExposure(total_counts, total_error_channel, out_file);
 
@@ -93,4 +361,105 @@ namespace evtbin {
     writeGti(out_file);
   }
 
+  void LightCurve::writeApertures(const std::string & out_file) const {
+    // Open RATE extension of output light curve file.
+    std::unique_ptr<tip::Table> output_table(tip::IFileSvc::instance().editTable(out_file, "RATE"));
+
+    // Write DSS keywords to preserve cut information.
+    writeDssKeywords(output_table->getHeader());
+
+    // Write the history that came from the events extension.
+    writeHistory(*output_table, "EVENTS");
+
+    const Binner * binner = m_hist.getBinners().at(0);
+    long num_apertures = m_apertures.size();
+
+    // Ontime and exposure of each bin, if requested. These are the same for every aperture.
+    std::vector<double> ontime;
+    std::vector<double> exposure;
+    if (m_bin_exposure) {
+      computeBinExposure(m_sc_file, m_sc_table, *binner, ontime, exposure);
+      output_table->appendField("ONTIME", std::string("D"));
+      output_table->appendField("EXPOSURE", std::string("D"));
+    }
+
+    // Need output table iterator.
+    tip::Table::Iterator table_itor = output_table->begin();
+
+    // Resize counts and error fields: one element per aperture.
+    (*table_itor)["COUNTS"].setNumElements(num_apertures);
+    (*table_itor)["ERROR"].setNumElements(num_apertures);
+
+    // Resize table: number of records in light curve must == the number of bins in the binner.
+    output_table->setNumRecords(binner->getNumBins());
+
+    std::vector<double> counts(num_apertures);
+    std::vector<double> stat_err(num_apertures);
+    for (long index = 0; index != binner->getNumBins(); ++index, ++table_itor) {
+      // Midpoint time and width of each bin, from the binner.
+      (*table_itor)["TIME"].set(binner->getInterval(index).midpoint());
+      (*table_itor)["TIMEDEL"].set(binner->getBinWidth(index));
+
+      // Number of counts in each aperture, and their statistical errors.
+      for (long aperture = 0; aperture != num_apertures; ++aperture) counts[aperture] = (*m_aperture_hist[aperture])[index];
+      calcStatErr(&counts[0], num_apertures, &stat_err[0]);
+      (*table_itor)["COUNTS"].set(&counts[0], &counts[0] + num_apertures, 0);
+      (*table_itor)["ERROR"].set(&stat_err[0], &stat_err[0] + num_apertures, 0);
+
+      if (m_bin_exposure) {
+        (*table_itor)["ONTIME"].set(ontime[index]);
+        (*table_itor)["EXPOSURE"].set(exposure[index]);
+      }
+    }
+
+    // Bins of a folding binner hold phases.
+    if (binner->isFolded()) renamePhaseColumns(output_table->getHeader());
+
+    // Write the apertures, in the same order as the elements of the COUNTS and ERROR vectors.
+    std::unique_ptr<tip::Table> aperture_table(tip::IFileSvc::instance().editTable(out_file, "APERTURES"));
+    aperture_table->setNumRecords(num_apertures);
+    tip::Table::Iterator aperture_itor = aperture_table->begin();
+    for (ApertureCont_t::const_iterator itor = m_apertures.begin(); itor != m_apertures.end(); ++itor, ++aperture_itor) {
+      (*aperture_itor)["NAME"].set(itor->getName());
+      (*aperture_itor)["RA"].set(itor->getRa());
+      (*aperture_itor)["DEC"].set(itor->getDec());
+      (*aperture_itor)["RADIUS"].set(itor->getRadius());
+    }
+  }
+
+  void LightCurve::setBinExposure(bool bin_exposure) { m_bin_exposure = bin_exposure; }
+
+  const Binner * LightCurve::getTimeBinner() const { return m_hist.getBinners().at(0); }
+
+  void LightCurve::addCounts(const Hist1D & hist) {
+    long num_bins = m_hist.getBinners().at(0)->getNumBins();
+    if (hist.end() - hist.begin() != num_bins) {
+      std::ostringstream os;
+      os << "LightCurve::addCounts: cannot add " << hist.end() - hist.begin() << " bins to a light curve with " << num_bins <<
+        " bins";
+      throw std::logic_error(os.str());
+    }
+    for (long index = 0; index != num_bins; ++index) m_hist.fillBinIndex(index, hist[index]);
+  }
+
+  void LightCurve::addCounts(const Hist & hist) {
+    long num_bins = m_hist.getBinners().at(0)->getNumBins();
+    long num_time_bins = hist.getBinners().at(0)->getNumBins();
+    if (num_time_bins != num_bins) {
+      std::ostringstream os;
+      os << "LightCurve::addCounts: cannot add " << num_time_bins << " time bins to a light curve with " << num_bins <<
+        " bins";
+      throw std::logic_error(os.str());
+    }
+
+    // The index of the last dimension varies fastest, so the values of each time bin are contiguous.
+    std::vector<double> values;
+    hist.getValues(values);
+    std::vector<double>::size_type bin_size = 0 == num_bins ? 0 : values.size() / num_bins;
+    for (long index = 0; index != num_bins; ++index) {
+      std::vector<double>::const_iterator bin_begin = values.begin() + index * bin_size;
+      m_hist.fillBinIndex(index, std::accumulate(bin_begin, bin_begin + bin_size, 0.));
+    }
+  }
+
 }
@@ -15,11 +15,6 @@ namespace evtbin {
     m_bin_size(bin_size),
     m_num_bins(long(ceil((interval_end - interval_begin)/bin_size))) {}
 
-  long LinearBinner::computeIndex(double value) const {
-    if (value < m_interval_begin || value >= m_interval_end) return -1;
-    return long((value - m_interval_begin) / m_bin_size);
-  }
-
   long LinearBinner::getNumBins() const { return m_num_bins; }
 
   Binner::Interval LinearBinner::getInterval(long index) const {
@@ -14,11 +14,6 @@ namespace evtbin {
     m_interval_end(interval_end),
     m_num_bins(num_bins) {}
 
-  long LogBinner::computeIndex(double value) const {
-    if (value < m_interval_begin || value >= m_interval_end) return -1;
-    return long(m_num_bins * log(double(value) / m_interval_begin) / log(double(m_interval_end) / m_interval_begin));
-  }
-
   long LogBinner::getNumBins() const { return m_num_bins; }
 
   Binner::Interval LogBinner::getInterval(long index) const {
@@ -0,0 +1,354 @@
+/** \file MappedEventTable.cxx
+    \brief Read-only access to the columns of an uncompressed FITS binary table through a memory mapping of the file.
+*/
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "evtbin/MappedEventTable.h"
+
+namespace {
+
+  typedef std::map<std::string, std::string> CardCont_t;
+
+  const std::size_t s_block_size = 2880;
+  const std::size_t s_card_size = 80;
+
+  std::string toUpper(const std::string & value) {
+    std::string result(value);
+    std::transform(result.begin(), result.end(), result.begin(), ::toupper);
+    return result;
+  }
+
+  std::string trim(const std::string & value) {
+    std::string::size_type first = value.find_first_not_of(' ');
+    if (std::string::npos == first) return std::string();
+    std::string::size_type last = value.find_last_not_of(' ');
+    return value.substr(first, last - first + 1);
+  }
+
+  std::size_t padToBlock(std::size_t size) { return (size + s_block_size - 1) / s_block_size * s_block_size; }
+
+  // Parse the value field of a single header card. String values are returned without quotes.
+  std::string parseValue(const char * card) {
+    std::string field(card + 10, s_card_size - 10);
+    std::string::size_type pos = field.find_first_not_of(' ');
+    if (std::string::npos == pos) return std::string();
+    if ('\'' == field[pos]) {
+      std::string value;
+      for (++pos; pos < field.size(); ++pos) {
+        if ('\'' == field[pos]) {
+          // Doubled quote is an escaped quote, anything else terminates the string.
+          if (pos + 1 < field.size() && '\'' == field[pos + 1]) { value += '\''; ++pos; }
+          else break;
+        } else {
+          value += field[pos];
+        }
+      }
+      return trim(value);
+    }
+    return trim(field.substr(pos, field.find('/', pos) - pos));
+  }
+
+  // Parse one header starting at the given address. Returns the number of bytes occupied by the header.
+  std::size_t parseHeader(const unsigned char * begin, std::size_t available, CardCont_t & cards) {
+    cards.clear();
+    for (std::size_t offset = 0; offset + s_card_size <= available; offset += s_card_size) {
+      const char * card = reinterpret_cast<const char *>(begin + offset);
+      std::string key = trim(std::string(card, 8));
+      if ("END" == key) return padToBlock(offset + s_card_size);
+      if ('=' == card[8] && ' ' == card[9]) cards[key] = parseValue(card);
+    }
+    throw std::runtime_error("MappedEventTable: header is not terminated by an END card");
+  }
+
+  long getLong(const CardCont_t & cards, const std::string & key, long default_value) {
+    CardCont_t::const_iterator found = cards.find(key);
+    if (cards.end() == found || found->second.empty()) return default_value;
+    return std::atol(found->second.c_str());
+  }
+
+  double getDouble(const CardCont_t & cards, const std::string & key, double default_value) {
+    CardCont_t::const_iterator found = cards.find(key);
+    if (cards.end() == found || found->second.empty()) return default_value;
+    std::string value(found->second);
+    // FITS allows a 'D' exponent.
+    std::replace(value.begin(), value.end(), 'D', 'E');
+    return std::atof(value.c_str());
+  }
+
+  std::string getString(const CardCont_t & cards, const std::string & key) {
+    CardCont_t::const_iterator found = cards.find(key);
+    return cards.end() == found ? std::string() : found->second;
+  }
+
+  std::string indexedKey(const std::string & root, long index) {
+    std::ostringstream os;
+    os << root << index;
+    return os.str();
+  }
+
+  // Number of bytes occupied by one element of the given TFORM type code, or 0 if unknown.
+  std::size_t elementSize(char type) {
+    switch (type) {
+      case 'L': case 'B': case 'A': return 1;
+      case 'I': return 2;
+      case 'J': case 'E': return 4;
+      case 'K': case 'D': case 'C': case 'P': return 8;
+      case 'M': case 'Q': return 16;
+      default: return 0;
+    }
+  }
+
+  // Decoding of big-endian values. The byte shuffles are written so that compilers reduce them to a single
+  // byte swap instruction, and loops over them vectorize.
+  inline unsigned long long load64(const unsigned char * p) {
+    return (static_cast<unsigned long long>(p[0]) << 56) | (static_cast<unsigned long long>(p[1]) << 48) |
+      (static_cast<unsigned long long>(p[2]) << 40) | (static_cast<unsigned long long>(p[3]) << 32) |
+      (static_cast<unsigned long long>(p[4]) << 24) | (static_cast<unsigned long long>(p[5]) << 16) |
+      (static_cast<unsigned long long>(p[6]) << 8) | static_cast<unsigned long long>(p[7]);
+  }
+
+  inline unsigned int load32(const unsigned char * p) {
+    return (static_cast<unsigned int>(p[0]) << 24) | (static_cast<unsigned int>(p[1]) << 16) |
+      (static_cast<unsigned int>(p[2]) << 8) | static_cast<unsigned int>(p[3]);
+  }
+
+  inline unsigned short load16(const unsigned char * p) {
+    return static_cast<unsigned short>((p[0] << 8) | p[1]);
+  }
+
+  inline double decode(char type, const unsigned char * p) {
+    switch (type) {
+      case 'D': { unsigned long long raw = load64(p); double value; std::memcpy(&value, &raw, sizeof(value)); return value; }
+      case 'E': { unsigned int raw = load32(p); float value; std::memcpy(&value, &raw, sizeof(value)); return value; }
+      case 'K': return static_cast<double>(static_cast<long long>(load64(p)));
+      case 'J': return static_cast<int>(load32(p));
+      case 'I': return static_cast<short>(load16(p));
+      case 'B': return *p;
+      default: return 0.;
+    }
+  }
+
+  template <char Type>
+  void decodeColumn(const unsigned char * data, std::size_t stride, long num_records, double scale, double zero,
+    double * dest) {
+    if (1. == scale && 0. == zero) {
+      for (long index = 0; index != num_records; ++index) dest[index] = decode(Type, data + index * stride);
+    } else {
+      for (long index = 0; index != num_records; ++index) dest[index] = zero + scale * decode(Type, data + index * stride);
+    }
+  }
+
+}
+
+namespace evtbin {
+
+  bool MappedEventTable::isMappable(const std::string & file_name) {
+#ifdef WIN32
+    return false;
+#else
+    // Reject anything tip/cfitsio would have to interpret: remote files, extended file name syntax and compression.
+    if (std::string::npos != file_name.find("://") || std::string::npos != file_name.find_first_of("[]")) return false;
+    std::string name = toUpper(trim(file_name));
+    static const char * suffixes[] = { ".GZ", ".Z", ".BZ2", ".ZIP" };
+    for (std::size_t index = 0; index != sizeof(suffixes) / sizeof(const char *); ++index) {
+      std::string suffix(suffixes[index]);
+      if (name.size() > suffix.size() && 0 == name.compare(name.size() - suffix.size(), suffix.size(), suffix)) return false;
+    }
+    struct stat status;
+    return 0 == stat(file_name.c_str(), &status) && S_ISREG(status.st_mode);
+#endif
+  }
+
+  MappedEventTable::MappedEventTable(const std::string & file_name, const std::string & ext_name): m_columns(), m_map(0),
+    m_map_size(0), m_data(0), m_row_width(0), m_num_records(0) {
+#ifdef WIN32
+    throw std::runtime_error("MappedEventTable: memory mapped input is not supported on this platform");
+#else
+    int fd = open(file_name.c_str(), O_RDONLY);
+    if (0 > fd) throw std::runtime_error("MappedEventTable: cannot open file " + file_name);
+
+    struct stat status;
+    if (0 != fstat(fd, &status) || 0 >= status.st_size) {
+      close(fd);
+      throw std::runtime_error("MappedEventTable: cannot determine size of file " + file_name);
+    }
+    m_map_size = status.st_size;
+
+    void * map = mmap(0, m_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (MAP_FAILED == map) throw std::runtime_error("MappedEventTable: cannot map file " + file_name);
+    m_map = static_cast<const unsigned char *>(map);
+
+    try {
+      parse(file_name, ext_name);
+    } catch (...) {
+      munmap(const_cast<unsigned char *>(m_map), m_map_size);
+      throw;
+    }
+
+    // Table is read front to back.
+    madvise(const_cast<unsigned char *>(m_map), m_map_size, MADV_SEQUENTIAL);
+#endif
+  }
+
+  MappedEventTable::~MappedEventTable() throw() {
+#ifndef WIN32
+    if (0 != m_map) munmap(const_cast<unsigned char *>(m_map), m_map_size);
+#endif
+  }
+
+  long MappedEventTable::getNumRecords() const { return m_num_records; }
+
+  bool MappedEventTable::hasField(const std::string & field_name) const {
+    ColumnCont_t::const_iterator found = m_columns.find(toUpper(field_name));
+    return m_columns.end() != found && 1 == found->second.m_repeat && 0 != elementSize(found->second.m_type) &&
+      std::string::npos != std::string("BIJKED").find(found->second.m_type);
+  }
+
+  void MappedEventTable::readColumn(const std::string & field_name, long first_record, long num_records, double * dest) const {
+    const Column & column = getColumn(field_name);
+    if (0 > first_record || 0 > num_records || m_num_records < first_record + num_records) {
+      std::ostringstream os;
+      os << "MappedEventTable::readColumn: records [" << first_record << ", " << first_record + num_records <<
+        ") are outside the table, which has " << m_num_records << " records";
+      throw std::logic_error(os.str());
+    }
+
+    const unsigned char * data = m_data + first_record * m_row_width + column.m_offset;
+    switch (column.m_type) {
+      case 'D': decodeColumn<'D'>(data, m_row_width, num_records, column.m_scale, column.m_zero, dest); break;
+      case 'E': decodeColumn<'E'>(data, m_row_width, num_records, column.m_scale, column.m_zero, dest); break;
+      case 'K': decodeColumn<'K'>(data, m_row_width, num_records, column.m_scale, column.m_zero, dest); break;
+      case 'J': decodeColumn<'J'>(data, m_row_width, num_records, column.m_scale, column.m_zero, dest); break;
+      case 'I': decodeColumn<'I'>(data, m_row_width, num_records, column.m_scale, column.m_zero, dest); break;
+      case 'B': decodeColumn<'B'>(data, m_row_width, num_records, column.m_scale, column.m_zero, dest); break;
+      default: break;
+    }
+  }
+
+  bool MappedEventTable::hasBitField(const std::string & field_name) const {
+    ColumnCont_t::const_iterator found = m_columns.find(toUpper(field_name));
+    if (m_columns.end() == found) return false;
+    const Column & column = found->second;
+    if ('X' == column.m_type) return 0 < column.m_repeat && long(8 * sizeof(unsigned long)) >= column.m_repeat;
+    return 1 == column.m_repeat && std::string::npos != std::string("BIJK").find(column.m_type);
+  }
+
+  void MappedEventTable::readBits(const std::string & field_name, long first_record, long num_records,
+    unsigned long * dest) const {
+    if (!hasBitField(field_name))
+      throw std::runtime_error("MappedEventTable: field " + field_name + " is not a bit field of the table");
+    if (0 > first_record || 0 > num_records || m_num_records < first_record + num_records) {
+      std::ostringstream os;
+      os << "MappedEventTable::readBits: records [" << first_record << ", " << first_record + num_records <<
+        ") are outside the table, which has " << m_num_records << " records";
+      throw std::logic_error(os.str());
+    }
+
+    const Column & column = m_columns.find(toUpper(field_name))->second;
+    const unsigned char * data = m_data + first_record * m_row_width + column.m_offset;
+    if ('X' == column.m_type) {
+      // Bits are packed from the most significant bit of the first byte, and padded at the end of the last byte.
+      long num_bytes = (column.m_repeat + 7) / 8;
+      long padding = 8 * num_bytes - column.m_repeat;
+      for (long index = 0; index != num_records; ++index) {
+        const unsigned char * p = data + index * m_row_width;
+        unsigned long value = 0;
+        for (long byte = 0; byte != num_bytes; ++byte) value = (value << 8) | p[byte];
+        dest[index] = value >> padding;
+      }
+    } else {
+      for (long index = 0; index != num_records; ++index)
+        dest[index] = static_cast<unsigned long>(decode(column.m_type, data + index * m_row_width) * column.m_scale + column.m_zero);
+    }
+  }
+
+  double MappedEventTable::readValue(const std::string & field_name, long record) const {
+    double value = 0.;
+    readColumn(field_name, record, 1, &value);
+    return value;
+  }
+
+  const MappedEventTable::Column & MappedEventTable::getColumn(const std::string & field_name) const {
+    if (!hasField(field_name))
+      throw std::runtime_error("MappedEventTable: field " + field_name + " is not a scalar numeric column of the table");
+    return m_columns.find(toUpper(field_name))->second;
+  }
+
+  void MappedEventTable::parse(const std::string & file_name, const std::string & ext_name) {
+    std::string target = toUpper(trim(ext_name));
+    std::size_t offset = 0;
+    bool primary = true;
+    CardCont_t cards;
+    while (offset < m_map_size) {
+      std::size_t header_size = parseHeader(m_map + offset, m_map_size - offset, cards);
+
+      // Size of the data unit is |BITPIX| * GCOUNT * (PCOUNT + NAXIS1 * ... * NAXISn) / 8.
+      long naxis = getLong(cards, "NAXIS", 0);
+      std::size_t num_elements = 0 < naxis ? 1 : 0;
+      for (long axis = 1; axis <= naxis; ++axis) num_elements *= getLong(cards, indexedKey("NAXIS", axis), 0);
+      std::size_t data_size = std::labs(getLong(cards, "BITPIX", 8)) / 8 * getLong(cards, "GCOUNT", 1) *
+        (getLong(cards, "PCOUNT", 0) + num_elements);
+
+      bool is_table = !primary && "BINTABLE" == toUpper(getString(cards, "XTENSION"));
+      if (is_table && (target.empty() || target == toUpper(getString(cards, "EXTNAME")))) {
+        if ("T" == getString(cards, "ZTABLE") || "T" == getString(cards, "ZIMAGE"))
+          throw std::runtime_error("MappedEventTable: extension " + ext_name + " in file " + file_name + " is compressed");
+
+        m_row_width = getLong(cards, "NAXIS1", 0);
+        m_num_records = getLong(cards, "NAXIS2", 0);
+        m_data = m_map + offset + header_size;
+        if (m_data + m_row_width * m_num_records > m_map + m_map_size)
+          throw std::runtime_error("MappedEventTable: file " + file_name + " is truncated");
+
+        // Compute the offset of each column within a row.
+        long num_fields = getLong(cards, "TFIELDS", 0);
+        std::size_t column_offset = 0;
+        for (long field = 1; field <= num_fields; ++field) {
+          std::string tform = toUpper(getString(cards, indexedKey("TFORM", field)));
+          std::string::size_type type_pos = tform.find_first_not_of("0123456789");
+          if (std::string::npos == type_pos) throw std::runtime_error("MappedEventTable: cannot interpret TFORM " + tform);
+
+          Column column;
+          column.m_offset = column_offset;
+          column.m_type = tform[type_pos];
+          column.m_repeat = 0 == type_pos ? 1 : std::atol(tform.substr(0, type_pos).c_str());
+          column.m_scale = getDouble(cards, indexedKey("TSCAL", field), 1.);
+          column.m_zero = getDouble(cards, indexedKey("TZERO", field), 0.);
+
+          std::size_t width = 0;
+          if ('X' == column.m_type) width = (column.m_repeat + 7) / 8;
+          else if (0 != elementSize(column.m_type)) width = column.m_repeat * elementSize(column.m_type);
+          else throw std::runtime_error("MappedEventTable: cannot interpret TFORM " + tform);
+
+          std::string name = toUpper(getString(cards, indexedKey("TTYPE", field)));
+          if (!name.empty()) m_columns[name] = column;
+          column_offset += width;
+        }
+
+        if (column_offset != m_row_width)
+          throw std::runtime_error("MappedEventTable: column widths do not add up to NAXIS1 in file " + file_name);
+        return;
+      }
+
+      offset += header_size + padToBlock(data_size);
+      primary = false;
+    }
+    throw std::runtime_error("MappedEventTable: could not find binary table " + ext_name + " in file " + file_name);
+  }
+
+}
@@ -2,12 +2,19 @@
     \brief Encapsulation of a single spectrum, with methods to read/write using tip.
     \author James Peachey, HEASARC
 */
+#include <algorithm>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <typeinfo>
+#include <vector>
 
 #include "evtbin/Binner.h"
+#include "evtbin/Hist2D.h"
+#include "evtbin/HistND.h"
 #include "evtbin/MultiSpec.h"
-#include "evtbin/SingleSpec.h"
+#include "evtbin/OrderedBinner.h"
 
 #include "st_facilities/Env.h"
 
@@ -16,12 +23,35 @@
 #include "tip/IFileSvc.h"
 #include "tip/Table.h"
 
+#include "fitsio.h"
+
+namespace {
+  // Number of values of each vector column written at once.
+  const long s_block_size = 1 << 20;
+
+  // Histogram of spectra whose time and energy bins are both ordered bins, whose binners are called inline.
+  typedef evtbin::HistND<evtbin::OrderedBinner, evtbin::OrderedBinner> OrderedSpecHist;
+
+  /** \brief Create the histogram of a group of spectra, an OrderedSpecHist if both binners are OrderedBinners, or a
+             Hist2D otherwise. Classes derived from OrderedBinner may compute indices differently, so they use a Hist2D.
+      \param time_binner The time binner.
+      \param energy_binner The energy binner.
+  */
+  evtbin::Hist * createSpecHist(const evtbin::Binner & time_binner, const evtbin::Binner & energy_binner) {
+    if (typeid(evtbin::OrderedBinner) == typeid(time_binner) && typeid(evtbin::OrderedBinner) == typeid(energy_binner))
+      return new OrderedSpecHist(dynamic_cast<const evtbin::OrderedBinner &>(time_binner),
+        dynamic_cast<const evtbin::OrderedBinner &>(energy_binner));
+    return new evtbin::Hist2D(time_binner, energy_binner);
+  }
+}
+
 namespace evtbin {
 
   MultiSpec::MultiSpec(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
     const std::string & sc_table, const Binner & time_binner, const Binner & energy_binner, const Binner & ebounds,
     const Gti & gti): DataProduct(event_file, event_table, gti), m_sc_file(sc_file), m_sc_table(sc_table),
-    m_hist(time_binner, energy_binner), m_ebounds(ebounds.clone()) { m_hist_ptr = &m_hist;
+    m_hist(createSpecHist(time_binner, energy_binner)), m_ebounds(ebounds.clone()) { m_hist_ptr = m_hist;
+    m_use_mapped_input = true;
 
     // Collect any/all needed keywords from the primary extension.
     harvestKeywords(m_event_file_cont);
@@ -43,12 +73,18 @@ namespace evtbin {
 
     // Update tstart/tstop etc.
     adjustTimeKeywords(sc_file, sc_table, &time_binner);
+
+    // Only events inside the range of the time binner need to be read.
+    if (0 < time_binner.getNumBins())
+      setTimeWindow(time_binner.getName(), time_binner.getDomain().begin(), time_binner.getDomain().end());
   }
 
-  MultiSpec::~MultiSpec() throw() { delete m_ebounds; }
+  MultiSpec::~MultiSpec() throw() { delete m_ebounds; delete m_hist; }
+
+  const Binner * MultiSpec::getTimeBinner() const { return m_hist->getBinners().at(0); }
 
   void MultiSpec::writeOutput(const std::string & creator, const std::string & out_file) const {
-    const Binner * energy_binner = m_hist.getBinners().at(1);
+    const Binner * energy_binner = m_hist->getBinners().at(1);
 
     // Add DETCHANS, which is just the number of bins in the energy binner.
     updateKeyValue("DETCHANS", energy_binner->getNumBins(), "Total number of detector channels available.");
@@ -56,110 +92,140 @@ namespace evtbin {
     // Standard file creation from base class.
     createFile(creator, out_file, facilities::commonUtilities::joinPath(m_data_dir, "LatBinnedTemplate"));
 
-    // Open SPECTRUM extension of output PHA1 file. Use an unique_ptr so that the table object
-    // will for sure be deleted, even if an exception is thrown.
-    std::unique_ptr<tip::Table> output_table(tip::IFileSvc::instance().editTable(out_file, "SPECTRUM"));
+    {
+      // Open SPECTRUM extension of output PHA1 file. Use an unique_ptr so that the table object
+      // will for sure be deleted, even if an exception is thrown.
+      std::unique_ptr<tip::Table> output_table(tip::IFileSvc::instance().editTable(out_file, "SPECTRUM"));
 
-    // Write DSS keywords to preserve cut information.
-    writeDssKeywords(output_table->getHeader());
+      // Write DSS keywords to preserve cut information.
+      writeDssKeywords(output_table->getHeader());
 
-    // Write the history that came from the events extension.
-    writeHistory(*output_table, "EVENTS");
+      // Write the history that came from the events extension.
+      writeHistory(*output_table, "EVENTS");
+    }
 
     // Get number of bins in each dimension.
-    const Binner * time_binner = m_hist.getBinners().at(0);
+    const Binner * time_binner = m_hist->getBinners().at(0);
     long num_time_bins = time_binner->getNumBins();
-    long num_energy_bins = m_hist.getBinners().at(1)->getNumBins();
-
-    // Tweak the dimensionality of output table.
-    // Need output table iterator.
-    tip::Table::Iterator table_itor = output_table->begin();
-
-    // Resize counts field: number of elements must be the same as the number of bins in the energy binner.
-    (*table_itor)["CHANNEL"].setNumElements(num_energy_bins);
-    (*table_itor)["COUNTS"].setNumElements(num_energy_bins);
-    (*table_itor)["STAT_ERR"].setNumElements(num_energy_bins);
-    
-    // Resize table: number of records in output file must == the number of bins in the time binner.
-    output_table->setNumRecords(num_time_bins);
-
-    long * channel = new long[num_energy_bins];
-    double * staterr = new double[num_energy_bins];
-    for (long index = 0; index != num_energy_bins; ++index) channel[index] = index + 1;
-
-    // Iterate over bin number and output table iterator, writing fields in order.
-    double total_counts=0;
+    long num_energy_bins = energy_binner->getNumBins();
+
+    // Ontime and exposure of every spectrum, from one pass through the spacecraft data.
+    std::vector<double> ontime;
+    std::vector<double> exposure;
+    computeBinExposure(m_sc_file, m_sc_table, *time_binner, ontime, exposure);
+
+    // Check for GBM deadtime keywords, which are applied to each spectrum below.
+    // We do this here rather than using the gbmExposure method since it writes to a table and not
+    // to a header keyword.
+    bool gbm_deadtime = false;
+    double deadtime = 0.;
+    double evtdedhi = 0.;
+    KeyValuePairCont_t::iterator found2 = m_key_value_pairs.find("EVT_DEAD");
+    KeyValuePairCont_t::iterator found3 = m_key_value_pairs.find("EVTDEDHI");
+    if (m_key_value_pairs.end() != found2 && !found2->second.empty()) {
+      gbm_deadtime = true;
+      found2->second.getValue(deadtime);
+      found3->second.getValue(evtdedhi);
+    }
+
+    // The table is written directly with cfitsio, a block of rows at a time, each column from one contiguous buffer.
+    int status = 0;
+    fitsfile * fp = 0;
+    fits_open_file(&fp, out_file.c_str(), READWRITE, &status);
+    checkFitsStatus(status, "MultiSpec::writeOutput cannot open " + out_file);
+    fits_movnam_hdu(fp, BINARY_TBL, const_cast<char *>("SPECTRUM"), 0, &status);
+
+    // Look up the columns.
+    static const char * field_name[] = { "TSTART", "TELAPSE", "SPEC_NUM", "CHANNEL", "COUNTS", "STAT_ERR", "EXPOSURE" };
+    enum { TSTART, TELAPSE, SPEC_NUM, CHANNEL, COUNTS, STAT_ERR, EXPOSURE, NUM_FIELDS };
+    int col_num[NUM_FIELDS] = { 0 };
+    for (int field = 0; field != NUM_FIELDS; ++field)
+      fits_get_colnum(fp, CASEINSEN, const_cast<char *>(field_name[field]), &col_num[field], &status);
+
+    // Number of elements of the vector columns must be the same as the number of bins in the energy binner.
+    fits_modify_vector_len(fp, col_num[CHANNEL], num_energy_bins, &status);
+    fits_modify_vector_len(fp, col_num[COUNTS], num_energy_bins, &status);
+    fits_modify_vector_len(fp, col_num[STAT_ERR], num_energy_bins, &status);
+
+    // Number of records in output file must == the number of bins in the time binner.
+    long num_rows = 0;
+    fits_get_num_rows(fp, &num_rows, &status);
+    if (num_rows < num_time_bins) fits_insert_rows(fp, num_rows, num_time_bins - num_rows, &status);
+    else if (num_rows > num_time_bins) fits_delete_rows(fp, num_time_bins + 1, num_rows - num_time_bins, &status);
+
+    // Rows per block, so that each vector column buffer holds about s_block_size values.
+    long block_rows = std::max(1l, std::min(num_time_bins, s_block_size / std::max(1l, num_energy_bins)));
+
+    // The channel numbers are the same in every row, so their buffer is filled once.
+    std::vector<long> channel(block_rows * num_energy_bins);
+    for (long row = 0; row != block_rows; ++row)
+      for (long index = 0; index != num_energy_bins; ++index) channel[row * num_energy_bins + index] = index + 1;
+
+    std::vector<double> counts(block_rows * num_energy_bins);
+    std::vector<double> staterr(block_rows * num_energy_bins);
+    std::vector<double> tstart(block_rows);
+    std::vector<double> telapse(block_rows);
+    std::vector<long> spec_num(block_rows);
+    std::vector<double> row_exposure(block_rows);
+
+    // Each spectrum is a row of the histogram, or a run of values of the flat contents of an OrderedSpecHist.
+    const Hist2D * hist2d = dynamic_cast<const Hist2D *>(m_hist);
+    const OrderedSpecHist * ordered_hist = dynamic_cast<const OrderedSpecHist *>(m_hist);
+
     double total_counts2=0;
-    double total_error_channel=0;
     double total_error_channel2=0;
-    for (long index = 0; index != num_time_bins; ++index, ++table_itor) {
-      // Get interval of this time bin.
-      const Binner::Interval & time_int = time_binner->getInterval(index);
-
-      // Calculate STAT_ERR for current time bin.
-      for (long index2 = 0; index2 != num_energy_bins; ++index2) staterr[index2] = calcStatErr(m_hist[index][index2]);
-
-      // Record time binning information.
-      (*table_itor)["TSTART"].set(time_int.begin());
-      (*table_itor)["TELAPSE"].set(time_int.width());
-
-      // Number the spectra.
-      (*table_itor)["SPEC_NUM"].set(index + 1);
-
-      // Channel of each bin.
-      (*table_itor)["CHANNEL"].set(channel, channel + num_energy_bins, 0);
-
-      // Number of counts in each bin, from the histogram.
-      (*table_itor)["COUNTS"].set(&(m_hist[index][0]), &(m_hist[index][num_energy_bins]), 0);
-            
-      // Keep a running total of binned counts for current spectrum.
-      for (long index2 = 0; index2 != num_energy_bins; ++index2) {
-	if (index2 <=126){
-	  total_counts+=m_hist[index][index2];
-	}else{
-	  total_error_channel+=m_hist[index][index2];
-	}
+    for (long first_row = 0; first_row < num_time_bins && 0 == status; first_row += block_rows) {
+      long num_block_rows = std::min(block_rows, num_time_bins - first_row);
+      long num_values = num_block_rows * num_energy_bins;
+
+      for (long row = 0; row != num_block_rows; ++row) {
+        long index = first_row + row;
+
+        // Get interval of this time bin. The bins of a folding (e.g. pulse phase) binner are fractions of each period, so
+        // then every spectrum spans the whole time range.
+        Binner::Interval time_int = time_binner->isFolded() ? time_binner->getDomain() : time_binner->getInterval(index);
+        tstart[row] = time_int.begin();
+        telapse[row] = time_int.width();
+
+        // Number the spectra.
+        spec_num[row] = index + 1;
+
+        // Number of counts in each bin, from the histogram, and the running total of binned counts for this spectrum.
+        std::vector<double>::const_iterator spectrum = 0 != hist2d ? (*hist2d)[index].begin() :
+          ordered_hist->begin() + index * num_energy_bins;
+        std::copy(spectrum, spectrum + num_energy_bins, counts.begin() + row * num_energy_bins);
+        double total_counts = 0.;
+        double total_error_channel = 0.;
+        for (long index2 = 0; index2 != num_energy_bins; ++index2) {
+          if (index2 <= 126) total_counts += spectrum[index2];
+          else total_error_channel += spectrum[index2];
+        }
+        total_counts2 += total_counts;
+        total_error_channel2 += total_error_channel;
+
+        // Exposure of this spectrum, corrected for GBM deadtime if needed.
+        row_exposure[row] = gbm_deadtime ? ontime[index] - total_counts * deadtime - total_error_channel * evtdedhi :
+          exposure[index];
       }
-      // And the total for all spectrums.
-      total_counts2+=total_counts;
-      total_error_channel2+=total_error_channel;
-
-      //Statistical Error
-      (*table_itor)["STAT_ERR"].set(staterr, staterr + num_energy_bins, 0);
-
-      // Create a Gti object which contains just the current time interval.
-      Gti gti;
-      gti.insertInterval(time_int.begin(), time_int.end());
-
-      // Merge this with the overall input Gti.
-      gti = gti & m_gti;
-
-      // Create an object which represents just this single spectrum, but with the reduced Gti.
-      SingleSpec spec(m_event_file, m_event_table, m_sc_file, m_sc_table, *energy_binner, *m_ebounds, gti);
-
-      // Use the single spectrum to compute exposure for the current spectrum, in a manner similar
-      // to keywords for a single spectrum.
-      (*table_itor)["EXPOSURE"].set(spec.computeExposure(m_sc_file, m_sc_table));
-
-      // Then check for GBM deadtime for each spectrum.
-      // We do this here rather than using the gbmExposure method since it writes to a table and not
-      // to a header keyword.
-      KeyValuePairCont_t::iterator found2 = m_key_value_pairs.find("EVT_DEAD");
-      KeyValuePairCont_t::iterator found3 = m_key_value_pairs.find("EVTDEDHI");
-      if (m_key_value_pairs.end() != found2 && !found2->second.empty()) {
-	double deadtime;
-	found2->second.getValue(deadtime);
-	double evtdedhi;
-	found3->second.getValue(evtdedhi);
-	double gbm_exposure=(gti.computeOntime())-(total_counts*deadtime)-(total_error_channel*evtdedhi);
-	(*table_itor)["EXPOSURE"].set(gbm_exposure);
-      }
-      total_counts=0;
-      total_error_channel=0;
+
+      // Statistical errors of the whole block at once.
+      calcStatErr(&counts[0], num_values, &staterr[0]);
+
+      long fits_row = first_row + 1;
+      fits_write_col(fp, TDOUBLE, col_num[TSTART], fits_row, 1, num_block_rows, &tstart[0], &status);
+      fits_write_col(fp, TDOUBLE, col_num[TELAPSE], fits_row, 1, num_block_rows, &telapse[0], &status);
+      fits_write_col(fp, TLONG, col_num[SPEC_NUM], fits_row, 1, num_block_rows, &spec_num[0], &status);
+      fits_write_col(fp, TLONG, col_num[CHANNEL], fits_row, 1, num_values, &channel[0], &status);
+      fits_write_col(fp, TDOUBLE, col_num[COUNTS], fits_row, 1, num_values, &counts[0], &status);
+      fits_write_col(fp, TDOUBLE, col_num[STAT_ERR], fits_row, 1, num_values, &staterr[0], &status);
+      fits_write_col(fp, TDOUBLE, col_num[EXPOSURE], fits_row, 1, num_block_rows, &row_exposure[0], &status);
     }
 
-    delete [] channel;
-    delete [] staterr;
+    // Close the file regardless of errors, reporting the first error.
+    int close_status = 0;
+    fits_close_file(fp, &close_status);
+    if (0 == status) status = close_status;
+    checkFitsStatus(status, "MultiSpec::writeOutput failed to write spectra to " + out_file);
 
     // Write the EBOUNDS extension.
     writeEbounds(out_file, m_ebounds);
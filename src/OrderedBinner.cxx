@@ -3,6 +3,7 @@
 */
 
 #include <algorithm>
+#include <cmath>
 #include <sstream>
 #include <stdexcept>
 
@@ -10,7 +11,10 @@
 
 namespace evtbin {
 
-  OrderedBinner::OrderedBinner(const IntervalCont_t & intervals, const std::string & name): Binner(name), m_intervals(intervals) {
+  const long OrderedBinner::s_max_scan;
+
+  OrderedBinner::OrderedBinner(const IntervalCont_t & intervals, const std::string & name): Binner(name), m_intervals(intervals),
+    m_begins(), m_ends(), m_bucket(), m_lowest(0.), m_highest(0.), m_bucket_scale(0.) {
     // Check over the bins to make sure they're in ascending order.
     for (IntervalCont_t::const_iterator itor = m_intervals.begin(); itor != m_intervals.end(); ++itor) {
       // Each interval must itself be ordered.
@@ -31,24 +35,26 @@ namespace evtbin {
         throw std::runtime_error(os.str());
       }
     }
+
+    buildIndex();
   }
 
   OrderedBinner::~OrderedBinner() throw() {}
 
-  long OrderedBinner::computeIndex(double value) const {
-    // Find the first bin for which the value is < that bin's beginning value.
-    IntervalCont_t::const_iterator bound = std::upper_bound(m_intervals.begin(), m_intervals.end(), value);
-
-    // If this iterator points to the very first bin, the value does not belong in any bin.
-    if (m_intervals.begin() == bound) return -1;
-
-    // This iterator position is one past the only interval which might contain the value, so back up.
-    --bound;
+  long OrderedBinner::computeNextIndex(double value, long previous_index) const {
+    long num_bins = m_begins.size();
+    if (0 <= previous_index && previous_index < num_bins && m_begins[previous_index] <= value) {
+      // Advance from the previous bin while the next bin also begins at or before the value.
+      long index = previous_index;
+      long limit = std::min(num_bins - 1, previous_index + s_max_scan);
+      while (index < limit && m_begins[index + 1] <= value) ++index;
 
-    // This bin by definition has a beginning value >= the value, so just check the end of the interval.
-    if (bound->end() > value) return bound - m_intervals.begin();
+      // Unless the scan stopped at its limit with more bins to go, this is the last bin which begins at or before the value.
+      if (index < limit || limit == num_bins - 1 || m_begins[index + 1] > value) return m_ends[index] > value ? index : -1;
+    }
 
-    return -1;
+    // The value is before the previous bin, too far beyond it, or there is no previous bin, so search.
+    return computeIndex(value);
   }
 
   long OrderedBinner::getNumBins() const { return m_intervals.size(); }
@@ -63,4 +69,52 @@ namespace evtbin {
 
   Binner * OrderedBinner::clone() const { return new OrderedBinner(*this); }
 
+  void OrderedBinner::buildIndex() {
+    long num_bins = m_intervals.size();
+    m_begins.resize(num_bins);
+    m_ends.resize(num_bins);
+    for (long index = 0; index != num_bins; ++index) {
+      m_begins[index] = m_intervals[index].begin();
+      m_ends[index] = m_intervals[index].end();
+    }
+
+    if (0 == num_bins) {
+      // No value can be binned.
+      m_bucket.assign(2, 0);
+      m_lowest = 0.;
+      m_highest = 0.;
+      m_bucket_scale = 0.;
+      return;
+    }
+
+    m_lowest = m_begins.front();
+    m_highest = m_ends.back();
+
+    // Buckets cannot span an infinite (or undefined) range, so in that case a single bucket holds all the bins, which
+    // are then bisected.
+    for (long index = 0; index != num_bins; ++index) {
+      if (!std::isfinite(m_begins[index]) || !std::isfinite(m_ends[index])) {
+        m_bucket.assign(1, 0);
+        m_bucket.push_back(num_bins - 1);
+        m_bucket_scale = 0.;
+        return;
+      }
+    }
+
+    // Use about one bucket per bin.
+    long num_buckets = num_bins;
+    double width = m_highest - m_lowest;
+    m_bucket_scale = 0. < width ? num_buckets / width : 0.;
+
+    // For the lower edge of each bucket (and the upper edge of the last one), record the last bin which begins at or
+    // before that edge.
+    m_bucket.resize(num_buckets + 1);
+    long index = 0;
+    for (long bucket = 0; bucket <= num_buckets; ++bucket) {
+      double edge = m_lowest + bucket * (width / num_buckets);
+      while (index + 1 < num_bins && m_begins[index + 1] <= edge) ++index;
+      m_bucket[bucket] = index;
+    }
+  }
+
 }
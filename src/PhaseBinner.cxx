@@ -0,0 +1,63 @@
+/** \file PhaseBinner.cxx
+    \brief Implementation of a binner which folds event times by the rotational phase of a pulsar.
+*/
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "evtbin/PhaseBinner.h"
+
+namespace evtbin {
+
+  PhaseBinner::PhaseBinner(double time_begin, double time_end, double epoch, double f0, double f1, double f2, long num_bins,
+    const std::string & name): Binner(name), m_time_begin(time_begin), m_time_end(time_end), m_epoch(epoch), m_f0(f0),
+    m_f1_half(f1 / 2.), m_f2_sixth(f2 / 6.), m_num_bins(num_bins) {
+    if (0 >= num_bins) {
+      std::ostringstream os;
+      os << "PhaseBinner: number of phase bins " << num_bins << " is not positive";
+      throw std::runtime_error(os.str());
+    }
+    if (time_begin >= time_end) {
+      std::ostringstream os;
+      os << "PhaseBinner: time range [" << time_begin << ", " << time_end << ") is empty";
+      throw std::runtime_error(os.str());
+    }
+  }
+
+  long PhaseBinner::computeIndex(double value) const {
+    if (!(value >= m_time_begin && value < m_time_end)) return -1;
+    long index = long(computePhase(value) * m_num_bins);
+    // Guard against round-off for phases just below 1.
+    return index < m_num_bins ? index : m_num_bins - 1;
+  }
+
+  long PhaseBinner::getNumBins() const { return m_num_bins; }
+
+  Binner::Interval PhaseBinner::getInterval(long index) const {
+    if (index < 0 || index >= m_num_bins) return Binner::Interval(0., 0.);
+    return Binner::Interval(double(index) / m_num_bins, index + 1 == m_num_bins ? 1. : double(index + 1) / m_num_bins);
+  }
+
+  Binner::Interval PhaseBinner::getDomain() const { return Binner::Interval(m_time_begin, m_time_end); }
+
+  bool PhaseBinner::isFolded() const { return true; }
+
+  Binner * PhaseBinner::clone() const { return new PhaseBinner(*this); }
+
+  double PhaseBinner::computePhase(double time) const {
+    double dt = time - m_epoch;
+    double phase = dt * (m_f0 + dt * (m_f1_half + dt * m_f2_sixth));
+    return phase - std::floor(phase);
+  }
+
+  void PhaseBinner::computeIndices(const double * time, long num_times, long * index) const {
+    for (long ii = 0; ii < num_times; ++ii) {
+      double dt = time[ii] - m_epoch;
+      double phase = dt * (m_f0 + dt * (m_f1_half + dt * m_f2_sixth));
+      long bin = long((phase - std::floor(phase)) * m_num_bins);
+      bin = bin < m_num_bins ? bin : m_num_bins - 1;
+      index[ii] = (time[ii] >= m_time_begin && time[ii] < m_time_end) ? bin : -1;
+    }
+  }
+
+}
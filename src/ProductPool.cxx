@@ -0,0 +1,75 @@
+/** \file ProductPool.cxx
+    \brief Pool of worker threads which bin several data products concurrently.
+*/
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+#include "evtbin/DataProduct.h"
+#include "evtbin/ProductPool.h"
+
+namespace {
+
+  // Worker which bins products until there are none left. Copies of a worker share the same queue and error state.
+  class Worker {
+    public:
+      typedef evtbin::ProductPool::ProductCont_t ProductCont_t;
+
+      Worker(const ProductCont_t & products, std::atomic<ProductCont_t::size_type> & next, std::exception_ptr & error,
+        std::mutex & error_mutex): m_products(products), m_next(next), m_error(error), m_error_mutex(error_mutex) {}
+
+      void operator ()() const {
+        // Take the next product not yet claimed by any worker.
+        for (ProductCont_t::size_type index = m_next++; index < m_products.size(); index = m_next++) {
+          try {
+            m_products[index]->binInput();
+          } catch (...) {
+            // Keep only the first error.
+            std::lock_guard<std::mutex> lock(m_error_mutex);
+            if (!m_error) m_error = std::current_exception();
+          }
+        }
+      }
+
+    private:
+      const ProductCont_t & m_products;
+      std::atomic<ProductCont_t::size_type> & m_next;
+      std::exception_ptr & m_error;
+      std::mutex & m_error_mutex;
+  };
+
+}
+
+namespace evtbin {
+
+  ProductPool::ProductPool(unsigned long num_threads): m_num_threads(num_threads) {
+    if (0 == m_num_threads) m_num_threads = std::thread::hardware_concurrency();
+    // hardware_concurrency may not be able to tell.
+    if (0 == m_num_threads) m_num_threads = 1;
+  }
+
+  void ProductPool::binInput(const ProductCont_t & products) const {
+    std::atomic<ProductCont_t::size_type> next(0);
+    std::exception_ptr error;
+    std::mutex error_mutex;
+    Worker work(products, next, error, error_mutex);
+
+    // The calling thread is one of the workers.
+    unsigned long num_threads = std::min<unsigned long>(m_num_threads, products.size());
+    std::vector<std::thread> threads;
+    for (unsigned long ii = 1; ii < num_threads; ++ii) threads.push_back(std::thread(work));
+    work();
+    for (std::vector<std::thread>::iterator itor = threads.begin(); itor != threads.end(); ++itor) itor->join();
+
+    if (error) std::rethrow_exception(error);
+
+    // The exposure of each product is computed through tip on its own thread. Wait for all of them here, so that callers
+    // may use tip, for example to write the products, without racing with them.
+    for (ProductCont_t::const_iterator itor = products.begin(); itor != products.end(); ++itor) (*itor)->finishExposure();
+  }
+
+  unsigned long ProductPool::getNumThreads() const { return m_num_threads; }
+
+}
@@ -0,0 +1,81 @@
+/** \file QuantileSketch.cxx
+    \brief Implementation of a streaming summary of a set of values from which approximate quantiles can be computed.
+*/
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+#include "evtbin/QuantileSketch.h"
+
+namespace evtbin {
+
+  QuantileSketch::QuantileSketch(double epsilon): m_epsilon(epsilon), m_count(0), m_summary(), m_buffer() {
+    if (0. >= epsilon || 1. <= epsilon) {
+      std::ostringstream os;
+      os << "QuantileSketch: rank error " << epsilon << " is not between 0 and 1";
+      throw std::logic_error(os.str());
+    }
+    // Values are inserted in sorted batches of about the number which may be added between compressions.
+    m_buffer.reserve(long(1. / (2. * m_epsilon)) + 1);
+  }
+
+  void QuantileSketch::add(double value) {
+    m_buffer.push_back(value);
+    ++m_count;
+    if (m_buffer.size() == m_buffer.capacity()) flush();
+  }
+
+  long QuantileSketch::getCount() const { return m_count; }
+
+  double QuantileSketch::getQuantile(double phi) const {
+    if (0 == m_count) throw std::runtime_error("QuantileSketch::getQuantile: no values were added");
+    flush();
+
+    // Find the last tuple whose maximum possible rank is within the allowed error of the requested rank.
+    double rank = std::ceil(std::max(0., std::min(1., phi)) * m_count);
+    double tolerance = m_epsilon * m_count;
+    double min_rank = 0.;
+    for (TupleCont_t::size_type index = 0; index != m_summary.size(); ++index) {
+      min_rank += m_summary[index].m_gap;
+      if (min_rank + m_summary[index].m_delta > rank + tolerance) return m_summary[0 == index ? 0 : index - 1].m_value;
+    }
+    return m_summary.back().m_value;
+  }
+
+  void QuantileSketch::flush() const {
+    if (m_buffer.empty()) return;
+    std::sort(m_buffer.begin(), m_buffer.end());
+
+    // The uncertainty of each new value's rank is the largest allowed for the total number of values; values which
+    // become the new minimum or maximum have exactly known ranks.
+    double delta = std::max(0., std::floor(2. * m_epsilon * m_count) - 1.);
+
+    // Merge the sorted buffer into the sorted summary.
+    TupleCont_t merged;
+    merged.reserve(m_summary.size() + m_buffer.size());
+    TupleCont_t::iterator summary_itor = m_summary.begin();
+    for (std::vector<double>::const_iterator itor = m_buffer.begin(); itor != m_buffer.end(); ++itor) {
+      for (; summary_itor != m_summary.end() && summary_itor->m_value <= *itor; ++summary_itor) merged.push_back(*summary_itor);
+      bool extreme = merged.empty() || summary_itor == m_summary.end();
+      merged.push_back(Tuple(*itor, 1., extreme ? 0. : delta));
+    }
+    merged.insert(merged.end(), summary_itor, m_summary.end());
+    m_buffer.clear();
+
+    // Compress: merge each tuple into its successor if the combined uncertainty stays within the bound. The first
+    // and last tuples are always kept, so the minimum and maximum are exact.
+    double threshold = 2. * m_epsilon * m_count;
+    m_summary.clear();
+    for (TupleCont_t::reverse_iterator itor = merged.rbegin(); itor != merged.rend(); ++itor) {
+      if (!m_summary.empty() && itor + 1 != merged.rend() &&
+        itor->m_gap + m_summary.back().m_gap + m_summary.back().m_delta < threshold) {
+        m_summary.back().m_gap += itor->m_gap;
+      } else {
+        m_summary.push_back(*itor);
+      }
+    }
+    std::reverse(m_summary.begin(), m_summary.end());
+  }
+
+}
@@ -21,6 +21,7 @@ namespace evtbin {
     const std::string & sc_table, const Binner & binner, const Binner & ebounds, const Gti & gti):
     DataProduct(event_file, event_table, gti), m_hist(binner), m_ebounds(ebounds.clone()) {
     m_hist_ptr = &m_hist;
+    m_use_mapped_input = true;
 
     // Collect any/all needed keywords from the primary extension.
     harvestKeywords(m_event_file_cont);
@@ -0,0 +1,207 @@
+/** \file SparseHist3D.cxx
+    \brief Three dimensional histogram which stores only its nonzero bins.
+*/
+#include <algorithm>
+#include <stdexcept>
+
+#include "evtbin/Binner.h"
+#include "evtbin/SparseHist3D.h"
+
+namespace {
+  // Smallest number of buffered fills which are merged into the planes at once.
+  const long s_min_pending = 65536;
+}
+
+namespace evtbin {
+
+  SparseHist3D::SparseHist3D(const Binner & binner1, const Binner & binner2, const Binner & binner3):
+    m_size1(binner1.getNumBins()), m_size2(binner2.getNumBins()), m_pixels(), m_values(), m_pending(), m_num_filled(0) {
+    // One empty plane per bin of the third dimension:
+    m_pixels.resize(binner3.getNumBins());
+    m_values.resize(binner3.getNumBins());
+
+    // Save binners:
+    m_binners.resize(3);
+    m_binners[0] = binner1.clone();
+    m_binners[1] = binner2.clone();
+    m_binners[2] = binner3.clone();
+  }
+
+  SparseHist3D::~SparseHist3D() throw() {}
+
+  void SparseHist3D::fillBin(const std::vector<double> & value, double weight) {
+    fillBin(value[0], value[1], value[2], weight);
+  }
+
+  void SparseHist3D::fillBin(double value1, double value2, double value3, double weight) {
+    // The plane is found first, since that is the dimension most likely to reject the value.
+    long index3 = m_binners[2]->computeIndex(value3);
+    if (0 > index3) return;
+
+    fillPlaneBin(index3, value1, value2, weight);
+  }
+
+  void SparseHist3D::fillPlaneBin(long index3, double value1, double value2, double weight) {
+    if (0 > index3 || long(m_pixels.size()) <= index3) return;
+
+    long index1 = m_binners[0]->computeIndex(value1);
+    long index2 = m_binners[1]->computeIndex(value2);
+
+    // Increment the appropriate bin, creating it if necessary:
+    if (0 <= index1 && 0 <= index2) addFill(index3, index1 + index2 * m_size1, weight);
+  }
+
+  void SparseHist3D::getValues(std::vector<double> & values) const {
+    flush();
+    long size3 = m_pixels.size();
+    values.assign(m_size1 * m_size2 * size3, 0.);
+    for (long index3 = 0; index3 != size3; ++index3) {
+      const PixelCont_t & pixels = m_pixels[index3];
+      for (PixelCont_t::size_type ii = 0; ii != pixels.size(); ++ii) {
+        long index1 = pixels[ii] % m_size1;
+        long index2 = pixels[ii] / m_size1;
+        values[(index1 * m_size2 + index2) * size3 + index3] = m_values[index3][ii];
+      }
+    }
+  }
+
+  void SparseHist3D::addValues(const std::vector<double> & values) {
+    long size3 = m_pixels.size();
+    if (values.size() != std::vector<double>::size_type(m_size1 * m_size2 * size3))
+      throw std::logic_error("SparseHist3D::addValues: wrong number of values");
+    for (long index1 = 0; index1 != m_size1; ++index1) {
+      for (long index2 = 0; index2 != m_size2; ++index2) {
+        for (long index3 = 0; index3 != size3; ++index3) {
+          double value = values[(index1 * m_size2 + index2) * size3 + index3];
+          if (0. != value) addFill(index3, index1 + index2 * m_size1, value);
+        }
+      }
+    }
+  }
+
+  void SparseHist3D::addRebinned(const Hist & master) {
+    // A dense master already holds all of its bins, so nothing is saved by visiting only the nonzero ones.
+    const SparseHist3D * sparse_master = dynamic_cast<const SparseHist3D *>(&master);
+    if (0 == sparse_master) {
+      Hist::addRebinned(master);
+      return;
+    }
+
+    std::vector<std::vector<long> > offset;
+    computeRebinOffsets(master, offset);
+
+    // Find the bin of this histogram for each nonzero bin of the master. Its flat index, laid out as by getValues,
+    // is (index1 * m_size2 + index2) * size3 + index3. All are found before any is added, in case the master is this.
+    sparse_master->flush();
+    long size3 = m_pixels.size();
+    std::vector<Fill> fills;
+    for (long master3 = 0; master3 != long(sparse_master->m_pixels.size()); ++master3) {
+      if (0 > offset[2][master3]) continue;
+      const PixelCont_t & pixels = sparse_master->m_pixels[master3];
+      const ValueCont_t & values = sparse_master->m_values[master3];
+      for (PixelCont_t::size_type ii = 0; ii != pixels.size(); ++ii) {
+        long offset1 = offset[0][pixels[ii] % sparse_master->m_size1];
+        long offset2 = offset[1][pixels[ii] / sparse_master->m_size1];
+        if (0 > offset1 || 0 > offset2) continue;
+        long target = offset1 + offset2 + offset[2][master3];
+        long index12 = target / size3;
+        Fill fill = { target % size3, index12 / m_size2 + (index12 % m_size2) * m_size1, values[ii] };
+        fills.push_back(fill);
+      }
+    }
+
+    m_pending.insert(m_pending.end(), fills.begin(), fills.end());
+    flush();
+  }
+
+  void SparseHist3D::sumRebinned(const std::vector<std::vector<long> > & offset, std::vector<double> & values) const {
+    flush();
+    for (long index3 = 0; index3 != long(m_pixels.size()); ++index3) {
+      if (0 > offset[2][index3]) continue;
+      const PixelCont_t & pixels = m_pixels[index3];
+      for (PixelCont_t::size_type ii = 0; ii != pixels.size(); ++ii) {
+        long offset1 = offset[0][pixels[ii] % m_size1];
+        long offset2 = offset[1][pixels[ii] / m_size1];
+        if (0 <= offset1 && 0 <= offset2) values[offset1 + offset2 + offset[2][index3]] += m_values[index3][ii];
+      }
+    }
+  }
+
+  void SparseHist3D::getImage(std::vector<float> & image) const {
+    flush();
+    long plane_size = m_size1 * m_size2;
+    image.assign(plane_size * m_pixels.size(), 0.);
+    for (long index3 = 0; index3 != long(m_pixels.size()); ++index3) {
+      const PixelCont_t & pixels = m_pixels[index3];
+      for (PixelCont_t::size_type ii = 0; ii != pixels.size(); ++ii)
+        image[index3 * plane_size + pixels[ii]] = m_values[index3][ii];
+    }
+  }
+
+  void SparseHist3D::getPlaneImage(long index3, std::vector<float> & image) const {
+    image.assign(m_size1 * m_size2, 0.);
+    const PixelCont_t & pixels = getPixels(index3);
+    const ValueCont_t & values = m_values[index3];
+    for (PixelCont_t::size_type ii = 0; ii != pixels.size(); ++ii) image[pixels[ii]] = values[ii];
+  }
+
+  const SparseHist3D::PixelCont_t & SparseHist3D::getPixels(long index3) const {
+    flush();
+    return m_pixels.at(index3);
+  }
+
+  const SparseHist3D::ValueCont_t & SparseHist3D::getPlaneValues(long index3) const {
+    flush();
+    return m_values.at(index3);
+  }
+
+  void SparseHist3D::addFill(long index3, long pixel, double weight) {
+    Fill fill = { index3, pixel, weight };
+    m_pending.push_back(fill);
+
+    // Merging costs time in proportion to the number of filled bins, so the buffer grows with them.
+    if (long(m_pending.size()) >= std::max(s_min_pending, m_num_filled / 2)) flush();
+  }
+
+  void SparseHist3D::flush() const {
+    if (m_pending.empty()) return;
+
+    std::sort(m_pending.begin(), m_pending.end());
+    std::vector<Fill>::const_iterator fill = m_pending.begin();
+    while (fill != m_pending.end()) {
+      // Find the fills of one plane.
+      long index3 = fill->m_index3;
+      std::vector<Fill>::const_iterator plane_end = fill;
+      while (plane_end != m_pending.end() && index3 == plane_end->m_index3) ++plane_end;
+
+      // Merge them with the bins already in the plane, both of which are sorted by position.
+      const PixelCont_t & old_pixels = m_pixels[index3];
+      const ValueCont_t & old_values = m_values[index3];
+      PixelCont_t pixels;
+      ValueCont_t values;
+      pixels.reserve(old_pixels.size() + (plane_end - fill));
+      values.reserve(old_values.size() + (plane_end - fill));
+      PixelCont_t::size_type old = 0;
+      for (; fill != plane_end; ++fill) {
+        for (; old != old_pixels.size() && old_pixels[old] <= fill->m_pixel; ++old) {
+          pixels.push_back(old_pixels[old]);
+          values.push_back(old_values[old]);
+        }
+        // The bin of this fill is the last one copied, if it exists already.
+        if (pixels.empty() || pixels.back() != fill->m_pixel) {
+          pixels.push_back(fill->m_pixel);
+          values.push_back(0.);
+        }
+        values.back() += fill->m_weight;
+      }
+      pixels.insert(pixels.end(), old_pixels.begin() + old, old_pixels.end());
+      values.insert(values.end(), old_values.begin() + old, old_values.end());
+
+      m_num_filled += pixels.size() - old_pixels.size();
+      m_pixels[index3].swap(pixels);
+      m_values[index3].swap(values);
+    }
+    m_pending.clear();
+  }
+
+}
@@ -16,26 +16,36 @@
             James Peachey, HEASARC
 */
 #include <cctype>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
 #include <memory>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 // Helper class for creating binners based on standard parameter values.
 #include "evtbin/BinConfig.h"
 
 // Binners used:
+#include "evtbin/Binner.h"
 #include "evtbin/LinearBinner.h"
 #include "evtbin/LogBinner.h"
 
 // Data product support classes.
 #include "evtbin/CountCube.h"
 #include "evtbin/CountMap.h"
+#include "evtbin/CountMapStack.h"
 #include "evtbin/HealpixMap.h"
 #include "evtbin/DataProduct.h"
 #include "evtbin/LightCurve.h"
 #include "evtbin/MultiSpec.h"
 #include "evtbin/SingleSpec.h"
 
+// Concurrent binning of several products.
+#include "evtbin/ProductPool.h"
+
 // Hoops exceptions.
 #include "hoops/hoops_exception.h"
 
@@ -46,8 +56,13 @@
 // Factory used by st_app's standard main to create application object.
 #include "st_app/StAppFactory.h"
 
+// Expansion of input file lists.
+#include "st_facilities/FileSys.h"
+
 // File access from tip.
 #include "tip/IFileSvc.h"
+// Header access from tip.
+#include "tip/Header.h"
 // Table access from tip.
 #include "tip/Table.h"
 
@@ -63,9 +78,9 @@ class EvtBinAppBase : public st_app::StApp {
     /** \brief Construct a binning application with the given name.
         \param app_name the name of the application.
     */
-    EvtBinAppBase(const std::string & app_name): m_bin_config(0), m_app_name(app_name) {}
+    EvtBinAppBase(const std::string & app_name): m_bin_config(0), m_time_binner(0), m_app_name(app_name) {}
 
-    virtual ~EvtBinAppBase() throw() { delete m_bin_config; }
+    virtual ~EvtBinAppBase() throw() { delete m_time_binner; delete m_bin_config; }
 
     /** \brief Standard "main" for an event binning application. This is the standard recipe for binning,
         with steps which vary between specific apps left to subclasses to define.
@@ -89,6 +104,12 @@ class EvtBinAppBase : public st_app::StApp {
       // Save all parameters from this tool run now.
       pars.Save();
 
+      // Bin each input file as a separate detector, if requested.
+      if (pars["perdet"]) {
+        runDetectors(pars);
+        return;
+      }
+
       // Get data product. This is definitely overridden in subclasses to produce the correct type product
       // for the specific application.
       std::unique_ptr<DataProduct> product(createDataProduct(pars));
@@ -100,6 +121,67 @@ class EvtBinAppBase : public st_app::StApp {
       product->writeOutput(m_app_name, pars["outfile"]);
     }
 
+    /** \brief Bin each file of the input event file list as a separate detector, concurrently, and write one output
+        file per detector, named by inserting the detector name (DETNAM) before the extension of the output file name.
+        Time bins are defined once from all the detectors and shared. Each detector gets its own energy bins and GTI,
+        so for GBM data each detector is binned with its own EBOUNDS. Optionally the light curve summed over all
+        detectors is also written, using the counts already binned for the detectors.
+        \param pars The parameter prompting object.
+    */
+    void runDetectors(st_app::AppParGroup & pars) {
+      using namespace evtbin;
+      using namespace st_facilities;
+
+      std::string ev_file = pars["evfile"];
+      std::string out_file = pars["outfile"];
+      std::string sum_file = getScFileName(pars["sumfile"]);
+      if (!sum_file.empty() && !hasTimeBins())
+        throw std::runtime_error("A summed light curve can only be made when binning in time (algorithm LC or PHA2)");
+
+      // Define the time bins from all detectors together.
+      if (hasTimeBins()) m_time_binner = m_bin_config->createTimeBinner(pars);
+
+      // Create one product per detector, pointing the event file parameter at each detector's file in turn.
+      FileSys::FileNameCont det_file_cont = FileSys::expandFileList(ev_file);
+      std::vector<std::shared_ptr<DataProduct> > product_cont;
+      std::vector<std::string> out_file_cont;
+      for (FileSys::FileNameCont::iterator itor = det_file_cont.begin(); itor != det_file_cont.end(); ++itor) {
+        pars["evfile"] = *itor;
+        out_file_cont.push_back(DataProduct::insertFileNameSuffix(out_file,
+          "_" + getDetectorName(*itor, pars["evtable"], product_cont.size())));
+        product_cont.push_back(std::shared_ptr<DataProduct>(createDataProduct(pars)));
+      }
+      pars["evfile"] = ev_file;
+
+      // Bin all detectors concurrently. The pool also waits for the exposure of each detector, which is computed through
+      // tip, so the outputs can be written one after the other below.
+      ProductPool::ProductCont_t pool_cont;
+      for (std::vector<std::shared_ptr<DataProduct> >::iterator itor = product_cont.begin(); itor != product_cont.end(); ++itor)
+        pool_cont.push_back(itor->get());
+      long num_threads = pars["nthreads"];
+      ProductPool pool(0 < num_threads ? num_threads : 0);
+      pool.binInput(pool_cont);
+
+      // Write the output for each detector.
+      for (std::vector<std::string>::size_type index = 0; index != out_file_cont.size(); ++index)
+        product_cont[index]->writeOutput(m_app_name, out_file_cont[index]);
+
+      if (!sum_file.empty()) {
+        // The summed light curve covers the time intervals of any of the detectors.
+        Gti gti;
+        for (std::vector<std::shared_ptr<DataProduct> >::iterator itor = product_cont.begin(); itor != product_cont.end(); ++itor)
+          gti |= (*itor)->getGti();
+
+        LightCurve sum(ev_file, pars["evtable"], getScFileName(pars["scfile"]), pars["sctable"], *m_time_binner, gti);
+        sum.setBinExposure(pars["lcexposure"]);
+        for (std::vector<std::shared_ptr<DataProduct> >::iterator itor = product_cont.begin(); itor != product_cont.end(); ++itor) {
+          if (0 != dynamic_cast<const LightCurve *>(itor->get())) sum.addCounts((*itor)->getHist1D());
+          else sum.addCounts((*itor)->getHist());
+        }
+        sum.writeOutput(m_app_name, sum_file);
+      }
+    }
+
     /** \brief Prompt for all parameters needed by a particular binner. The base class version prompts
         for universally needed parameters.
         \param pars The parameter prompting object.
@@ -116,7 +198,70 @@ class EvtBinAppBase : public st_app::StApp {
     */
     virtual evtbin::DataProduct * createDataProduct(const st_app::AppParGroup & pars) = 0;
 
+    /** \brief Return true if the data products of this application are binned in time.
+    */
+    virtual bool hasTimeBins() const { return false; }
+
   protected:
+    /** \brief Create the time binner: a copy of the time bins shared by all detectors if these were defined,
+        otherwise the bins defined by the configuration object from the parameters.
+        \param pars The parameter prompting object.
+    */
+    evtbin::Binner * createTimeBinner(const st_app::AppParGroup & pars) const {
+      return 0 != m_time_binner ? m_time_binner->clone() : m_bin_config->createTimeBinner(pars);
+    }
+
+    /** \brief Split the given product by event type if the evtypes parameter lists any event types.
+        \param pars The parameter prompting object.
+        \param product The data product.
+    */
+    void setEventTypes(const st_app::AppParGroup & pars, evtbin::DataProduct & product) const {
+      std::string ev_types = pars["evtypes"];
+
+      // Event type masks are separated by commas and/or blanks, and may be given in any base strtoul understands.
+      evtbin::DataProduct::EventTypeCont_t event_types;
+      std::string::size_type begin = ev_types.find_first_not_of(", \t");
+      while (std::string::npos != begin) {
+        std::string::size_type end = ev_types.find_first_of(", \t", begin);
+        std::string token = ev_types.substr(begin, std::string::npos == end ? std::string::npos : end - begin);
+        char * rest = 0;
+        unsigned long event_type = std::strtoul(token.c_str(), &rest, 0);
+        if (0 == rest || '\0' != *rest || 0 == event_type)
+          throw std::runtime_error("EvtBinAppBase: cannot interpret \"" + token + "\" in evtypes as an event type bit mask");
+        event_types.push_back(event_type);
+        begin = ev_types.find_first_not_of(", \t", std::string::npos == end ? ev_types.size() : end);
+      }
+
+      if (!event_types.empty()) product.setEventTypes(event_types, pars["evtypefield"]);
+    }
+
+    /** \brief Return the name of the detector of the given event file, from its DETNAM keyword, or make one up from
+        the given index if the keyword is missing.
+        \param ev_file The event file name.
+        \param ev_table The name of the event table.
+        \param index The position of the file in the list of detector files.
+    */
+    std::string getDetectorName(const std::string & ev_file, const std::string & ev_table, std::size_t index) const {
+      std::string det_name;
+      try {
+        std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(ev_file, ev_table));
+        table->getHeader()["DETNAM"].get(det_name);
+      } catch (const std::exception &) {
+        det_name.erase();
+      }
+
+      // Drop any whitespace, which would be awkward in a file name.
+      std::string name;
+      for (std::string::iterator itor = det_name.begin(); itor != det_name.end(); ++itor) if (!isspace(*itor)) name += *itor;
+
+      if (name.empty()) {
+        std::ostringstream os;
+        os << "det" << index;
+        name = os.str();
+      }
+      return name;
+    }
+
     std::string getScFileName(const std::string & sc_file) const {
       // Find end of trailing whitespace.
       std::string::const_iterator end = sc_file.end();
@@ -134,6 +279,7 @@ class EvtBinAppBase : public st_app::StApp {
     }
 
     evtbin::BinConfig * m_bin_config;
+    evtbin::Binner * m_time_binner;
 
   private:
     std::string m_app_name;
@@ -199,9 +345,17 @@ class CountCubeApp : public EvtBinAppBase {
       // Get a binner for energy bounds.
       std::unique_ptr<Binner> ebounds(m_bin_config->createEbounds(pars));
 
-      return new evtbin::CountCube(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]), pars["sctable"],
-        pars["xref"], pars["yref"], pars["proj"], num_x_pix, num_y_pix, pars["binsz"], pars["axisrot"],
-        use_lb, pars["rafield"], pars["decfield"], *energy_binner, *ebounds, *gti);
+      std::unique_ptr<DataProduct> product(new evtbin::CountCube(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]),
+        pars["sctable"], pars["xref"], pars["yref"], pars["proj"], num_x_pix, num_y_pix, pars["binsz"], pars["axisrot"],
+        use_lb, pars["rafield"], pars["decfield"], *energy_binner, *ebounds, *gti));
+
+      // Select tile compression of the output image.
+      product->setImageCompression(pars["compress"]);
+
+      // Split by event type, if requested.
+      setEventTypes(pars, *product);
+
+      return product.release();
     }
 };
 
@@ -256,12 +410,92 @@ class CountMapApp : public EvtBinAppBase {
       else throw std::logic_error(
         "CountMapApp::createDataProduct does not understand \"" + pars["coordsys"].Value() + "\" coordinates");
 
-      return new evtbin::CountMap(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]), pars["sctable"],
-        pars["xref"], pars["yref"], pars["proj"], num_x_pix, num_y_pix, pars["binsz"], pars["axisrot"],
-        use_lb, pars["rafield"], pars["decfield"], *gti);
+      std::unique_ptr<DataProduct> product(new evtbin::CountMap(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]),
+        pars["sctable"], pars["xref"], pars["yref"], pars["proj"], num_x_pix, num_y_pix, pars["binsz"], pars["axisrot"],
+        use_lb, pars["rafield"], pars["decfield"], *gti));
+
+      // Select tile compression of the output image.
+      product->setImageCompression(pars["compress"]);
+
+      // Split by event type, if requested.
+      setEventTypes(pars, *product);
+
+      return product.release();
     }
 };
 
+/** \class CountMapStackApp
+    \brief Count map stack specific binning application: one count map per time bin, binned in one pass.
+*/
+class CountMapStackApp : public EvtBinAppBase {
+  public:
+    CountMapStackApp(const std::string & app_name): EvtBinAppBase(app_name) {}
+
+    virtual void parPrompt(st_app::AppParGroup & pars) {
+      // Call base class prompter for standard universal parameters.
+      EvtBinAppBase::parPrompt(pars);
+
+      // Call configuration object to prompt for spatial binning related parameters.
+      m_bin_config->spatialParPrompt(pars);
+
+      // Call time binner to prompt for time binning related parameters.
+      m_bin_config->timeParPrompt(pars);
+    }
+
+    virtual evtbin::DataProduct * createDataProduct(const st_app::AppParGroup & pars) {
+      using namespace evtbin;
+
+      unsigned long num_x_pix = 0;
+      unsigned long num_y_pix = 0;
+
+      // Hoops throws an exception if one tries to convert a signed to an unsigned parameter value.
+      try {
+        // The conversion will work even if the exception is thrown.
+        pars["nxpix"].To(num_x_pix);
+      } catch (const hoops::Hexception & x) {
+        // Ignore just the "signedness" error.
+        if (hoops::P_SIGNEDNESS != x.Code()) throw;
+      }
+
+      // Hoops throws an exception if one tries to convert a signed to an unsigned parameter value.
+      try {
+        // The conversion will work even if the exception is thrown.
+        pars["nypix"].To(num_y_pix);
+      } catch (const hoops::Hexception & x) {
+        // Ignore just the "signedness" error.
+        if (hoops::P_SIGNEDNESS != x.Code()) throw;
+      }
+
+      // Create configuration-specific time binner.
+      std::unique_ptr<Binner> binner(createTimeBinner(pars));
+
+      // Create configuration-specific GTI.
+      std::unique_ptr<Gti>gti(m_bin_config->createGti(pars));
+
+      // Get the coordsys parameter and use it to determine what type coordinate system to use.
+      bool use_lb = false;
+      std::string coord_sys = pars["coordsys"];
+      for (std::string::iterator itor = coord_sys.begin(); itor != coord_sys.end(); ++itor) *itor = tolower(*itor);
+      if (coord_sys == "cel") use_lb = false;
+      else if (coord_sys == "gal") use_lb = true;
+      else throw std::logic_error(
+        "CountMapStackApp::createDataProduct does not understand \"" + pars["coordsys"].Value() + "\" coordinates");
+
+      std::unique_ptr<CountMapStack> product(new CountMapStack(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]),
+        pars["sctable"], pars["xref"], pars["yref"], pars["proj"], num_x_pix, num_y_pix, pars["binsz"], pars["axisrot"],
+        use_lb, pars["rafield"], pars["decfield"], *binner, *gti));
+
+      // Select tile compression of the output image(s).
+      product->setImageCompression(pars["compress"]);
+
+      // One count map file per time bin, or a single cube.
+      product->setWindowImages(pars["winimages"]);
+
+      return product.release();
+    }
+
+    virtual bool hasTimeBins() const { return true; }
+};
 
 /** \class HealpixMapApp
     \brief Manages the creation of a healpix based countmap or countcube
@@ -308,11 +542,22 @@ class HealpixMapApp : public EvtBinAppBase {
       else if (coord_sys == "gal") use_lb = true;
       else throw std::logic_error(
         "HealpixMapApp::createDataProduct does not understand \"" + pars["coordsys"].Value() + "\" coordinates");
-       return new evtbin::HealpixMap(pars["evfile"], pars["evtable"], 
+      std::unique_ptr<HealpixMap> product(new evtbin::HealpixMap(pars["evfile"], pars["evtable"], 
 				     getScFileName(pars["scfile"]), pars["sctable"],
 				     pars["hpx_ordering_scheme"], pars["hpx_order"], 
 				     pars["hpx_region"],
-				     pars["hpx_ebin"], *energy_binner, *ebounds, use_lb, *gti);
+				     pars["hpx_ebin"], *energy_binner, *ebounds, use_lb, *gti));
+
+      // Coarser maps derived from the binned map, if requested.
+      product->setPyramidOrderMin(pars["hpx_order_min"]);
+
+      // Adaptive multi-order map, if requested.
+      product->setMocThreshold(pars["hpx_moc_threshold"]);
+
+      // Split by event type, if requested.
+      setEventTypes(pars, *product);
+
+      return product.release();
     }
 };
 
@@ -345,13 +590,56 @@ class LightCurveApp : public EvtBinAppBase {
       using namespace evtbin;
 
       // Create configuration-specific time binner.
-      std::unique_ptr<Binner> binner(m_bin_config->createTimeBinner(pars));
+      std::unique_ptr<Binner> binner(createTimeBinner(pars));
 
       // Create configuration-specific GTI.
       std::unique_ptr<Gti>gti(m_bin_config->createGti(pars));
 
       // Create data object from Binner.
-      return new LightCurve(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]), pars["sctable"], *binner, *gti);
+      std::unique_ptr<LightCurve> product(new LightCurve(pars["evfile"], pars["evtable"], getScFileName(pars["scfile"]),
+        pars["sctable"], *binner, *gti));
+
+      // Ontime and exposure columns, if requested.
+      product->setBinExposure(pars["lcexposure"]);
+
+      // One light curve per source aperture, if a source list was given.
+      std::string src_list = getScFileName(pars["srclist"]);
+      if (!src_list.empty()) product->setApertures(readApertures(src_list), pars["rafield"], pars["decfield"]);
+
+      return product.release();
+    }
+
+    virtual bool hasTimeBins() const { return true; }
+
+  private:
+    /** \brief Read a source list: one source per line, giving its name, its coordinates and the radius of its aperture
+        in degrees, separated by blanks. Blank lines and lines starting with # are skipped.
+        \param src_list The name of the source list file.
+    */
+    evtbin::LightCurve::ApertureCont_t readApertures(const std::string & src_list) const {
+      std::ifstream in(src_list.c_str());
+      if (!in) throw std::runtime_error("LightCurveApp: cannot open source list " + src_list);
+
+      evtbin::LightCurve::ApertureCont_t apertures;
+      std::string line;
+      for (long line_num = 1; std::getline(in, line); ++line_num) {
+        std::string::size_type begin = line.find_first_not_of(" \t\r");
+        if (std::string::npos == begin || '#' == line[begin]) continue;
+
+        std::istringstream is(line);
+        std::string name;
+        double ra = 0.;
+        double dec = 0.;
+        double radius = 0.;
+        if (!(is >> name >> ra >> dec >> radius)) {
+          std::ostringstream os;
+          os << "LightCurveApp: line " << line_num << " of source list " << src_list <<
+            " does not give a name, two coordinates and a radius";
+          throw std::runtime_error(os.str());
+        }
+        apertures.push_back(evtbin::LightCurve::Aperture(name, ra, dec, radius));
+      }
+      return apertures;
     }
 };
 
@@ -432,7 +720,7 @@ class MultiSpectraApp : public EvtBinAppBase {
       using namespace evtbin;
 
       // Get binner for time from time bin configuration object.
-      std::unique_ptr<Binner> time_binner(m_bin_config->createTimeBinner(pars));
+      std::unique_ptr<Binner> time_binner(createTimeBinner(pars));
 
       // Get binner for energy from energy application object.
       std::unique_ptr<Binner> energy_binner(m_bin_config->createEnergyBinner(pars));
@@ -448,6 +736,8 @@ class MultiSpectraApp : public EvtBinAppBase {
         *energy_binner, *ebounds, *gti);
 
     }
+
+    virtual bool hasTimeBins() const { return true; }
 };
 
 /** \class GtBinApp
@@ -490,6 +780,16 @@ class GtBinApp : public st_app::StApp {
       pars.setCase("tbinalg", "SNR", "snratio");
       pars.setCase("tbinalg", "SNR", "lcemin");
       pars.setCase("tbinalg", "SNR", "lcemax");
+      pars.setCase("tbinalg", "BB", "tstart");
+      pars.setCase("tbinalg", "BB", "tstop");
+      pars.setCase("tbinalg", "QUANT", "tstart");
+      pars.setCase("tbinalg", "QUANT", "tstop");
+      pars.setCase("tbinalg", "QUANT", "ntimebins");
+      pars.setCase("tbinalg", "PHASE", "tstart");
+      pars.setCase("tbinalg", "PHASE", "tstop");
+      pars.setCase("tbinalg", "PHASE", "ntimebins");
+      pars.setCase("tbinalg", "PHASE", "pepoch");
+      pars.setCase("tbinalg", "PHASE", "f0");
 #if 0
       pars.setCase("algorithm", "LC", "tfield");
 
@@ -505,6 +805,9 @@ class GtBinApp : public st_app::StApp {
       pars.setCase("ebinalg", "LOG", "emin");
       pars.setCase("ebinalg", "LOG", "emax");
       pars.setCase("ebinalg", "LOG", "enumbins");
+      pars.setCase("ebinalg", "QUANT", "emin");
+      pars.setCase("ebinalg", "QUANT", "emax");
+      pars.setCase("ebinalg", "QUANT", "enumbins");
 
 #if 0
       pars.setCase("algorithm", "PHA1", "efield");
@@ -537,6 +840,7 @@ class GtBinApp : public st_app::StApp {
 
       if (0 == algorithm.compare("CCUBE")) app.reset(new CountCubeApp("gtbin"));
       else if (0 == algorithm.compare("CMAP")) app.reset(new CountMapApp("gtbin"));
+      else if (0 == algorithm.compare("CMAPSTACK")) app.reset(new CountMapStackApp("gtbin"));
       else if (0 == algorithm.compare("LC")) app.reset(new LightCurveApp("gtbin"));
       else if (0 == algorithm.compare("PHA1")) app.reset(new SingleSpectrumApp("gtbin"));
       else if (0 == algorithm.compare("PHA2")) app.reset(new MultiSpectraApp("gtbin"));
@@ -64,9 +64,11 @@ infile [file]
 algorithm [string]
     Indicates which specific binning to perform by indicating the
     type of output file produced. Legal values are CMAP (count map
-    binned in sky X-Y projected coordinates), LC (light curve binned
-    in time only), PHA1 (spectrum binned in energy), and PHA2
-    (spectra binned in energy for a series of time ranges/bins).
+    binned in sky X-Y projected coordinates), CMAPSTACK (a series
+    of count maps, one per time bin, binned in a single pass), LC
+    (light curve binned in time only), PHA1 (spectrum binned in
+    energy), and PHA2 (spectra binned in energy for a series of time
+    ranges/bins).
 
 evfile [file]
     Name of input event file, FT1 format or equivalent.
@@ -85,7 +87,16 @@ scfile [file]
 tbinalg = LIN [string]
     Indicates how the time bins will be specified. Legal values
     are FILE (bins will be read from a bin definition file), LIN
-    (linearly uniform bins), and LOG (logarithmically uniform bins).
+    (linearly uniform bins), LOG (logarithmically uniform bins),
+    SNR (bins of constant signal-to-noise ratio), BB (Bayesian
+    Blocks computed directly from the individual event times),
+    QUANT (bins containing approximately equal numbers of events)
+    and PHASE (uniform bins of pulsar rotational phase, computed
+    from the event times with the given ephemeris). For PHASE, a
+    light curve has PHASE and PHASEDEL columns, holding the phase
+    and width of each bin, instead of TIME and TIMEDEL, and each
+    spectrum of a PHA2 file gets the same fraction of the
+    exposure as the width of its phase bin.
     This is only used if time binning is required by the output
     type selected by the algorithm parameter.
 
@@ -112,9 +123,52 @@ dtime [double]
     The width of linearly uniform bins. Only used if tbinalg
     is LIN.
 
+ntimebins [integer]
+    The number of equal-count bins or phase bins. Only used if
+    tbinalg is QUANT or PHASE.
+
+pepoch [double]
+    The epoch (MET) at which the pulsar phase is 0. Event times
+    must already be barycentered. Only used if tbinalg is PHASE.
+
+f0 [double]
+    The pulsar rotation frequency (Hz) at pepoch. Only used if
+    tbinalg is PHASE.
+
+(f1 = 0.) [double]
+    The first derivative of the frequency (Hz/s). Only used if
+    tbinalg is PHASE.
+
+(f2 = 0.) [double]
+    The second derivative of the frequency (Hz/s^2). Only used
+    if tbinalg is PHASE.
+
 tbinfile [file]
     The name of the time bin definition file. Only used if
     tbinalg is FILE.
+
+(ncpprior = 9.) [double]
+    The prior penalty for each change point between Bayesian
+    Blocks. Larger values give fewer, longer blocks. Only used
+    if tbinalg is BB.
+
+(lcexposure = no) [bool]
+    If yes, light curves get ONTIME and EXPOSURE columns holding
+    the ontime (overlap with the GTI) and the livetime-weighted
+    exposure of each time bin, computed in one pass through the
+    spacecraft data. Only used if algorithm is LC.
+
+(srclist = NONE) [file]
+    A text file listing sources, one per line, each given by its
+    name, its two coordinates (in the coordinate system of the
+    rafield and decfield fields) and an aperture radius, all in
+    degrees. If given, LC makes one light curve per source from a
+    single pass over the events, counting each event in every
+    aperture which contains it. The output RATE extension then
+    has COUNTS and ERROR vectors with one element per source, in
+    the order of the rows of the APERTURES extension, which gives
+    the name, center and radius of each aperture. Only used if
+    algorithm is LC.
 \endverbatim
 
     \subsection image Image Parameters
@@ -158,6 +212,36 @@ uselb = yes [bool]
     Indicates whether the xref and yref fields specify (RA, DEC)
     or (l, b).
 
+(compress = NONE) [string]
+    Tile compression of the output image (maps and cubes only).
+    Legal values are NONE, RICE and GZIP. If compression is
+    selected, the counts are compressed as they are written, as a
+    lossless 32 bit integer tile-compressed image extension named
+    COUNTS, one tile per image plane, directly after the primary
+    header (as fpack writes it). The primary array is then empty.
+
+(winimages = no) [bool]
+    If yes, CMAPSTACK writes one count map file per time bin,
+    named by inserting "_win" and the bin number before the
+    extension of outfile, each with the GTI, ONTIME and EXPOSURE
+    of its time bin. Otherwise a single cube is written, whose
+    third axis is time and whose WINDOWS extension gives the
+    start, stop, ontime and exposure of each plane.
+
+(evtypes = "") [string]
+    A list of event type bit masks, separated by commas, e.g.
+    "4,8,16,32" for the four PSF event types (CCUBE, CMAP and
+    HEALPIX only). If given, the events are read once and each
+    event is binned into a separate output for every listed mask
+    it has bits in common with. One output file is written per
+    mask, named by inserting "_evtype" and the mask before the
+    extension of outfile.
+
+(evtypefield = EVENT_TYPE) [string]
+    The field in the input file which contains the event type bit
+    array used by evtypes. The default value is that used in FT1
+    files.
+
 \endverbatim
 
     \subsection energybins Energy Binning Parameters
@@ -165,8 +249,9 @@ uselb = yes [bool]
 ebinalg = LOG [string]
     Indicates how the energy bins will be specified. Legal values
     are FILE (bins will be read from a bin definition file), LIN
-    (linearly uniform bins), and LOG (logarithmically uniform bins).
-    This is only used if energy binning is required by the output
+    (linearly uniform bins), LOG (logarithmically uniform bins),
+    and QUANT (bins containing approximately equal numbers of
+    events). This is only used if energy binning is required by the output
     type selected by the algorithm parameter.
 
 (efield = ENERGY) [string]
@@ -176,17 +261,17 @@ ebinalg = LOG [string]
 
 emin [double]
     The lowest energy of the first interval for linearly or
-    logarithmically uniform bins. Only used if ebinalg
-    is LIN or LOG.
+    logarithmically uniform or equal-count bins. Only used if
+    ebinalg is LIN, LOG or QUANT.
 
 emax [double]
     The highest energy of the last interval for linearly or
-    logarithmically uniform bins. Only used if ebinalg
-    is LIN or LOG.
+    logarithmically uniform or equal-count bins. Only used if
+    ebinalg is LIN, LOG or QUANT.
 
 enumbins [integer]
-    The number of bins for logarithmically uniform bins. Only
-    used if ebinalg is LOG.
+    The number of bins for logarithmically uniform or equal-count
+    bins. Only used if ebinalg is LOG or QUANT.
 
 denergy [double]
     The width of linearly uniform bins. Only used if ebinalg
@@ -197,6 +282,27 @@ ebinfile [file]
     ebinalg is FILE.
 \endverbatim
 
+    \subsection detectors Multiple Detector Parameters
+\verbatim
+(perdet = no) [bool]
+    If yes, each file of an evfile list (given as @list) is binned
+    as a separate detector, and one output file is written for each
+    detector, named by inserting "_" and the detector's DETNAM
+    before the extension of outfile. Detectors are binned
+    concurrently. Time bins are defined once from all the files;
+    for GBM data, each detector's energy bins come from its own
+    EBOUNDS extension.
+
+(sumfile = NONE) [file]
+    If perdet is yes, the name of an additional light curve summed
+    over all detectors, made from the counts binned for each
+    detector. Only used if algorithm is LC or PHA2.
+
+(nthreads = 0) [integer]
+    The number of threads used to bin detectors when perdet is yes.
+    If 0, one thread per hardware thread is used.
+\endverbatim
+
     <a name="gtbindef_parameters"></a>
     \section gtbindef_parameters Gtbindef Application
     The gtbindef application is a utility to allow users to
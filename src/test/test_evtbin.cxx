@@ -7,18 +7,26 @@
 #include <algorithm>
 #include <cmath>
 #include <cstddef>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <memory>
+#include <numeric>
+#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 // Class encapsulating a Bayesian block binner.
 #include "evtbin/BayesianBinner.h"
 // Class encapsulating a binner configuration helper object.
 #include "evtbin/BinConfig.h"
+// Class encapsulating a binner of integer channels.
+#include "evtbin/ChannelBinner.h"
 // Class encapsulating a count map.
 #include "evtbin/CountMap.h"
+#include "evtbin/CountMapStack.h"
 // Class encapsulating a count cube.
 #include "evtbin/CountCube.h"
 // Glass encapsulating GTIs
@@ -27,6 +35,10 @@
 #include "evtbin/Hist1D.h"
 // Class encapsulating a 2 dimensional histogram.
 #include "evtbin/Hist2D.h"
+// Class encapsulating a 3 dimensional histogram.
+#include "evtbin/Hist3D.h"
+// Class encapsulating an N dimensional histogram with compile-time binner types.
+#include "evtbin/HistND.h"
 // Light curve abstractions.
 #include "evtbin/LightCurve.h"
 // Class encapsulating description of a const s/n binner.
@@ -37,12 +49,17 @@
 #include "evtbin/LogBinner.h"
 // Class encapsulating description of a binner with ordered but otherwise arbitrary bins.
 #include "evtbin/OrderedBinner.h"
+#include "evtbin/PhaseBinner.h"
+#include "evtbin/ProductPool.h"
+#include "evtbin/QuantileSketch.h"
 // Class encapsulating description of a HEALPIX binner 
 #include "evtbin/HealpixBinner.h"
 // Class encapsulating description of a HEALPIX map
 #include "evtbin/HealpixMap.h"
 // Class for binning into Hist objects from tip objects:
 #include "evtbin/RecordBinFiller.h"
+// Class for reading uncompressed tables directly through a memory mapping.
+#include "evtbin/MappedEventTable.h"
 // Multiple spectra abstractions.
 #include "evtbin/MultiSpec.h"
 // Single spectrum abstractions.
@@ -62,6 +79,8 @@
 #include "st_stream/StreamFormatter.h"
 // Tip File access.
 #include "tip/IFileSvc.h"
+// Tip Image access.
+#include "tip/Image.h"
 // Tip Table access.
 #include "tip/Table.h"
 // Tip type definitions
@@ -72,6 +91,18 @@ using namespace evtbin;
 
 const std::string s_cvs_id("$Name:  $");
 
+namespace {
+  // Light curve which lets the test seek its time window itself.
+  class WindowLightCurve : public LightCurve {
+    public:
+      WindowLightCurve(const std::string & event_file, const std::string & event_table, const std::string & sc_file,
+        const std::string & sc_table, const Binner & binner, const Gti & gti):
+        LightCurve(event_file, event_table, sc_file, sc_table, binner, gti) {}
+
+      using DataProduct::seekTimeWindow;
+  };
+}
+
 /** \class EvtBinTest
     \brief Application singleton for evtbin test program.
 */
@@ -119,6 +150,34 @@ class EvtBinTest : public st_app::StApp {
 
     void testMultipleFiles();
 
+    void testMappedEventTable();
+
+    void testQuantileSketch();
+
+    void testPhaseBinner();
+
+    void testChannelBinner();
+
+    void testProductPool();
+
+    void testDeferredExposure();
+
+    void testBinExposure();
+
+    void testRebin();
+
+    void testHistND();
+
+    void testEventTypes();
+
+    void testCountMapStack();
+
+    void testApertureLightCurve();
+
+    void testDetectorExposure();
+
+    void testTimeWindow();
+
   private:
     st_stream::StreamFormatter m_os;
     std::string m_data_dir;
@@ -184,6 +243,34 @@ void EvtBinTest::run() {
   testBayesianBinner();
   // Test getting input from multiple files:
   testMultipleFiles();
+  // Test reading input through a memory mapping:
+  testMappedEventTable();
+  // Test approximate quantiles:
+  testQuantileSketch();
+  // Test pulse phase binner:
+  testPhaseBinner();
+  // Test integer channel binner:
+  testChannelBinner();
+  // Test concurrent binning of several products:
+  testProductPool();
+  // Test computing exposure while binning:
+  testDeferredExposure();
+  // Test ontime and exposure of each light curve bin:
+  testBinExposure();
+  // Test deriving coarser products from a master product:
+  testRebin();
+  // Test N dimensional histogram:
+  testHistND();
+  // Test splitting sky products by event type:
+  testEventTypes();
+  // Test count map stacks:
+  testCountMapStack();
+  // Test aperture light curves:
+  testApertureLightCurve();
+  // Test exposure of detectors binned concurrently:
+  testDetectorExposure();
+  // Test seeking the time window of time-ordered input:
+  testTimeWindow();
 
   // Report problems, if any.
   if (m_failed) throw std::runtime_error("Unit test failed");
@@ -436,7 +523,83 @@ void EvtBinTest::testOrderedBinner() {
       m_failed = true;
       std::cerr << msg << value << ") returned " << index << ", not a negative index" << std::endl;
     }
-  
+
+    // Not a number.
+    value = std::numeric_limits<double>::quiet_NaN();
+    index = binner.computeIndex(value);
+    if (0 <= index) {
+      m_failed = true;
+      std::cerr << msg << value << ") returned " << index << ", not a negative index" << std::endl;
+    }
+
+    // Many bins of very uneven widths, with gaps, adjacent bins and empty bins. Compare every lookup with a plain
+    // binary search of the intervals.
+    OrderedBinner::IntervalCont_t many_intervals;
+    double edge = 1.e5;
+    for (int ii = 0; ii != 100000; ++ii) {
+      double width = (0 == ii % 97) ? 0. : std::pow(10., 4. * rand() / RAND_MAX - 3.);
+      many_intervals.push_back(Binner::Interval(edge, edge + width));
+      edge += width;
+      if (0 == ii % 3) edge += std::pow(10., 4. * rand() / RAND_MAX - 3.);
+    }
+    OrderedBinner many_binner(many_intervals);
+    double lowest = many_intervals.front().begin();
+    double highest = many_intervals.back().end();
+    long num_mismatch = 0;
+    for (int ii = 0; ii != 1000000; ++ii) {
+      // Mostly random values, plus the exact boundaries of bins.
+      if (ii % 4) value = lowest - 1. + (highest - lowest + 2.) * rand() / RAND_MAX;
+      else if (ii % 8) value = many_intervals[rand() % many_intervals.size()].begin();
+      else value = many_intervals[rand() % many_intervals.size()].end();
+
+      OrderedBinner::IntervalCont_t::const_iterator bound =
+        std::upper_bound(many_intervals.begin(), many_intervals.end(), value);
+      long expected = -1;
+      if (many_intervals.begin() != bound && (bound - 1)->end() > value) expected = bound - 1 - many_intervals.begin();
+
+      index = many_binner.computeIndex(value);
+      if (index != expected && 10 > num_mismatch++) {
+        m_failed = true;
+        std::cerr << msg << value << ") returned " << index << ", not " << expected << std::endl;
+      }
+    }
+
+    // Starting from the bin of a previous value must not change the result, whether the values are in order or not.
+    msg = "OrderedBinner::computeNextIndex(";
+    num_mismatch = 0;
+    long cursor = -1;
+    for (int ii = 0; ii != 1000000; ++ii) {
+      // Mostly increasing values with small steps, and occasional jumps backwards and forwards.
+      if (0 == ii % 1000) value = lowest - 1. + (highest - lowest + 2.) * rand() / RAND_MAX;
+      else value += .05 * rand() / RAND_MAX;
+
+      long expected = many_binner.computeIndex(value);
+      index = many_binner.computeNextIndex(value, cursor);
+      if (index != expected && 10 > num_mismatch++) {
+        m_failed = true;
+        std::cerr << msg << value << ", " << cursor << ") returned " << index << ", not " << expected << std::endl;
+      }
+      if (0 <= index) cursor = index;
+    }
+
+    // Open-ended bins, for example from a bin definition file, are looked up by binary search.
+    msg = "OrderedBinner::computeIndex(";
+    OrderedBinner::IntervalCont_t open_intervals;
+    open_intervals.push_back(Binner::Interval(-std::numeric_limits<double>::infinity(), 0.));
+    open_intervals.push_back(Binner::Interval(0., 1.));
+    open_intervals.push_back(Binner::Interval(2., std::numeric_limits<double>::infinity()));
+    OrderedBinner open_binner(open_intervals);
+    const double open_values[] = { -1.e300, -1., 0., .5, 1.5, 2., 1.e300, std::numeric_limits<double>::infinity() };
+    const long open_expected[] = { 0, 0, 1, 1, -1, 2, 2, -1 };
+    for (int ii = 0; ii != 8; ++ii) {
+      index = open_binner.computeIndex(open_values[ii]);
+      if (open_expected[ii] != index) {
+        m_failed = true;
+        std::cerr << msg << open_values[ii] << ") returned " << index << " for open-ended bins, not " << open_expected[ii] <<
+          std::endl;
+      }
+    }
+
   } catch (const std::exception &) {
     std::cerr << msg << " threw when given a set of intervals which are legal (i.e. in order)" << std::endl;
     m_failed = true;
@@ -466,6 +629,60 @@ void EvtBinTest::testHealpixBinner() {
   catch(const std::exception & x) {
     m_os.info() << "Expected: failed to create a Healpix Binner with order 13 : " << x.what() << std::endl;
   }
+
+  //test that the bulk pixelization agrees exactly with the scalar one, including near the poles
+  std::vector<double> coord1;
+  std::vector<double> coord2;
+  for(int ii=0;ii!=2000;++ii){
+    coord1.push_back(std::fmod(ii*137.50776405,360.)-(ii%7==0?360.:0.));
+    coord2.push_back(-90.+std::fmod(ii*0.09*ii,180.));
+  }
+  coord2[0]=90.;
+  coord2[1]=-90.;
+  coord2[2]=89.9999;
+  coord2[3]=-89.9999;
+  coord2[4]=41.8103149; // z = 2/3
+  for(int order=0;order<=12;order+=3){
+    for(int scheme=0;scheme!=2;++scheme){
+      HealpixBinner binner(order, scheme ? NEST : RING, false, nullString, "Binner");
+      std::vector<long> bulk(coord1.size());
+      binner.computeIndices(&coord1[0], &coord2[0], coord1.size(), &bulk[0]);
+      for(std::vector<double>::size_type ii=0;ii!=coord1.size();++ii){
+        long scalar=binner.computeIndex(coord1[ii],coord2[ii]);
+        if(scalar!=bulk[ii]){
+          m_failed=true;
+          std::cerr << "HealpixBinner::computeIndices(order " << order << ", " << (scheme ? "NEST" : "RING") << ") returned " <<
+            bulk[ii] << " for (" << coord1[ii] << ", " << coord2[ii] << "), not " << scalar << std::endl;
+          break;
+        }
+      }
+    }
+  }
+
+  //test the reverse pixel index of partial-sky maps, both the dense (order 6) and sorted (order 11) lookups
+  for(int order=6;order<=11;order+=5){
+    HealpixBinner binner(order, NEST, false, "DISK(83.4,22.0,5.)", "Binner");
+    std::unique_ptr<Binner> clone(binner.clone());
+    const std::vector<int> & pixels = binner.pixelIndices();
+    if(pixels.empty() || long(pixels.size()) != binner.getNumBins()) {
+      m_failed=true;
+      std::cerr << msg << order << ") for a disk region has " << pixels.size() << " pixels and " <<
+        binner.getNumBins() << " bins" << std::endl;
+    }
+    for(std::vector<int>::size_type local=0;local!=pixels.size();++local){
+      if(long(local)!=binner.computeIndex(pixels[local]) || long(local)!=clone->computeIndex(pixels[local])) {
+        m_failed=true;
+        std::cerr << msg << order << ") mapped global pixel " << pixels[local] << " to " <<
+          binner.computeIndex(pixels[local]) << ", not " << local << std::endl;
+        break;
+      }
+    }
+    // pixel on the other side of the sky is not in the region
+    if(-1!=binner.computeIndex(263.4, -22.0)) {
+      m_failed=true;
+      std::cerr << msg << order << ") did not return -1 for a direction outside the region" << std::endl;
+    }
+  }
 }
 
 void EvtBinTest::testHealpixMap() {
@@ -488,6 +705,76 @@ void EvtBinTest::testHealpixMap() {
   healpix_cube.binInput();
   healpix_cube.writeOutput("test_evtbin", "test.healcube");
 
+  //multi-resolution case: coarser NESTED maps derived from the binned one must conserve counts
+  HealpixMap healpix_pyramid(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA",
+			     "NESTED", 6, nullString,
+			     true, energy_binner2, energy_binner2, true,gti);
+  healpix_pyramid.setPyramidOrderMin(0);
+  healpix_pyramid.setMocThreshold(5.);
+  healpix_pyramid.binInput();
+  healpix_pyramid.writeOutput("test_evtbin", "test_pyramid.healcube");
+  std::unique_ptr<const tip::Table> fine_table(tip::IFileSvc::instance().readTable("test_pyramid.healcube", "SKYMAP"));
+  std::unique_ptr<const tip::Table> coarse_table(tip::IFileSvc::instance().readTable("test_pyramid.healcube", "SKYMAP_0"));
+  if (12 != coarse_table->getNumRecords()) {
+    m_failed = true;
+    std::cerr << "Unexpected: SKYMAP_0 extension of test_pyramid.healcube has " << coarse_table->getNumRecords() <<
+      " rows, not 12" << std::endl;
+  }
+  double fine_total = 0.;
+  double coarse_total = 0.;
+  for (tip::Table::ConstIterator itor = fine_table->begin(); itor != fine_table->end(); ++itor)
+    fine_total += (*itor)["CHANNEL1"].get();
+  for (tip::Table::ConstIterator itor = coarse_table->begin(); itor != coarse_table->end(); ++itor)
+    coarse_total += (*itor)["CHANNEL1"].get();
+  if (fine_total != coarse_total) {
+    m_failed = true;
+    std::cerr << "Unexpected: SKYMAP_0 extension of test_pyramid.healcube has " << coarse_total <<
+      " counts in CHANNEL1, not " << fine_total << std::endl;
+  }
+
+  //multi-order map: cells must tile the region without overlap, conserve counts, and only be split above threshold
+  std::vector<std::int64_t> uniq;
+  HealpixMap::Cont_t moc_data;
+  healpix_pyramid.computeMoc(5., 0, uniq, moc_data);
+  double moc_area = 0.;
+  double moc_total = 0.;
+  for (std::vector<std::int64_t>::size_type index = 0; index != uniq.size(); ++index) {
+    int order = 0;
+    while ((std::int64_t(4) << (2 * (order + 1))) <= uniq[index]) ++order;
+    moc_area += std::pow(4., 6 - order);
+    for (HealpixMap::Cont_t::size_type e_index = 0; e_index != moc_data.size(); ++e_index) {
+      moc_total += moc_data[e_index][index];
+      if (order < 6 && 5. < moc_data[e_index][index]) {
+        m_failed = true;
+        std::cerr << "Unexpected: multi-order map cell " << uniq[index] << " has more counts than the threshold" << std::endl;
+      }
+    }
+  }
+  if (12. * 4096. != moc_area) {
+    m_failed = true;
+    std::cerr << "Unexpected: multi-order map covers " << moc_area << " order 6 pixels, not " << 12 * 4096 << std::endl;
+  }
+  double cube_total = 0.;
+  std::vector<int> pixels;
+  HealpixMap::Cont_t fine;
+  healpix_pyramid.degrade(6, pixels, fine);
+  for (HealpixMap::Cont_t::size_type e_index = 0; e_index != fine.size(); ++e_index) {
+    for (std::vector<double>::const_iterator itor = fine[e_index].begin(); itor != fine[e_index].end(); ++itor) cube_total += *itor;
+  }
+  if (cube_total != moc_total) {
+    m_failed = true;
+    std::cerr << "Unexpected: multi-order map has " << moc_total << " counts, not " << cube_total << std::endl;
+  }
+
+  //coarser maps cannot be derived from RING maps
+  try {
+    healpix_cube.setPyramidOrderMin(0);
+    m_failed = true;
+    std::cerr << "Unexpected: HealpixMap::setPyramidOrderMin accepted a RING map" << std::endl;
+  } catch (const std::exception &) {
+    // OK, supposed to fail.
+  }
+
 
 }
 
@@ -682,7 +969,63 @@ void EvtBinTest::testMultiSpectra() {
   }
 
   // Make sure we can extract a 2D histogram from spectrum.
-  spectrum.getHist2D();
+  const Hist2D & hist = spectrum.getHist2D();
+
+  // Compare the spectra written, which are written in blocks of rows, with the histogram.
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable("PHA2.pha", "SPECTRUM"));
+  if (10 != table->getNumRecords()) {
+    m_failed = true;
+    std::cerr << "PHA2.pha has " << table->getNumRecords() << " spectra, not 10" << std::endl;
+  }
+  long row = 0;
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor, ++row) {
+    std::vector<double> counts;
+    std::vector<double> stat_err;
+    std::vector<long> channel;
+    (*itor)["COUNTS"].get(counts);
+    (*itor)["STAT_ERR"].get(stat_err);
+    (*itor)["CHANNEL"].get(channel);
+    long spec_num = 0;
+    (*itor)["SPEC_NUM"].get(spec_num);
+    if (row + 1 != spec_num || 100u != counts.size() || 100u != stat_err.size() || 100u != channel.size()) {
+      m_failed = true;
+      std::cerr << "Row " << row << " of PHA2.pha is spectrum number " << spec_num << " with " << counts.size() <<
+        " channels" << std::endl;
+      continue;
+    }
+    for (long index = 0; index != 100; ++index) {
+      if (hist[row][index] != counts[index] || index + 1 != channel[index] ||
+        std::fabs(spectrum.calcStatErr(hist[row][index]) - stat_err[index]) > 1.e-6 * stat_err[index]) {
+        m_failed = true;
+        std::cerr << "Row " << row << ", channel " << channel[index] << " of PHA2.pha has " << counts[index] <<
+          " counts with error " << stat_err[index] << ", not " << hist[row][index] << " with error " <<
+          spectrum.calcStatErr(hist[row][index]) << std::endl;
+      }
+    }
+  }
+
+  // Spectra whose time and energy bins are both ordered bins are binned by a HistND rather than a Hist2D. Their sum
+  // over energy must be the light curve binned with the same time bins.
+  OrderedBinner::IntervalCont_t time_intervals;
+  for (long index = 0; index != 10; ++index) {
+    time_intervals.push_back(Binner::Interval(m_t_start + index * .1 * (m_t_stop - m_t_start),
+      m_t_start + (index + .5) * .1 * (m_t_stop - m_t_start)));
+  }
+  OrderedBinner ordered_time_binner(time_intervals, "TIME");
+  OrderedBinner ordered_energy_binner(OrderedBinner::IntervalCont_t(1, Binner::Interval(0., 1.e10)), "ENERGY");
+  MultiSpec ordered_spectrum(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", ordered_time_binner, ordered_energy_binner,
+    ordered_energy_binner, gti);
+  ordered_spectrum.binInput();
+  LightCurve ordered_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", ordered_time_binner, gti);
+  ordered_lc.binInput();
+  LightCurve summed_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", ordered_time_binner, gti);
+  summed_lc.addCounts(ordered_spectrum.getHist());
+  if (!std::equal(ordered_lc.getHist1D().begin(), ordered_lc.getHist1D().end(), summed_lc.getHist1D().begin())) {
+    m_failed = true;
+    std::cerr << "Spectra with ordered time and energy bins do not sum to the light curve with the same time bins" <<
+      std::endl;
+  }
+  ordered_spectrum.writeOutput("test_evtbin", "PHA2_ordered.pha");
 }
 
 void EvtBinTest::testCountMap() {
@@ -730,6 +1073,69 @@ void EvtBinTest::testCountCube() {
   // Write the count cube to an output file.
   count_cube.writeOutput("test_evtbin", "test.ccube");
 
+  // Write the same count cube again as a tile-compressed image, and compare it to the uncompressed one.
+  count_cube.setImageCompression("RICE");
+  count_cube.writeOutput("test_evtbin", "test_compressed.ccube");
+
+  std::vector<float> uncompressed;
+  std::vector<float> compressed;
+  std::unique_ptr<const tip::Image> image(tip::IFileSvc::instance().readImage("test.ccube", ""));
+  image->get(uncompressed);
+  image.reset(tip::IFileSvc::instance().readImage("test_compressed.ccube", "COUNTS"));
+  image->get(compressed);
+  if (uncompressed != compressed) {
+    m_failed = true;
+    std::cerr << "Unexpected: tile-compressed count cube test_compressed.ccube differs from test.ccube" << std::endl;
+  }
+
+  // Readers which look for the counts in the first extension, as fpack writes them, must find the image and its WCS.
+  std::unique_ptr<const tip::Image> primary(tip::IFileSvc::instance().readImage("test.ccube", ""));
+  image.reset(tip::IFileSvc::instance().readImage("test_compressed.ccube", "1"));
+  image->get(compressed);
+  if (uncompressed != compressed) {
+    m_failed = true;
+    std::cerr << "Unexpected: first extension of test_compressed.ccube differs from test.ccube" << std::endl;
+  }
+  const char * wcs_string_key[] = { "CTYPE1", "CTYPE2", "CTYPE3" };
+  for (std::size_t ii = 0; ii != sizeof(wcs_string_key) / sizeof(wcs_string_key[0]); ++ii) {
+    std::string expected;
+    std::string found;
+    primary->getHeader()[wcs_string_key[ii]].get(expected);
+    image->getHeader()[wcs_string_key[ii]].get(found);
+    if (expected != found) {
+      m_failed = true;
+      std::cerr << "Unexpected: first extension of test_compressed.ccube has " << wcs_string_key[ii] << " == " <<
+        found << ", not " << expected << std::endl;
+    }
+  }
+  const char * wcs_double_key[] = { "CRVAL1", "CRVAL2", "CRPIX1", "CRPIX2", "CDELT1", "CDELT2" };
+  for (std::size_t ii = 0; ii != sizeof(wcs_double_key) / sizeof(wcs_double_key[0]); ++ii) {
+    double expected = 0.;
+    double found = 0.;
+    primary->getHeader()[wcs_double_key[ii]].get(expected);
+    image->getHeader()[wcs_double_key[ii]].get(found);
+    if (expected != found) {
+      m_failed = true;
+      std::cerr << "Unexpected: first extension of test_compressed.ccube has " << wcs_double_key[ii] << " == " <<
+        found << ", not " << expected << std::endl;
+    }
+  }
+
+  // The compressed image is written only once, so the primary array must be empty.
+  image.reset(tip::IFileSvc::instance().readImage("test_compressed.ccube", ""));
+  if (!image->getImageDimensions().empty()) {
+    m_failed = true;
+    std::cerr << "Unexpected: primary array of test_compressed.ccube is not empty" << std::endl;
+  }
+
+  // Unknown compression algorithms are rejected.
+  try {
+    count_cube.setImageCompression("JPEG");
+    m_failed = true;
+    std::cerr << "Unexpected: DataProduct::setImageCompression accepted JPEG compression" << std::endl;
+  } catch (const std::exception &) {
+    // OK, supposed to fail.
+  }
 }
 
 void EvtBinTest::testBinConfig() {
@@ -929,6 +1335,64 @@ void EvtBinTest::testBinConfig() {
         binner->getInterval(binner->getNumBins() - 1).end() << " not 30000." << std::endl;
     }
 
+    delete binner; binner = 0;
+
+    // Now test equal-count energy bins, defined from the energies in the event file.
+    par_group["efield"] = "ENERGY";
+    par_group["ebinalg"] = "QUANT";
+    par_group["emin"] = 30.;
+    par_group["emax"] = 300000.;
+    par_group["enumbins"] = 4;
+
+    // Save these parameters.
+    par_group.Save();
+
+    // Prompt for energy values. Again, they're all hidden.
+    config->energyParPrompt(par_group);
+
+    // Test creating the energy binner.
+    binner = config->createEnergyBinner(par_group);
+
+    if (4 != binner->getNumBins()) {
+      m_failed = true;
+      std::cerr << "BinConfig::createEnergyBinner created an equal-count binner with " << binner->getNumBins() <<
+        " bins, not 4" << std::endl;
+    } else if (30. != binner->getInterval(0).begin() || 300000. != binner->getInterval(3).end()) {
+      m_failed = true;
+      std::cerr << "BinConfig::createEnergyBinner created an equal-count binner spanning [" << binner->getInterval(0).begin() <<
+        ", " << binner->getInterval(3).end() << "), not [30., 300000.)" << std::endl;
+    } else {
+      // Count the events in each bin, which should agree to within the rank error of the two edges of each bin.
+      std::vector<long> counts(4, 0);
+      long num_events = 0;
+      std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(m_ft1_file, "EVENTS"));
+      for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+        double energy = (*itor)["ENERGY"].get();
+        long index = binner->computeIndex(energy);
+        if (0 <= index) { ++counts[index]; ++num_events; }
+      }
+      double tolerance = 2.e-3 * num_events + 1.;
+      for (long index = 0; index != 4; ++index) {
+        if (tolerance < std::fabs(counts[index] - num_events / 4.)) {
+          m_failed = true;
+          std::cerr << "BinConfig::createEnergyBinner created an equal-count binner with " << counts[index] <<
+            " events in bin " << index << ", not about " << num_events / 4. << std::endl;
+        }
+      }
+
+      // The ebounds use the same parameters, so they must have the same bins.
+      std::unique_ptr<Binner> ebounds(config->createEbounds(par_group));
+      bool same_bins = ebounds->getNumBins() == binner->getNumBins();
+      for (long index = 0; same_bins && index != binner->getNumBins(); ++index)
+        same_bins = ebounds->getInterval(index).begin() == binner->getInterval(index).begin() &&
+          ebounds->getInterval(index).end() == binner->getInterval(index).end();
+      if (!same_bins) {
+        m_failed = true;
+        std::cerr << "BinConfig::createEbounds created equal-count bins which differ from those of createEnergyBinner" <<
+          std::endl;
+      }
+    }
+
   } catch (const std::exception & x) {
     m_failed = true;
     std::cerr << "testBinConfig encountered an unexpected error: " << x.what() << std::endl;
@@ -1356,8 +1820,11 @@ void EvtBinTest::testGti() {
 void EvtBinTest::testConstSnBinner() {
   m_os.setMethod("testConstSnBinner()");
 
-  // Create test binner object.
+  // Create test binner object, and define its bins from a set of uniformly spaced times.
   ConstSnBinner binner(1., 101., 5., 1., 25.);
+  std::vector<double> ev_time_cont;
+  for (double ev_time = 1.; ev_time <= 102.; ++ev_time) ev_time_cont.push_back(ev_time);
+  binner.defineBins(ev_time_cont);
 
   // Check value before first bin.
   long index = binner.computeIndex(0.);
@@ -1373,8 +1840,9 @@ void EvtBinTest::testConstSnBinner() {
     m_os.err() << "In first binner test, index of 1. was " << index << ", not -1" << std::endl;
   }
 
-  // Check values up through and including the end of the last bin.
-  for (double ev_time = 2.; ev_time <= 101.; ++ev_time) {
+  // Check values up through and including the end of the last bin. Binning is independent of the order of the
+  // values, so go backwards.
+  for (double ev_time = 101.; ev_time >= 2.; --ev_time) {
     index = binner.computeIndex(ev_time);
     long correct_index = long((ev_time - 2.)/25.);
     if (index != correct_index) {
@@ -1390,10 +1858,18 @@ void EvtBinTest::testConstSnBinner() {
     m_os.err() << "In first binner test, index of 102. was " << index << ", not -1" << std::endl;
   }
 
-  // Reset the binner.
+  // The last event closes the last bin exactly at the end of the interval.
+  if (4 != binner.getNumBins()) {
+    m_failed = true;
+    m_os.err() << "In first binner test, number of bins was " << binner.getNumBins() << ", not 4" << std::endl;
+  }
+
+  // Reset the binner, with some more times with larger step between each one.
   binner = ConstSnBinner(1., 101., 5., 1., 25.);
+  ev_time_cont.clear();
+  for (double ev_time = 2.; ev_time <= 101.; ev_time += 2.) ev_time_cont.push_back(ev_time);
+  binner.defineBins(ev_time_cont);
 
-  // Loop over some more times with larger step between each one.
   for (double ev_time = 2.; ev_time <= 101.; ev_time += 2.) {
     index = binner.computeIndex(ev_time);
     long correct_index = long((ev_time - 2.)/50.);
@@ -1410,11 +1886,14 @@ void EvtBinTest::testConstSnBinner() {
     m_os.err() << "In second binner test, index of 102. was " << index << ", not -1" << std::endl;
   }
 
-  // Reset the binner.
+  // Reset the binner, with some times which are not uniformly distributed, given in reverse order. Note upper cutoff
+  // is different from earlier tests because adding the sine to the event time makes the last times later than the
+  // binner's upper bound.
   binner = ConstSnBinner(1., 101., 5., 1., 25.);
+  ev_time_cont.clear();
+  for (double ev_time = 100.; ev_time >= 2.; --ev_time) ev_time_cont.push_back(ev_time + .1 * sin(ev_time));
+  binner.defineBins(ev_time_cont);
 
-  // Loop over some times which are not uniformly distributed. Note upper cutoff is different from earlier tests
-  // because adding the sine to the event time makes the last times later than the binner's upper bound.
   for (double ev_time = 2.; ev_time < 101.; ++ev_time) {
     double true_ev_time = ev_time + .1 * sin(ev_time);
     index = binner.computeIndex(true_ev_time);
@@ -1429,7 +1908,10 @@ void EvtBinTest::testConstSnBinner() {
   std::vector<double> background_coeffs(1, 1.);
   binner = ConstSnBinner(1., 101., 5., 1., 25., background_coeffs);
 
-  // Loop over twice as many times, but with the background of 1, the results will be the same as the second test.
+  // Use twice as many times, but with the background of 1, the results will be the same as the second test.
+  ev_time_cont.clear();
+  for (double ev_time = 1.5; ev_time <= 101.; ev_time += .5) ev_time_cont.push_back(ev_time);
+  binner.defineBins(ev_time_cont);
 
   // Check value before first bin.
   index = binner.computeIndex(0.);
@@ -1438,7 +1920,6 @@ void EvtBinTest::testConstSnBinner() {
     m_os.err() << "In fourth binner test, index of 0. was " << index << ", not -1" << std::endl;
   }
 
-  // Loop over some more times with smaller step between each one.
   for (double ev_time = 1.5; ev_time <= 101.; ev_time += .5) {
     index = binner.computeIndex(ev_time);
     long correct_index = long((ev_time - 1.5)/50.);
@@ -1455,6 +1936,36 @@ void EvtBinTest::testConstSnBinner() {
     m_os.err() << "In fourth binner test, index of 102. was " << index << ", not -1" << std::endl;
   }
 
+  // Reset the binner, and define bins from times and energies, where only every other event is in the energy band.
+  // The in-band events alone give the same bins as the second test, but every event must still be binned.
+  binner = ConstSnBinner(1., 101., 5., 1., 25.);
+  ev_time_cont.clear();
+  std::vector<double> ev_energy_cont;
+  for (double ev_time = 2.; ev_time <= 101.; ++ev_time) {
+    ev_time_cont.push_back(ev_time);
+    ev_energy_cont.push_back(0 == long(ev_time) % 2 ? 10. : 50.);
+  }
+  binner.defineBins(ev_time_cont, ev_energy_cont);
+
+  for (double ev_time = 2.; ev_time <= 101.; ++ev_time) {
+    index = binner.computeIndex(ev_time);
+    long correct_index = long((ev_time - 1.)/50.);
+    if (index != correct_index) {
+      m_failed = true;
+      m_os.err() << "In fifth binner test, index of " << ev_time << " was " << index << ", not " << correct_index << std::endl;
+    }
+  }
+
+  // Mismatched times and energies must be rejected.
+  try {
+    ev_energy_cont.pop_back();
+    binner.defineBins(ev_time_cont, ev_energy_cont);
+    m_failed = true;
+    m_os.err() << "In fifth binner test, defineBins did not throw when given fewer energies than times" << std::endl;
+  } catch (const std::logic_error &) {
+    // Expected.
+  }
+
 }
 
 void EvtBinTest::testBayesianBinner() {
@@ -1493,6 +2004,49 @@ void EvtBinTest::testBayesianBinner() {
       }
     }
   }
+
+  // Pruning candidate block starts must not change the result.
+  BayesianBinner pruned(intervals, cell_pop.begin(), "", 6., true);
+  if (pruned.getNumBins() != binner.getNumBins()) {
+    m_failed = true;
+    m_os.err() << "Number of pruned Bayesian blocks found was " << pruned.getNumBins() << ", not " <<
+      binner.getNumBins() << ", as expected." << std::endl;
+  } else {
+    for (long ii = 0; ii != binner.getNumBins(); ++ii) {
+      Binner::Interval expected(binner.getInterval(ii));
+      Binner::Interval interval(pruned.getInterval(ii));
+      if (interval.begin() != expected.begin() || interval.end() != expected.end()) {
+        m_failed = true;
+        m_os.err() << "Pruned interval[" << ii << "] is [" << interval.begin() << ", " << interval.end() << "], not [" <<
+          expected.begin() << ", " << expected.end() << "], as expected." << std::endl;
+      }
+    }
+  }
+
+  // Event mode: a burst ten times brighter than the background between 100 and 110, given as unsorted event
+  // times with one duplicate.
+  std::vector<double> event_time;
+  for (int ii = 0; ii < 100; ++ii) event_time.push_back(ii + .5);
+  for (int ii = 0; ii < 100; ++ii) event_time.push_back(100. + .1 * ii + .05);
+  for (int ii = 0; ii < 90; ++ii) event_time.push_back(110. + ii + .5);
+  event_time.push_back(150.5);
+  std::reverse(event_time.begin(), event_time.end());
+  BayesianBinner event_binner(0., 200., event_time, "TIME");
+  double event_cp[] = { 0., 100., 110., 200. };
+  if (3 != event_binner.getNumBins()) {
+    m_failed = true;
+    m_os.err() << "Number of event mode Bayesian blocks found was " << event_binner.getNumBins() << ", not 3, as expected." <<
+      std::endl;
+  } else {
+    for (long ii = 0; ii != event_binner.getNumBins(); ++ii) {
+      Binner::Interval interval(event_binner.getInterval(ii));
+      if (.5 < std::fabs(interval.begin() - event_cp[ii]) || .5 < std::fabs(interval.end() - event_cp[ii + 1])) {
+        m_failed = true;
+        m_os.err() << "Event mode interval[" << ii << "] is [" << interval.begin() << ", " << interval.end() <<
+          "], not close to [" << event_cp[ii] << ", " << event_cp[ii + 1] << "], as expected." << std::endl;
+      }
+    }
+  }
 }
 
 void EvtBinTest::testMultipleFiles() {
@@ -1604,5 +2158,952 @@ void EvtBinTest::testMultipleFiles() {
   }
 }
 
+void EvtBinTest::testMappedEventTable() {
+  using namespace tip;
+  m_os.setMethod("testMappedEventTable()");
+
+  // Fields to compare for each test file.
+  std::vector<std::pair<std::string, std::string> > file_field;
+  file_field.push_back(std::make_pair(m_ft1_file, std::string("TIME")));
+  file_field.push_back(std::make_pair(m_ft1_file, std::string("ENERGY")));
+  file_field.push_back(std::make_pair(m_ft1_file, std::string("DEC")));
+  file_field.push_back(std::make_pair(m_gbm_file, std::string("PHA")));
+
+  for (std::vector<std::pair<std::string, std::string> >::iterator itor = file_field.begin(); itor != file_field.end(); ++itor) {
+    const std::string & file_name(itor->first);
+    const std::string & field_name(itor->second);
+
+    if (!MappedEventTable::isMappable(file_name)) {
+      m_failed = true;
+      m_os.err() << "MappedEventTable::isMappable returned false for " << file_name << std::endl;
+      continue;
+    }
+
+    std::unique_ptr<const Table> table(IFileSvc::instance().readTable(file_name, "EVENTS"));
+    MappedEventTable mapped(file_name, "EVENTS");
+
+    if (table->getNumRecords() != mapped.getNumRecords()) {
+      m_failed = true;
+      m_os.err() << "MappedEventTable for " << file_name << " has " << mapped.getNumRecords() << " records, not " <<
+        table->getNumRecords() << ", as expected." << std::endl;
+      continue;
+    }
+
+    // Decode the whole column at once and compare to what tip reads.
+    std::vector<double> values(mapped.getNumRecords() + 1);
+    mapped.readColumn(field_name, 0, mapped.getNumRecords(), &values[0]);
+    long record = 0;
+    for (Table::ConstIterator t_itor = table->begin(); t_itor != table->end(); ++t_itor, ++record) {
+      double expected = (*t_itor)[field_name].get();
+      if (expected != values[record]) {
+        m_failed = true;
+        m_os.err() << "MappedEventTable for " << file_name << " read " << field_name << " = " << values[record] <<
+          " for record " << record << ", not " << expected << ", as expected." << std::endl;
+        break;
+      }
+    }
+  }
+
+  // Compressed or remote files must be handled by tip.
+  if (MappedEventTable::isMappable(m_ft1_file + ".gz") || MappedEventTable::isMappable("ftp://host/ft1.fits") ||
+    MappedEventTable::isMappable(m_ft1_file + "[EVENTS]")) {
+    m_failed = true;
+    m_os.err() << "MappedEventTable::isMappable returned true for a compressed, remote or filtered file" << std::endl;
+  }
+}
+
+void EvtBinTest::testQuantileSketch() {
+  m_os.setMethod("testQuantileSketch()");
+
+  // Add a permutation of the values 0 through num_values - 1, so that the true rank of each value is the value itself.
+  const long num_values = 100000;
+  const long step = 7919;
+  const double epsilon = 1.e-3;
+  QuantileSketch sketch(epsilon);
+  for (long ii = 0; ii != num_values; ++ii) sketch.add((ii * step) % num_values);
+
+  if (num_values != sketch.getCount()) {
+    m_failed = true;
+    m_os.err() << "QuantileSketch::getCount returned " << sketch.getCount() << ", not " << num_values << std::endl;
+  }
+
+  // Every quantile must be within the rank error of the exact quantile, and the extremes must be exact.
+  for (long ii = 0; ii <= 20; ++ii) {
+    double phi = ii / 20.;
+    double quantile = sketch.getQuantile(phi);
+    if (epsilon * num_values + 1. < std::fabs(quantile - phi * num_values)) {
+      m_failed = true;
+      m_os.err() << "QuantileSketch::getQuantile(" << phi << ") returned " << quantile << ", not within " <<
+        epsilon * num_values << " of " << phi * num_values << std::endl;
+    }
+  }
+  if (0. != sketch.getQuantile(0.) || num_values - 1. != sketch.getQuantile(1.)) {
+    m_failed = true;
+    m_os.err() << "QuantileSketch returned minimum " << sketch.getQuantile(0.) << " and maximum " << sketch.getQuantile(1.) <<
+      ", not 0 and " << num_values - 1 << std::endl;
+  }
+
+  // An empty sketch has no quantiles.
+  try {
+    QuantileSketch empty;
+    empty.getQuantile(.5);
+    m_failed = true;
+    m_os.err() << "QuantileSketch::getQuantile did not throw for an empty sketch" << std::endl;
+  } catch (const std::runtime_error &) {
+    // Expected.
+  }
+}
+
+void EvtBinTest::testPhaseBinner() {
+  m_os.setMethod("testPhaseBinner()");
+
+  // A pulsar with a period of 10 s at time 100, folded into 10 phase bins between times 100 and 200.
+  PhaseBinner binner(100., 200., 100., .1, 0., 0., 10, "TIME");
+
+  if (10 != binner.getNumBins() || !binner.isFolded() || 100. != binner.getDomain().begin() || 200. != binner.getDomain().end()) {
+    m_failed = true;
+    m_os.err() << "PhaseBinner has " << binner.getNumBins() << " bins over times [" << binner.getDomain().begin() << ", " <<
+      binner.getDomain().end() << "), not 10 bins over [100, 200)" << std::endl;
+  }
+
+  // Times and expected bins: phase 0 at the epoch, half a period later, just before and at the next period, and
+  // times outside the range.
+  double time[] = { 100., 105., 109.99, 110., 137.5, 199.99, 99.99, 200. };
+  long expected[] = { 0, 5, 9, 0, 7, 9, -1, -1 };
+  const long num_times = sizeof(time) / sizeof(time[0]);
+  std::vector<long> index(num_times);
+  binner.computeIndices(time, num_times, &index[0]);
+  for (long ii = 0; ii != num_times; ++ii) {
+    long scalar_index = binner.computeIndex(time[ii]);
+    if (expected[ii] != scalar_index || expected[ii] != index[ii]) {
+      m_failed = true;
+      m_os.err() << "PhaseBinner assigned time " << time[ii] << " to bin " << scalar_index << " (" << index[ii] <<
+        " in bulk), not " << expected[ii] << std::endl;
+    }
+  }
+
+  // Bins are in phase.
+  Binner::Interval interval = binner.getInterval(3);
+  if (std::fabs(interval.begin() - .3) > 1.e-12 || std::fabs(interval.end() - .4) > 1.e-12 || 1. != binner.getInterval(9).end()) {
+    m_failed = true;
+    m_os.err() << "PhaseBinner bin 3 is [" << interval.begin() << ", " << interval.end() << "), not [.3, .4)" << std::endl;
+  }
+
+  // With a frequency derivative, phase(t) = f0 * dt + f1 * dt^2 / 2, so 10 s after the epoch the phase is 1.1.
+  PhaseBinner spin_down(100., 200., 100., .1, .002, 0., 10, "TIME");
+  if (1 != spin_down.computeIndex(110.)) {
+    m_failed = true;
+    m_os.err() << "PhaseBinner with f1 = .002 assigned time 110 to bin " << spin_down.computeIndex(110.) << ", not 1" << std::endl;
+  }
+
+  // Phases are always in [0, 1), including before the epoch.
+  double phase = binner.computePhase(97.5);
+  if (std::fabs(phase - .75) > 1.e-12) {
+    m_failed = true;
+    m_os.err() << "PhaseBinner::computePhase(97.5) returned " << phase << ", not .75" << std::endl;
+  }
+
+  // Histograms filled in batches go through computeIndices, and must agree with histograms filled one value at a time.
+  Hist1D scalar_hist(binner);
+  Hist1D batch_hist(binner);
+  for (long ii = 0; ii != num_times; ++ii) scalar_hist.fillBin(time[ii]);
+  batch_hist.fillBins(std::vector<const double *>(1, time), num_times);
+  if (!std::equal(scalar_hist.begin(), scalar_hist.end(), batch_hist.begin())) {
+    m_failed = true;
+    m_os.err() << "Hist1D filled in a batch through PhaseBinner differs from Hist1D filled one time at a time" << std::endl;
+  }
+
+  // A folded light curve has phase columns instead of time columns.
+  Gti gti(m_ft1_file);
+  PhaseBinner lc_binner(m_t_start, m_t_stop, m_t_start, 1.e-3, 0., 0., 10, "TIME");
+  LightCurve lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", lc_binner, gti);
+  lc.binInput();
+  lc.writeOutput("test_evtbin", "test_phase.lc");
+  try {
+    std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable("test_phase.lc", "RATE"));
+    double first_phase = (*table->begin())["PHASE"].get();
+    double first_width = (*table->begin())["PHASEDEL"].get();
+    if (std::fabs(first_phase - .05) > 1.e-12 || std::fabs(first_width - .1) > 1.e-12) {
+      m_failed = true;
+      m_os.err() << "First bin of test_phase.lc has phase " << first_phase << " and width " << first_width <<
+        ", not .05 and .1" << std::endl;
+    }
+  } catch (const std::exception & x) {
+    m_failed = true;
+    m_os.err() << "Cannot read PHASE and PHASEDEL columns of test_phase.lc: " << x.what() << std::endl;
+  }
+}
+
+void EvtBinTest::testChannelBinner() {
+  m_os.setMethod("testChannelBinner()");
+
+  // A non-contiguous list of channels, not in increasing order, and the equivalent ordered binner.
+  ChannelBinner::ChannelCont_t channels;
+  channels.push_back(3);
+  channels.push_back(4);
+  channels.push_back(7);
+  channels.push_back(10);
+  channels.push_back(0);
+  ChannelBinner binner(channels, "PHA");
+
+  if (5 != binner.getNumBins()) {
+    m_failed = true;
+    m_os.err() << "ChannelBinner has " << binner.getNumBins() << " bins, not 5" << std::endl;
+  }
+
+  Binner::Interval interval = binner.getInterval(2);
+  if (6.5 != interval.begin() || 7.5 != interval.end()) {
+    m_failed = true;
+    m_os.err() << "ChannelBinner bin 2 is [" << interval.begin() << ", " << interval.end() << "), not [6.5, 7.5)" << std::endl;
+  }
+
+  // Each value must land in the bin whose interval contains it.
+  for (double value = -2.; value < 12.; value += .25) {
+    long expected = -1;
+    for (long index = 0; index != binner.getNumBins(); ++index) {
+      Binner::Interval bin = binner.getInterval(index);
+      if (bin.begin() <= value && value < bin.end()) expected = index;
+    }
+    if (expected != binner.computeIndex(value)) {
+      m_failed = true;
+      m_os.err() << "ChannelBinner assigned value " << value << " to bin " << binner.computeIndex(value) << ", not " <<
+        expected << std::endl;
+    }
+  }
+
+  // Channels in bulk, including channels in a gap, outside the range and values which round to a channel.
+  double channel[] = { 0., 3., 4., 5., 7., 10., -1., 11., 1000., 3.49, 3.5, -.5, std::numeric_limits<double>::quiet_NaN() };
+  long expected[] = { 4, 0, 1, -1, 2, 3, -1, -1, -1, 0, 1, 4, -1 };
+  const long num_channels = sizeof(channel) / sizeof(channel[0]);
+  std::vector<long> index(num_channels);
+  binner.computeIndices(channel, num_channels, &index[0]);
+  for (long ii = 0; ii != num_channels; ++ii) {
+    if (expected[ii] != index[ii] || binner.computeIndex(channel[ii]) != index[ii]) {
+      m_failed = true;
+      m_os.err() << "ChannelBinner assigned channel " << channel[ii] << " to bin " << index[ii] << " (" <<
+        binner.computeIndex(channel[ii]) << " one at a time), not " << expected[ii] << std::endl;
+    }
+  }
+
+  // A spectrum filled in a batch goes through computeIndices, and must agree with one filled a value at a time.
+  Hist1D scalar_hist(binner);
+  Hist1D batch_hist(binner);
+  for (long ii = 0; ii != num_channels; ++ii) scalar_hist.fillBin(channel[ii]);
+  batch_hist.fillBins(std::vector<const double *>(1, channel), num_channels);
+  if (!std::equal(scalar_hist.begin(), scalar_hist.end(), batch_hist.begin())) {
+    m_failed = true;
+    m_os.err() << "Hist1D filled in a batch through ChannelBinner differs from Hist1D filled one value at a time" << std::endl;
+  }
+
+  // Repeated channels are an error.
+  channels.push_back(4);
+  try {
+    ChannelBinner bad_binner(channels);
+    m_failed = true;
+    m_os.err() << "ChannelBinner did not throw when channel 4 was repeated" << std::endl;
+  } catch (const std::exception &) {
+  }
+}
+
+void EvtBinTest::testProductPool() {
+  m_os.setMethod("testProductPool()");
+
+  // LAT and GBM light curves, binned one after the other.
+  Gti gti(m_ft1_file);
+  Gti gbm_gti;
+  gbm_gti.insertInterval(m_gbm_t_start, m_gbm_t_stop);
+  LinearBinner binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .01, "TIME");
+  LinearBinner gbm_binner(m_gbm_t_start, m_gbm_t_stop, (m_gbm_t_stop - m_gbm_t_start) * .01, "TIME");
+
+  LightCurve lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  LightCurve gbm_lc(m_gbm_file, "EVENTS", "", "SC_DATA", gbm_binner, gbm_gti);
+  lc.binInput();
+  gbm_lc.binInput();
+
+  // The same light curves, binned concurrently.
+  LightCurve pool_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  LightCurve pool_gbm_lc(m_gbm_file, "EVENTS", "", "SC_DATA", gbm_binner, gbm_gti);
+  ProductPool::ProductCont_t products;
+  products.push_back(&pool_lc);
+  products.push_back(&pool_gbm_lc);
+  ProductPool pool(2);
+  pool.binInput(products);
+
+  if (!std::equal(lc.getHist1D().begin(), lc.getHist1D().end(), pool_lc.getHist1D().begin()) ||
+    !std::equal(gbm_lc.getHist1D().begin(), gbm_lc.getHist1D().end(), pool_gbm_lc.getHist1D().begin())) {
+    m_failed = true;
+    m_os.err() << "Light curves binned concurrently differ from light curves binned serially" << std::endl;
+  }
+
+  // Adding a light curve twice to an empty one doubles its counts.
+  LightCurve sum(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  sum.addCounts(lc.getHist1D());
+  sum.addCounts(pool_lc.getHist1D());
+  for (long index = 0; index != binner.getNumBins(); ++index) {
+    if (2. * lc.getHist1D()[index] != sum.getHist1D()[index]) {
+      m_failed = true;
+      m_os.err() << "Summed light curve has " << sum.getHist1D()[index] << " counts in bin " << index << ", not " <<
+        2. * lc.getHist1D()[index] << std::endl;
+    }
+  }
+}
+
+void EvtBinTest::testDeferredExposure() {
+  m_os.setMethod("testDeferredExposure()");
+
+  // The EXPOSURE keyword is computed from the spacecraft data while the events are binned.
+  Gti gti(m_ft1_file);
+  LightCurve lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA",
+    LinearBinner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .01, "TIME"), gti);
+  lc.binInput();
+  lc.writeOutput("test_evtbin", "LC_exposure.lc");
+
+  // The result must be the same as computing it directly.
+  double expected = lc.computeExposure(m_ft2_file, "SC_DATA");
+  double exposure = 0.;
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable("LC_exposure.lc", "RATE"));
+  table->getHeader()["EXPOSURE"].get(exposure);
+  if (std::fabs(exposure - expected) > 1.e-6 * std::fabs(expected)) {
+    m_failed = true;
+    m_os.err() << "EXPOSURE keyword written after binning was " << exposure << ", not " << expected << std::endl;
+  }
+
+  // Writing without binning computes the exposure then.
+  LightCurve unbinned_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA",
+    LinearBinner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .01, "TIME"), gti);
+  unbinned_lc.writeOutput("test_evtbin", "LC_exposure_unbinned.lc");
+  table.reset(tip::IFileSvc::instance().readTable("LC_exposure_unbinned.lc", "RATE"));
+  table->getHeader()["EXPOSURE"].get(exposure);
+  if (std::fabs(exposure - expected) > 1.e-6 * std::fabs(expected)) {
+    m_failed = true;
+    m_os.err() << "EXPOSURE keyword written without binning was " << exposure << ", not " << expected << std::endl;
+  }
+}
+
+void EvtBinTest::testBinExposure() {
+  m_os.setMethod("testBinExposure()");
+
+  Gti gti(m_ft1_file);
+  LinearBinner binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .01, "TIME");
+  LightCurve lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  lc.setBinExposure(true);
+  lc.binInput();
+  lc.writeOutput("test_evtbin", "LC_binexposure.lc");
+
+  // The bins cover the whole range of the light curve, so their ontime and exposure add up to the totals.
+  std::vector<double> ontime;
+  std::vector<double> exposure;
+  lc.computeBinExposure(m_ft2_file, "SC_DATA", binner, ontime, exposure);
+  double total_ontime = lc.getGti().computeOntime();
+  double total_exposure = lc.computeExposure(m_ft2_file, "SC_DATA");
+  double sum_ontime = std::accumulate(ontime.begin(), ontime.end(), 0.);
+  double sum_exposure = std::accumulate(exposure.begin(), exposure.end(), 0.);
+  if (std::fabs(sum_ontime - total_ontime) > 1.e-6 * total_ontime ||
+    std::fabs(sum_exposure - total_exposure) > 1.e-6 * total_exposure) {
+    m_failed = true;
+    m_os.err() << "Bins have total ontime " << sum_ontime << " and exposure " << sum_exposure << ", not " << total_ontime <<
+      " and " << total_exposure << std::endl;
+  }
+
+  // Each bin's exposure is at most its ontime, which is at most its width.
+  for (long index = 0; index != binner.getNumBins(); ++index) {
+    if (exposure[index] > ontime[index] * (1. + 1.e-9) || ontime[index] > binner.getBinWidth(index) * (1. + 1.e-9)) {
+      m_failed = true;
+      m_os.err() << "Bin " << index << " has exposure " << exposure[index] << " and ontime " << ontime[index] <<
+        " for a width of " << binner.getBinWidth(index) << std::endl;
+    }
+  }
+
+  // The columns written must hold the same values.
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable("LC_binexposure.lc", "RATE"));
+  long index = 0;
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor, ++index) {
+    double column_ontime = (*itor)["ONTIME"].get();
+    double column_exposure = (*itor)["EXPOSURE"].get();
+    if (column_ontime != ontime[index] || column_exposure != exposure[index]) {
+      m_failed = true;
+      m_os.err() << "Row " << index << " of LC_binexposure.lc has ONTIME " << column_ontime << " and EXPOSURE " <<
+        column_exposure << ", not " << ontime[index] << " and " << exposure[index] << std::endl;
+    }
+  }
+}
+
+void EvtBinTest::testRebin() {
+  m_os.setMethod("testRebin()");
+
+  Gti gti(m_ft1_file);
+  LinearBinner fine_binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .01, "TIME");
+  LinearBinner coarse_binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .1, "TIME");
+  LogBinner energy_binner(m_e_min, m_e_max, 100, "ENERGY");
+
+  // Products binned directly from the events.
+  LightCurve fine_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", fine_binner, gti);
+  fine_lc.binInput();
+  LightCurve coarse_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", coarse_binner, gti);
+  coarse_lc.binInput();
+  MultiSpec multi_spectrum(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", fine_binner, energy_binner, energy_binner, gti);
+  multi_spectrum.binInput();
+
+  // A coarse light curve rebinned from the fine light curve or from the spectra must have the same counts.
+  LightCurve lc_from_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", coarse_binner, gti);
+  lc_from_lc.rebin(fine_lc);
+  LightCurve lc_from_pha2(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", coarse_binner, gti);
+  lc_from_pha2.rebin(multi_spectrum);
+  if (!std::equal(coarse_lc.getHist1D().begin(), coarse_lc.getHist1D().end(), lc_from_lc.getHist1D().begin()) ||
+    !std::equal(coarse_lc.getHist1D().begin(), coarse_lc.getHist1D().end(), lc_from_pha2.getHist1D().begin())) {
+    m_failed = true;
+    m_os.err() << "Light curve rebinned from a master product differs from light curve binned from events" << std::endl;
+  }
+
+  // A spectrum rebinned from the time resolved spectra is their sum.
+  SingleSpec spectrum(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", energy_binner, energy_binner, gti);
+  spectrum.rebin(multi_spectrum);
+  const Hist2D & pha2 = multi_spectrum.getHist2D();
+  for (long energy_index = 0; energy_index != energy_binner.getNumBins(); ++energy_index) {
+    double expected = 0.;
+    for (long time_index = 0; time_index != fine_binner.getNumBins(); ++time_index) expected += pha2[time_index][energy_index];
+    if (expected != spectrum.getHist1D()[energy_index]) {
+      m_failed = true;
+      m_os.err() << "Spectrum rebinned from PHA2 has " << spectrum.getHist1D()[energy_index] << " counts in channel " <<
+        energy_index << ", not " << expected << std::endl;
+    }
+  }
+
+  // The rebinned light curve covers the same good time, so its keywords are those of the master.
+  lc_from_lc.writeOutput("test_evtbin", "LC_rebin.lc");
+  fine_lc.writeOutput("test_evtbin", "LC_rebin_master.lc");
+  double exposure = 0.;
+  double master_exposure = 0.;
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable("LC_rebin.lc", "RATE"));
+  table->getHeader()["EXPOSURE"].get(exposure);
+  table.reset(tip::IFileSvc::instance().readTable("LC_rebin_master.lc", "RATE"));
+  table->getHeader()["EXPOSURE"].get(master_exposure);
+  if (exposure != master_exposure) {
+    m_failed = true;
+    m_os.err() << "Rebinned light curve has EXPOSURE " << exposure << ", not " << master_exposure << std::endl;
+  }
+
+  // A rebinned light curve covering only part of the master's time keeps its own time span.
+  double half_stop = m_t_start + (m_t_stop - m_t_start) * .5;
+  LightCurve half_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA",
+    LinearBinner(m_t_start, half_stop, (m_t_stop - m_t_start) * .1, "TIME"), gti);
+  half_lc.rebin(fine_lc);
+  half_lc.writeOutput("test_evtbin", "LC_rebin_half.lc");
+  double tstop = 0.;
+  double master_tstop = 0.;
+  table.reset(tip::IFileSvc::instance().readTable("LC_rebin_half.lc", "RATE"));
+  table->getHeader()["TSTOP"].get(tstop);
+  table->getHeader()["EXPOSURE"].get(exposure);
+  table.reset(tip::IFileSvc::instance().readTable("LC_rebin_master.lc", "RATE"));
+  table->getHeader()["TSTOP"].get(master_tstop);
+  if (tstop > half_stop || tstop >= master_tstop) {
+    m_failed = true;
+    m_os.err() << "Light curve rebinned to half the master's time range has TSTOP " << tstop << ", not at most " <<
+      half_stop << std::endl;
+  }
+  if (exposure > master_exposure) {
+    m_failed = true;
+    m_os.err() << "Light curve rebinned to half the master's time range has EXPOSURE " << exposure <<
+      ", which is more than the master's " << master_exposure << std::endl;
+  }
+
+  // Bins which do not line up with the master's bins must be rejected.
+  try {
+    LightCurve misaligned_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA",
+      LinearBinner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .075, "TIME"), gti);
+    misaligned_lc.rebin(fine_lc);
+    m_failed = true;
+    m_os.err() << "Rebinning to bins which do not line up with the master's did not throw an exception" << std::endl;
+  } catch (const std::runtime_error &) {
+  }
+
+  // Count maps with different projections cannot be rebinned from each other.
+  CountMap count_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 100, 100, .1, 0., false, "RA", "DEC", gti);
+  count_map.binInput();
+  try {
+    CountMap other_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "CAR", 100, 100, .1, 0., false, "RA", "DEC", gti);
+    other_map.rebin(count_map);
+    m_failed = true;
+    m_os.err() << "Rebinning a count map from a map with another projection did not throw an exception" << std::endl;
+  } catch (const std::runtime_error &) {
+  }
+}
+
+void EvtBinTest::testHistND() {
+  m_os.setMethod("testHistND()");
+
+  // Count cube configuration: pixels in two linear dimensions, log energy bins.
+  LinearBinner x_binner(0.5, 20.5, 1., "X");
+  LinearBinner y_binner(0.5, 10.5, 1., "Y");
+  LogBinner energy_binner(m_e_min, m_e_max, 15, "ENERGY");
+  HistND<LinearBinner, LinearBinner, LogBinner> hist(x_binner, y_binner, energy_binner);
+  HistND<LinearBinner, LinearBinner, LogBinner> batch_hist(x_binner, y_binner, energy_binner);
+  Hist3D hist_3d(x_binner, y_binner, energy_binner);
+
+  // Values on a grid which extends past every edge of the histogram.
+  std::vector<double> x_value;
+  std::vector<double> y_value;
+  std::vector<double> energy_value;
+  for (long ii = 0; ii != 23; ++ii) {
+    for (long jj = 0; jj != 13; ++jj) {
+      for (long kk = 0; kk != 17; ++kk) {
+        x_value.push_back(ii);
+        y_value.push_back(jj);
+        energy_value.push_back(.9 * m_e_min * std::pow(1.1 * m_e_max / (.9 * m_e_min), kk / 16.));
+      }
+    }
+  }
+
+  std::vector<double> value(3);
+  for (std::vector<double>::size_type ii = 0; ii != x_value.size(); ++ii) {
+    value[0] = x_value[ii];
+    value[1] = y_value[ii];
+    value[2] = energy_value[ii];
+    hist.fillBin(value);
+    hist_3d.fillBin(value);
+  }
+  std::vector<const double *> columns;
+  columns.push_back(&x_value[0]);
+  columns.push_back(&y_value[0]);
+  columns.push_back(&energy_value[0]);
+  batch_hist.fillBins(columns, x_value.size());
+
+  // All three must agree, both in their contents and as images.
+  std::vector<double> values;
+  std::vector<double> values_3d;
+  hist.getValues(values);
+  hist_3d.getValues(values_3d);
+  if (values != values_3d || !std::equal(hist.begin(), hist.end(), batch_hist.begin())) {
+    m_failed = true;
+    m_os.err() << "HistND contents differ from Hist3D contents" << std::endl;
+  }
+  std::vector<float> image;
+  std::vector<float> image_3d;
+  hist.getImage(image);
+  hist_3d.getImage(image_3d);
+  if (image != image_3d) {
+    m_failed = true;
+    m_os.err() << "HistND image differs from Hist3D image" << std::endl;
+  }
+
+  // As a Hist, it can be the master of a rebinned histogram.
+  Hist2D sky_hist(x_binner, y_binner);
+  sky_hist.addRebinned(hist);
+  for (long ii = 0; ii != x_binner.getNumBins(); ++ii) {
+    for (long jj = 0; jj != y_binner.getNumBins(); ++jj) {
+      double expected = 0.;
+      for (long kk = 0; kk != energy_binner.getNumBins(); ++kk) expected += hist[ii * hist.getStride(0) + jj * hist.getStride(1) + kk];
+      if (expected != sky_hist[ii][jj]) {
+        m_failed = true;
+        m_os.err() << "Bin (" << ii << ", " << jj << ") summed over energy has " << sky_hist[ii][jj] << " counts, not " <<
+          expected << std::endl;
+      }
+    }
+  }
+}
+
+void EvtBinTest::testEventTypes() {
+  m_os.setMethod("testEventTypes()");
+
+  // The test data predate the EVENT_TYPE bit array, so split by conversion type: 1 (back) has bit 0 set, 0 (front) none.
+  std::string field("CONVERSION_TYPE");
+  double num_back = 0.;
+  std::vector<unsigned long> expected_type;
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(m_ft1_file, "EVENTS"));
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+    double conversion_type = (*itor)[field].get();
+    expected_type.push_back(static_cast<unsigned long>(conversion_type));
+    if (1. == conversion_type) ++num_back;
+  }
+
+  // Bit fields read through a memory mapping.
+  MappedEventTable mapped(m_ft1_file, "EVENTS");
+  std::vector<unsigned long> event_type(mapped.getNumRecords());
+  if (!mapped.hasBitField(field) || mapped.hasBitField("ENERGY")) {
+    m_failed = true;
+    m_os.err() << "MappedEventTable::hasBitField did not identify " << field << " as a bit field and ENERGY as not" << std::endl;
+  } else {
+    mapped.readBits(field, 0, mapped.getNumRecords(), &event_type[0]);
+    if (event_type != expected_type) {
+      m_failed = true;
+      m_os.err() << "MappedEventTable::readBits did not read the same values of " << field << " as tip" << std::endl;
+    }
+  }
+
+  Gti gti(m_ft1_file);
+  DataProduct::EventTypeCont_t event_types;
+  event_types.push_back(1);
+  event_types.push_back(2);
+
+  // All-sky healpix and count maps hold every event, so each map holds all the events of its type.
+  static const std::string nullString;
+  LogBinner energy_binner(m_e_min, m_e_max, 0., "ENERGY");
+  HealpixMap healpix_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", "RING", 3, nullString,
+    false, energy_binner, energy_binner, true, gti);
+  healpix_map.setEventTypes(event_types, field);
+  healpix_map.binInput();
+  healpix_map.writeOutput("test_evtbin", "test_evtype.healmap");
+
+  CountMap count_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 360, 180, 1., 0., false, "RA", "DEC", gti);
+  count_map.setEventTypes(event_types, field);
+  count_map.binInput();
+  count_map.writeOutput("test_evtbin", "CM_evtype.fits");
+
+  // The same map binned through tip must split the events the same way as the memory mapped map.
+  CountMap tip_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 360, 180, 1., 0., false, "RA", "DEC", gti);
+  tip_map.setEventTypes(event_types, field);
+  std::unique_ptr<const tip::Table> events(tip::IFileSvc::instance().readTable(m_ft1_file, "EVENTS"));
+  tip_map.binInput(events->begin(), events->end());
+  tip_map.writeOutput("test_evtbin", "CM_evtype_tip.fits");
+
+  for (DataProduct::EventTypeCont_t::size_type index = 0; index != event_types.size(); ++index) {
+    double expected = 1 == event_types[index] ? num_back : 0.;
+
+    std::string file_name = healpix_map.getEventTypeFileName("test_evtype.healmap", event_types[index]);
+    table.reset(tip::IFileSvc::instance().readTable(file_name, "SKYMAP"));
+    double total = 0.;
+    for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) total += (*itor)["CHANNEL1"].get();
+    if (expected != total) {
+      m_failed = true;
+      m_os.err() << file_name << " holds " << total << " counts, not " << expected << std::endl;
+    }
+
+    file_name = count_map.getEventTypeFileName("CM_evtype.fits", event_types[index]);
+    std::unique_ptr<const tip::Image> image(tip::IFileSvc::instance().readImage(file_name, ""));
+    std::vector<float> pixels;
+    image->get(pixels);
+    total = std::accumulate(pixels.begin(), pixels.end(), 0.);
+    if (expected != total) {
+      m_failed = true;
+      m_os.err() << file_name << " holds " << total << " counts, not " << expected << std::endl;
+    }
+
+    std::string tip_file_name = tip_map.getEventTypeFileName("CM_evtype_tip.fits", event_types[index]);
+    image.reset(tip::IFileSvc::instance().readImage(tip_file_name, ""));
+    std::vector<float> tip_pixels;
+    image->get(tip_pixels);
+    if (tip_pixels != pixels) {
+      m_failed = true;
+      m_os.err() << tip_file_name << " binned through tip differs from " << file_name << " binned through a memory mapping" <<
+        std::endl;
+    }
+  }
+
+  // A split map keeps only the map of each event type, so it has no histogram to give out or to rebin.
+  try {
+    count_map.getHist2D();
+    m_failed = true;
+    m_os.err() << "CountMap::getHist2D did not throw an exception for a map split by event type" << std::endl;
+  } catch (const std::logic_error &) {
+  }
+  try {
+    CountMap coarse_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 360, 180, 1., 0., false, "RA", "DEC",
+      gti);
+    coarse_map.rebin(count_map);
+    m_failed = true;
+    m_os.err() << "DataProduct::rebin did not throw an exception for a master split by event type" << std::endl;
+  } catch (const std::logic_error &) {
+  }
+
+  // Products which cannot be split refuse to.
+  try {
+    LightCurve lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA",
+      LinearBinner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .1, "TIME"), gti);
+    lc.setEventTypes(event_types, field);
+    m_failed = true;
+    m_os.err() << "LightCurve::setEventTypes did not throw an exception" << std::endl;
+  } catch (const std::logic_error &) {
+  }
+}
+
+void EvtBinTest::testCountMapStack() {
+  m_os.setMethod("testCountMapStack()");
+
+  Gti gti(m_ft1_file);
+  LinearBinner time_binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .25, "TIME");
+  long num_windows = time_binner.getNumBins();
+
+  // Count the events in each time window. An all-sky map holds every event.
+  std::vector<double> expected(num_windows, 0.);
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(m_ft1_file, "EVENTS"));
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+    long index = time_binner.computeIndex((*itor)["TIME"].get());
+    if (0 <= index) ++expected[index];
+  }
+
+  CountMapStack stack(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 360, 180, 1., 0., false, "RA", "DEC",
+    time_binner, gti);
+  stack.binInput();
+  stack.writeOutput("test_evtbin", "CM_stack.fits");
+  stack.setWindowImages(true);
+  stack.writeOutput("test_evtbin", "CM_stack.fits");
+
+  // Each plane of the cube and each window's count map hold the events of that window.
+  std::unique_ptr<const tip::Image> image(tip::IFileSvc::instance().readImage("CM_stack.fits", ""));
+  std::vector<float> cube;
+  image->get(cube);
+  long plane_size = 360 * 180;
+  if (std::vector<float>::size_type(plane_size * num_windows) != cube.size()) {
+    m_failed = true;
+    m_os.err() << "CM_stack.fits has " << cube.size() << " pixels, not " << plane_size * num_windows << std::endl;
+    return;
+  }
+  for (long index = 0; index != num_windows; ++index) {
+    double total = std::accumulate(cube.begin() + index * plane_size, cube.begin() + (index + 1) * plane_size, 0.);
+    if (expected[index] != total) {
+      m_failed = true;
+      m_os.err() << "plane " << index << " of CM_stack.fits holds " << total << " counts, not " << expected[index] << std::endl;
+    }
+
+    std::string file_name = stack.getWindowFileName("CM_stack.fits", index);
+    image.reset(tip::IFileSvc::instance().readImage(file_name, ""));
+    std::vector<float> pixels;
+    image->get(pixels);
+    total = std::accumulate(pixels.begin(), pixels.end(), 0.);
+    if (expected[index] != total) {
+      m_failed = true;
+      m_os.err() << file_name << " holds " << total << " counts, not " << expected[index] << std::endl;
+    }
+
+    // The ONTIME of each window is its overlap with the GTI.
+    Gti window;
+    window.insertInterval(time_binner.getInterval(index).begin(), time_binner.getInterval(index).end());
+    double expected_ontime = (stack.getGti() & window).computeOntime();
+    double ontime = 0.;
+    image->getHeader()["ONTIME"].get(ontime);
+    if (std::fabs(expected_ontime - ontime) > 1.e-6 * (1. + expected_ontime)) {
+      m_failed = true;
+      m_os.err() << file_name << " has ONTIME " << ontime << ", not " << expected_ontime << std::endl;
+    }
+  }
+
+  // A count map can be made from the stack by summing over time.
+  CountMap count_map(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 360, 180, 1., 0., false, "RA", "DEC", gti);
+  count_map.rebin(stack);
+  std::vector<double> values;
+  count_map.getHist2D().getValues(values);
+  double total = std::accumulate(values.begin(), values.end(), 0.);
+  double expected_total = std::accumulate(expected.begin(), expected.end(), 0.);
+  if (expected_total != total) {
+    m_failed = true;
+    m_os.err() << "count map rebinned from count map stack holds " << total << " counts, not " << expected_total << std::endl;
+  }
+
+  // A stack with longer windows can be made from the stack without expanding either one.
+  LinearBinner coarse_binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .5, "TIME");
+  CountMapStack coarse_stack(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", 0., 0., "AIT", 360, 180, 1., 0., false, "RA",
+    "DEC", coarse_binner, gti);
+  coarse_stack.rebin(stack);
+  coarse_stack.writeOutput("test_evtbin", "CM_stack_coarse.fits");
+  image.reset(tip::IFileSvc::instance().readImage("CM_stack_coarse.fits", ""));
+  image->get(cube);
+  for (long index = 0; index != coarse_binner.getNumBins(); ++index) {
+    total = std::accumulate(cube.begin() + index * plane_size, cube.begin() + (index + 1) * plane_size, 0.);
+    expected_total = expected[2 * index] + expected[2 * index + 1];
+    if (expected_total != total) {
+      m_failed = true;
+      m_os.err() << "plane " << index << " of CM_stack_coarse.fits holds " << total << " counts, not " << expected_total <<
+        std::endl;
+    }
+  }
+}
+
+void EvtBinTest::testApertureLightCurve() {
+  m_os.setMethod("testApertureLightCurve()");
+
+  Gti gti(m_ft1_file);
+  LinearBinner time_binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .1, "TIME");
+  long num_bins = time_binner.getNumBins();
+
+  // Read the events.
+  std::vector<double> time;
+  std::vector<double> ra;
+  std::vector<double> dec;
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(m_ft1_file, "EVENTS"));
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) {
+    time.push_back((*itor)["TIME"].get());
+    ra.push_back((*itor)["RA"].get());
+    dec.push_back((*itor)["DEC"].get());
+  }
+  if (time.empty()) {
+    m_failed = true;
+    m_os.err() << m_ft1_file << " has no events" << std::endl;
+    return;
+  }
+
+  // Apertures of very different sizes, centered on events so that they are not empty, and one around a pole.
+  LightCurve::ApertureCont_t apertures;
+  apertures.push_back(LightCurve::Aperture("small", ra[0], dec[0], .5));
+  apertures.push_back(LightCurve::Aperture("medium", ra[time.size() / 2], dec[time.size() / 2], 10.));
+  apertures.push_back(LightCurve::Aperture("large", ra[0] + 180., -dec[0], 60.));
+  apertures.push_back(LightCurve::Aperture("pole", 0., 90., 20.));
+
+  // Count the events in each aperture by brute force.
+  static const double deg = 3.14159265358979323846 / 180.;
+  std::vector<std::vector<double> > expected(apertures.size(), std::vector<double>(num_bins, 0.));
+  for (std::vector<double>::size_type event = 0; event != time.size(); ++event) {
+    long index = time_binner.computeIndex(time[event]);
+    if (0 > index) continue;
+    for (LightCurve::ApertureCont_t::size_type aperture = 0; aperture != apertures.size(); ++aperture) {
+      const LightCurve::Aperture & ap(apertures[aperture]);
+      double cos_dist = std::sin(dec[event] * deg) * std::sin(ap.getDec() * deg) +
+        std::cos(dec[event] * deg) * std::cos(ap.getDec() * deg) * std::cos((ra[event] - ap.getRa()) * deg);
+      if (cos_dist >= std::cos(ap.getRadius() * deg)) ++expected[aperture][index];
+    }
+  }
+
+  LightCurve lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", time_binner, gti);
+  lc.setApertures(apertures);
+  lc.binInput();
+  lc.writeOutput("test_evtbin", "LC_apertures.lc");
+
+  for (LightCurve::ApertureCont_t::size_type aperture = 0; aperture != apertures.size(); ++aperture) {
+    const Hist1D & hist(lc.getApertureHist(aperture));
+    for (long index = 0; index != num_bins; ++index) {
+      if (std::fabs(expected[aperture][index] - hist[index]) > .5) {
+        m_failed = true;
+        m_os.err() << "aperture " << apertures[aperture].getName() << " has " << hist[index] << " counts in bin " << index <<
+          ", not " << expected[aperture][index] << std::endl;
+      }
+    }
+  }
+
+  // The output has one element of COUNTS per aperture in each row of RATE.
+  table.reset(tip::IFileSvc::instance().readTable("LC_apertures.lc", "RATE"));
+  long index = 0;
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor, ++index) {
+    std::vector<double> counts;
+    (*itor)["COUNTS"].get(counts);
+    for (std::vector<double>::size_type aperture = 0; aperture != counts.size() && aperture != apertures.size(); ++aperture) {
+      if (expected[aperture][index] != counts[aperture]) {
+        m_failed = true;
+        m_os.err() << "LC_apertures.lc has " << counts[aperture] << " counts in row " << index << " for aperture " <<
+          apertures[aperture].getName() << ", not " << expected[aperture][index] << std::endl;
+      }
+    }
+    if (counts.size() != apertures.size()) {
+      m_failed = true;
+      m_os.err() << "LC_apertures.lc has " << counts.size() << " elements of COUNTS, not " << apertures.size() << std::endl;
+    }
+  }
+  table.reset(tip::IFileSvc::instance().readTable("LC_apertures.lc", "APERTURES"));
+  if (table->getNumRecords() != long(apertures.size())) {
+    m_failed = true;
+    m_os.err() << "LC_apertures.lc has " << table->getNumRecords() << " apertures, not " << apertures.size() << std::endl;
+  }
+
+  // Apertures must have a positive radius. A bad aperture after a good one leaves the light curve as it was.
+  try {
+    LightCurve::ApertureCont_t bad_apertures(1, LightCurve::Aperture("good", 0., 0., 10.));
+    bad_apertures.push_back(LightCurve::Aperture("bad", 0., 0., 0.));
+    lc.setApertures(bad_apertures);
+    m_failed = true;
+    m_os.err() << "LightCurve::setApertures did not throw an exception for an aperture of radius 0" << std::endl;
+  } catch (const std::runtime_error &) {
+  }
+  if (lc.getApertures().size() != apertures.size() || lc.getApertures()[0].getName() != apertures[0].getName() ||
+    !std::equal(lc.getApertureHist(0).begin(), lc.getApertureHist(0).end(), expected[0].begin())) {
+    m_failed = true;
+    m_os.err() << "LightCurve::setApertures changed the apertures although one of the new apertures was bad" << std::endl;
+  }
+}
+
+void EvtBinTest::testDetectorExposure() {
+  m_os.setMethod("testDetectorExposure()");
+
+  // One light curve per detector file, each with spacecraft data, binned concurrently as gtbin does for several detectors.
+  const char * det_file_name[] = { "ft1tiny0.fits", "ft1tiny1.fits", "ft1tiny2.fits" };
+  LinearBinner binner(m_t_start, m_t_stop, (m_t_stop - m_t_start) * .01, "TIME");
+  std::vector<std::shared_ptr<LightCurve> > product_cont;
+  ProductPool::ProductCont_t pool_cont;
+  for (int index = 0; index != 3; ++index) {
+    std::string det_file = facilities::commonUtilities::joinPath(m_data_dir, det_file_name[index]);
+    product_cont.push_back(std::shared_ptr<LightCurve>(new LightCurve(det_file, "EVENTS", m_ft2_file, "SC_DATA", binner,
+      Gti(det_file))));
+    pool_cont.push_back(product_cont.back().get());
+  }
+  ProductPool pool(3);
+  pool.binInput(pool_cont);
+
+  // Write each output in turn, and check its exposure against one computed directly.
+  for (int index = 0; index != 3; ++index) {
+    std::ostringstream out_file;
+    out_file << "LC_detector" << index << ".lc";
+    product_cont[index]->writeOutput("test_evtbin", out_file.str());
+
+    double expected = product_cont[index]->computeExposure(m_ft2_file, "SC_DATA");
+    double exposure = 0.;
+    std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(out_file.str(), "RATE"));
+    table->getHeader()["EXPOSURE"].get(exposure);
+    if (std::fabs(exposure - expected) > 1.e-6 * std::fabs(expected)) {
+      m_failed = true;
+      m_os.err() << "EXPOSURE keyword of " << out_file.str() << " was " << exposure << ", not " << expected << std::endl;
+    }
+  }
+}
+
+void EvtBinTest::testTimeWindow() {
+  m_os.setMethod("testTimeWindow()");
+
+  // Read the event times, and put the edges of the window on events, the middle half of them.
+  std::unique_ptr<const tip::Table> table(tip::IFileSvc::instance().readTable(m_ft1_file, "EVENTS"));
+  std::vector<double> time;
+  for (tip::Table::ConstIterator itor = table->begin(); itor != table->end(); ++itor) time.push_back((*itor)["TIME"].get());
+  long num_rec = time.size();
+  if (4 > num_rec) {
+    m_failed = true;
+    m_os.err() << m_ft1_file << " has too few events to test time windows" << std::endl;
+    return;
+  }
+  double window_begin = time[num_rec / 4];
+  double window_end = time[3 * num_rec / 4];
+  LinearBinner binner(window_begin, window_end, (window_end - window_begin) / 7., "TIME");
+  Gti gti(m_ft1_file);
+
+  // Light curve binned from every row.
+  LightCurve full_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  full_lc.binInput(table->begin(), table->end());
+
+  // Light curve binned from the rows found by seeking through tip.
+  WindowLightCurve tip_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  tip::Table::ConstIterator begin = table->begin();
+  tip::Table::ConstIterator end = table->end();
+  tip_lc.seekTimeWindow(*table, begin, end);
+  long first = std::distance(table->begin(), begin);
+  long last = std::distance(table->begin(), end);
+  tip_lc.binInput(begin, end);
+
+  // Light curve binned from the rows found by seeking through a memory mapping.
+  WindowLightCurve mapped_lc(m_ft1_file, "EVENTS", m_ft2_file, "SC_DATA", binner, gti);
+  MappedEventTable mapped(m_ft1_file, "EVENTS");
+  long first_record = 0;
+  long last_record = mapped.getNumRecords();
+  mapped_lc.seekTimeWindow(mapped, first_record, last_record);
+  mapped_lc.binInput(mapped, first_record, last_record);
+
+  // Both must find the same rows, with the window's edge events inside and their neighbors outside.
+  if (first != first_record || last != last_record) {
+    m_failed = true;
+    m_os.err() << "seeking the window through tip found rows [" << first << ", " << last << "), through a memory mapping [" <<
+      first_record << ", " << last_record << ")" << std::endl;
+  }
+  if (!(0 <= first && first < last && last <= num_rec) || window_begin != time[first] || window_end != time[last - 1] ||
+    (0 < first && time[first - 1] >= window_begin) || (num_rec > last && time[last] <= window_end) ||
+    num_rec == last - first) {
+    m_failed = true;
+    m_os.err() << "seeking the window [" << window_begin << ", " << window_end << "] found rows [" << first << ", " << last <<
+      ") of " << num_rec << std::endl;
+  }
+
+  // So all three light curves must be the same.
+  const Hist1D & full_hist = full_lc.getHist1D();
+  if (!std::equal(full_hist.begin(), full_hist.end(), tip_lc.getHist1D().begin()) ||
+    !std::equal(full_hist.begin(), full_hist.end(), mapped_lc.getHist1D().begin())) {
+    m_failed = true;
+    m_os.err() << "light curve binned from the rows inside its time window differs from the one binned from every row" <<
+      std::endl;
+  }
+}
+
 /// \brief Create factory singleton object which will create the application:
 st_app::StAppFactory<EvtBinTest> g_app_factory("test_evtbin");